@@ -51,20 +51,25 @@
     #include <stdint.h>
     extern uint32_t SystemCoreClock;
 /* USER CODE BEGIN 0 */   	      
-    extern volatile unsigned long ulHighFrequencyTimerTicks;
+    void configureTimerForRunTimeStats(void);
+    unsigned long getRunTimeCounterValue(void);
+    void Profile_Task_Switched_In(void);
+    void Profile_Task_Switched_Out(void);
+    void Stack_Monitor_Task_Created(void *task, uint32_t stack_words);
+    void Stack_Monitor_Task_Deleted(void *task);
 /* USER CODE END 0 */       
 #endif
 
 #define configUSE_PREEMPTION                     1
-#define configSUPPORT_STATIC_ALLOCATION          0
-#define configSUPPORT_DYNAMIC_ALLOCATION         1
-#define configUSE_IDLE_HOOK                      0
+#define configSUPPORT_STATIC_ALLOCATION          1
+#define configSUPPORT_DYNAMIC_ALLOCATION         0
+#define configUSE_IDLE_HOOK                      1
 #define configUSE_TICK_HOOK                      0
+#define configUSE_TICKLESS_IDLE                  2
 #define configCPU_CLOCK_HZ                       ( SystemCoreClock )
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 7 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)64)
-#define configTOTAL_HEAP_SIZE                    ((size_t)12000)
 #define configMAX_TASK_NAME_LEN                  ( 16 )
 #define configGENERATE_RUN_TIME_STATS            1
 #define configUSE_TRACE_FACILITY                 1
@@ -76,6 +81,12 @@
 #define configUSE_CO_ROUTINES                    0
 #define configMAX_CO_ROUTINE_PRIORITIES          ( 2 )
 
+/* Software timer definitions. */
+#define configUSE_TIMERS                         1
+#define configTIMER_TASK_PRIORITY                ( 2 )
+#define configTIMER_QUEUE_LENGTH                 10
+#define configTIMER_TASK_STACK_DEPTH             192
+
 /* Set the following definitions to 1 to include the API function, or zero
 to exclude the API function. */
 #define INCLUDE_vTaskPrioritySet            1
@@ -83,9 +94,10 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelete                 1
 #define INCLUDE_vTaskCleanUpResources       0
 #define INCLUDE_vTaskSuspend                1
-#define INCLUDE_vTaskDelayUntil             0
+#define INCLUDE_vTaskDelayUntil             1
 #define INCLUDE_vTaskDelay                  1
 #define INCLUDE_xTaskGetSchedulerState      1
+#define INCLUDE_uxTaskGetStackHighWaterMark 1
 
 /* Normal assert() semantics without relying on the provision of an assert.h
 header file. */
@@ -104,26 +116,38 @@ standard names. */
 
 /* USER CODE BEGIN 2 */    
 /* Definitions needed when configGENERATE_RUN_TIME_STATS is on */
-#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() ( ulHighFrequencyTimerTicks = 0UL )
-#define portGET_RUN_TIME_COUNTER_VALUE() ulHighFrequencyTimerTicks
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS configureTimerForRunTimeStats
+#define portGET_RUN_TIME_COUNTER_VALUE getRunTimeCounterValue
 /* USER CODE END 2 */
 
 /* USER CODE BEGIN Defines */   	      
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
-#define configCOMMAND_INT_MAX_OUTPUT_SIZE 3200
+#define configCOMMAND_INT_MAX_OUTPUT_SIZE 1024 // task-stats is the longest output not streamed, about 40 bytes a task
+#define configCOMMAND_INT_MAX_COMMANDS 24 // Checked against the command table in CLI-commands.c
 #define configUSE_STATS_FORMATTING_FUNCTIONS 1
 #define configUSE_TASK_NOTIFICATIONS 1
 
+/* Per task execution time accounting in profile.c */
+#define traceTASK_SWITCHED_IN()			Profile_Task_Switched_In()
+#define traceTASK_SWITCHED_OUT()		Profile_Task_Switched_Out()
+
+/* Stack size and high water mark of every task in stack_monitor.c. pxEndOfStack gives the size. */
+#define configRECORD_STACK_HIGH_ADDRESS	1
+#define traceTASK_CREATE(pxNewTCB)		Stack_Monitor_Task_Created((pxNewTCB), (uint32_t)(((pxNewTCB)->pxEndOfStack - (pxNewTCB)->pxStack) + 1))
+#define traceTASK_DELETE(pxTCB)			Stack_Monitor_Task_Deleted(pxTCB)
+
 /* Priorities at which the tasks are created. */
-#define REGULATOR_TASK_PRIORITY			( tskIDLE_PRIORITY + 4 )
-#define ADC_TASK_PRIORITY				( tskIDLE_PRIORITY + 3 )
-#define USBPD_TASK_PRIORITY				( tskIDLE_PRIORITY + 3 )
-#define	LED_TASK_PRIORITY				( tskIDLE_PRIORITY + 2 )
+#define CONTROL_TASK_PRIORITY			( tskIDLE_PRIORITY + 4 )
+#define TELEMETRY_TASK_PRIORITY			( tskIDLE_PRIORITY + 2 )
 #define UART_CLI_TASK_PRIORITY			( tskIDLE_PRIORITY + 1 )
+#define EVENT_LOG_TASK_PRIORITY			( tskIDLE_PRIORITY + 1 )
 
+/* Stack sizes in words. All task memory is static, see rtos_static.h, and is listed by Tools/ram_report.py at link time. */
+#define vIdle_STACK_SIZE				( configMINIMAL_STACK_SIZE * 2 )
 #define vcliSTACK_SIZE					( configMINIMAL_STACK_SIZE * 6 )
-#define vRead_ADC_STACK_SIZE			( configMINIMAL_STACK_SIZE * 5 )
-#define vRegulator_STACK_SIZE			( configMINIMAL_STACK_SIZE * 4 )
+#define vControl_STACK_SIZE				( configMINIMAL_STACK_SIZE * 5 )
+#define vTelemetry_STACK_SIZE			( configMINIMAL_STACK_SIZE * 2 )
+#define vEvent_Log_STACK_SIZE			( configMINIMAL_STACK_SIZE * 3 )
 
 /* USER CODE END Defines */ 
 
@@ -16,7 +16,8 @@ extern "C" {
 #include "FreeRTOS.h"
 #include "cmsis_os.h"
 
-#define ADC_FILTER_SUM_COUNT		380
+#define ADC_FILTER_SUM_COUNT		380 // About 115ms per filtered reading
+#define ADC_READING_TIMEOUT_MS		500
 
 #define BATTERY_ADC_MULTIPLIER 		1000000
 
@@ -37,6 +38,24 @@ extern "C" {
 
 #define SCALAR_ARRAY_SIZE			5
 
+//Calibrated voltage in uV = ((reading * gain) + offset) >> ADC_CAL_GAIN_SHIFT. Sized so the product fits in an int32_t.
+#define ADC_CAL_GAIN_SHIFT			6
+#define ADC_CAL_MIN_GAIN_UV			750 // uV per count, same limits as the old integer scalars
+#define ADC_CAL_MAX_GAIN_UV			5000
+#define ADC_CAL_MAX_OFFSET_UV		200000
+#define ADC_CAL_MAX_TEMPCO_PPM		2000 // Gain change per degree C
+#define ADC_CAL_MIN_SPAN_UV			1000000 // Points at least this far apart give a two point calibration
+#define ADC_CAL_SAME_POINT_UV		50000 // A point this close to the last one, taken ADC_CAL_MIN_TC_DELTA_C warmer or colder, gives the temperature coefficient
+#define ADC_CAL_MIN_TC_DELTA_C		10
+
+//Per channel calibration: battery, cell 1, 2S, 3S and 4S taps
+struct Adc_Calibration {
+	int32_t gain[SCALAR_ARRAY_SIZE]; // uV per count << ADC_CAL_GAIN_SHIFT
+	int32_t offset_uv[SCALAR_ARRAY_SIZE];
+	int16_t tempco_ppm[SCALAR_ARRAY_SIZE];
+	int16_t temperature_c; // MCU temperature the gain was measured at
+};
+
 /**
  * @brief  OTP memory start address
  */
@@ -57,7 +76,9 @@ extern "C" {
  */
 #define OTP_SIZE			128
 
-void vRead_ADC(void const *pvParameters);
+void ADC_Start(void);
+
+uint8_t ADC_Update(void);
 
 uint8_t Calibrate_ADC(float reference_voltage_mv);
 
@@ -77,7 +98,11 @@ uint32_t Get_VDDa(void);
 
 uint8_t Write_Cal_To_OTP_Flash(void);
 
-osThreadId adcTaskHandle;
+uint8_t Save_Cal_To_Flash(void);
+
+void Get_ADC_Calibration(struct Adc_Calibration *calibration);
+
+uint8_t Set_ADC_Calibration(const struct Adc_Calibration *calibration);
 
 #ifdef __cplusplus
 }
@@ -33,6 +33,9 @@ extern "C" {
 #define CHARGE_OPTION_0_ADDR		0x00
 #define MINIMUM_SYSTEM_VOLTAGE_ADDR	0x0D
 #define CHARGE_STATUS_ADDR			0x20
+#define PROCHOT_STATUS_ADDR			0x22
+#define INPUT_CURRENT_HOST_ADDR		0x0E
+#define INPUT_CURRENT_DPM_ADDR		0x24
 #define ADC_OPTION_ADDR				0x3A
 #define VBUS_ADC_ADDR				0x27
 #define PSYS_ADC_ADDR				0x26
@@ -46,6 +49,23 @@ extern "C" {
 #define EN_OOA						0b1
 
 #define CHARGING_ENABLED_MASK		0b00000100
+
+/* ChargerStatus LSB fault bits */
+#define FAULT_ACOV_MASK				0b10000000
+#define FAULT_BATOC_MASK			0b01000000
+#define FAULT_ACOC_MASK				0b00100000
+#define FAULT_SYSOVP_MASK			0b00010000
+#define FAULT_LATCHOFF_MASK			0b00000100
+#define CHARGER_FAULT_MASK			(FAULT_ACOV_MASK | FAULT_BATOC_MASK | FAULT_ACOC_MASK | FAULT_SYSOVP_MASK | FAULT_LATCHOFF_MASK)
+
+/* ProchotStatus LSB bits, latched until read */
+#define STAT_COMP_MASK				0b01000000
+#define STAT_ICRIT_MASK				0b00100000
+#define STAT_INOM_MASK				0b00010000
+#define STAT_IDCHG_MASK				0b00001000
+#define STAT_VSYS_MASK				0b00000100
+#define STAT_BATTERY_REMOVAL_MASK	0b00000010
+#define STAT_ADAPTER_REMOVAL_MASK	0b00000001
 #define ADC_ENABLED_BITMASK			0b01010111
 #define ADC_START_CONVERSION_MASK	0b01100000
 
@@ -89,8 +109,14 @@ extern "C" {
 
 #define IIN_ADC_SCALE				(uint32_t)(0.050 * REG_ADC_MULTIPLIER)
 
+//IIN_HOST and IIN_DPM registers. 7 bit value in the msb, 50mA per step
+#define INPUT_CURRENT_STEP_MA		50
+#define INPUT_CURRENT_REG_MAX		0x7F
+
+//Defaults for the runtime parameters in params.c. Also MAX_CHARGING_POWER, TEMP_THROTTLE_THRESH_C and UVP_RECOVERY_CURRENT_MA
 #define MAX_CHARGE_CURRENT_MA		3800 // 3800 / 3650 / 2500
 #define CHARGE_TERM_CURRENT_MA  500
+#define CHARGE_TERM_DEBOUNCE_MS		750 // Charge current under the termination current this long ends the charge
 #define ASSUME_EFFICIENCY			0.85f
 #define BATTERY_DISCONNECT_THRESH	(uint32_t)(4.215 * REG_ADC_MULTIPLIER)
 #define MAX_CHARGING_POWER			60000
@@ -98,13 +124,37 @@ extern "C" {
 
 #define TEMP_THROTTLE_THRESH_C		50
 
+//Closed loop regulation of the measured input current to a fraction of the PD contract current
+#define INPUT_CURRENT_CLOSED_LOOP		1
+#define INPUT_CURRENT_TARGET_PERCENT	95
+#define INPUT_CURRENT_LOOP_KP_PERCENT	50
+#define INPUT_CURRENT_LOOP_KI_PERCENT	20
+#define INPUT_CURRENT_LOOP_PERIOD_MS	250 // The gains are per actuate period of the control executive
+
+//Backs the charge current off when the source droops and binary searches back up to the sustainable limit
+#define SOURCE_DROOP_DETECTION			1
+#define SOURCE_DROOP_THRESH_MV			1500 // VBUS below the contract voltage by this much counts as a droop
+#define SOURCE_DROOP_BACKOFF_PERCENT	75
+#define SOURCE_DROOP_STABLE_MS			5000 // Time without a droop before probing up
+#define SOURCE_DROOP_RESOLUTION_MA		128 // Search stops once the window is two charge current steps wide
+#define SOURCE_INPUT_DEBOUNCE_MS		2000 // CHRG_OK low for longer than this is a lost input rather than a droop
+
+//Charger pin events notified to the control executive from the EXTI callbacks
+#define REGULATOR_EVENT_CHRG_OK_FALL	0x01
+#define REGULATOR_EVENT_CHRG_OK_RISE	0x02
+#define REGULATOR_EVENT_PROCHOT			0x04
+
 #define FIXED_VOLTAGE_CHARGING    1
-#define FIXED_VOLTAGE_SETPOINT    15730 // 15730, 16400,
-#define FIXED_VOLTAGE_PRECHARGE   12400
-//Fixed voltage charging settings are configured in Set_Charge_Voltage function
+#define FIXED_VOLTAGE_CELL_SETPOINT    3932 // mV per cell, 3932 (15730 for 4S), 4100 (16400 for 4S)
+#define FIXED_VOLTAGE_CELL_PRECHARGE   3100 // mV per cell, 12400 for 4S
+//Fixed voltage charging settings are configured in Set_Charge_Voltage function, scaled by the cell count
 
 #define ATTEMPT_UVP_RECOVERY          1
 #define UVP_RECOVERY_CURRENT_MA       200
+#define UVP_RECOVERY_ATTEMPTS         300 // Up to 3s * 300 of precharge
+#define UVP_RECOVERY_FIRST_PULSE_STEPS 20 // Regulator steps of 250ms
+#define UVP_RECOVERY_PULSE_STEPS      12
+#define UVP_RECOVERY_SETTLE_STEPS     4
 
 
 
@@ -116,12 +166,22 @@ uint32_t Get_PSYS_ADC_Reading(void);
 uint32_t Get_Input_Current_ADC_Reading(void);
 uint32_t Get_Charge_Current_ADC_Reading(void);
 uint32_t Get_Max_Charge_Current(void);
+uint32_t Get_Input_Current_Limit(void);
+uint32_t Get_Source_Current_Limit(void);
+uint16_t Get_Charger_Status(void);
+uint8_t Get_Prochot_Status(void);
+uint32_t Get_Charger_Fault_Events(void);
+uint8_t Get_Thermal_Throttle_State(void);
 uint8_t Get_Precharge_State();
-void vRegulator(void const *pvParameters);
+void Regulator_Init(void);
+void Regulator_Sense(void);
+void Regulator_Estimate(void);
+void Regulator_Decide(void);
+void Regulator_Actuate(void);
+void Handle_Charger_Events(uint32_t events);
 
 /* Used to guard access to the I2C in case messages are sent to the UART from
  more than one task. */
 extern SemaphoreHandle_t xTxMutex_Regulator;
-osThreadId regulatorTaskHandle;
 
 #endif /* BQ25703A_REGULATOR_H_ */
@@ -0,0 +1,64 @@
+/**
+ ******************************************************************************
+ * @file           : control.h
+ * @brief          : Header for control.c file.
+ ******************************************************************************
+ */
+
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+#include "cmsis_os.h"
+
+//Every stage period is a whole number of frames. A filtered ADC reading takes about 115ms, so nearly every frame has a new one.
+#define CONTROL_FRAME_MS			125
+#define CONTROL_STAGE_COUNT			9 // Entries in the stage table in control.c
+
+//Stages run in this order within a frame
+#define CONTROL_STAGE_SENSE			0
+#define CONTROL_STAGE_ESTIMATE		1
+#define CONTROL_STAGE_DECIDE		2
+#define CONTROL_STAGE_ACTUATE		3
+#define CONTROL_STAGE_INDICATE		4
+
+struct Control_Stage_Stats {
+	const char *name;
+	uint16_t period_ms;
+	uint16_t deadline_ms; // From the frame release
+	uint32_t runs;
+	uint32_t overruns;
+	uint32_t max_response_us; // From the frame release to the end of the stage
+};
+
+struct Control_Frame_Stats {
+	uint32_t frames;
+	uint32_t late_frames; // Released after their release time because the frame before ran long
+	uint32_t skipped_frames; // Not run at all, a late frame only runs the latest release
+	uint32_t event_frames; // Extra frames for charger pin events, only run the stages marked for them
+	uint32_t max_latency_us; // From the start of the sense stage to the end of the actuate stage
+	uint32_t max_event_latency_us; // From a charger pin edge to the backoff being written to the charger
+};
+
+void vControl(void const *pvParameters);
+
+void Control_Notify_From_ISR(uint32_t events);
+
+void Control_Reset_Stats(void);
+
+void Get_Control_Frame_Stats(struct Control_Frame_Stats *stats);
+
+uint8_t Get_Control_Stage_Stats(uint8_t index, struct Control_Stage_Stats *stats);
+
+osThreadId controlTaskHandle;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONTROL_H_ */
@@ -0,0 +1,23 @@
+/**
+ ******************************************************************************
+ * @file           : crc.h
+ * @brief          : Header for crc.c file.
+ ******************************************************************************
+ */
+
+#ifndef CRC_H_
+#define CRC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+
+uint16_t CRC16_CCITT(const uint8_t *data, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRC_H_ */
@@ -22,10 +22,54 @@
 #define REGULATOR_COMMUNICATION_ERROR	0b010000
 #define VOLTAGE_INPUT_ERROR				0b100000
 
+#define ERROR_COUNT						6 // Error n is bit (1 << n) of the error state
+
+//What happens to an error when its condition goes away, set per error in the policy table in error.c
+#define ERROR_POLICY_SELF_CLEAR			0 // Clears straight away
+#define ERROR_POLICY_RETRY				1 // Clears once the condition has been gone for the back-off
+#define ERROR_POLICY_LATCH				2 // Stays set until Error_Reset
+
+#define ERROR_RETRY_WINDOW_MS			60000 // An error back within this long of clearing is a retry, which doubles the back-off
+#define ERROR_MAX_BACKOFF_SHIFT			5 // The back-off stops doubling at 32 times the first
+
+//Error_Event.type, 0 is kept for a telemetry frame without an event
+#define ERROR_EVENT_NONE				0
+#define ERROR_EVENT_SET					1
+#define ERROR_EVENT_CLEAR				2
+#define ERROR_EVENT_LATCH				3 // A retry error ran out of retries
+#define ERROR_EVENT_RESET				4
+#define ERROR_EVENT_QUEUE_LENGTH		16 // Events, must be a power of 2. The oldest is dropped when full.
+
+struct Error_Stats {
+	const char *name;
+	uint8_t policy;
+	uint8_t active; // Bit set in the error state
+	uint8_t raised; // The condition is still present, an active error that is not raised is backing off
+	uint8_t latched;
+	uint8_t retries; // Times back within the retry window, reset by a clear that lasts longer
+	uint32_t count; // Times the error went active
+	uint32_t first_ms; // Tick time it first went active, only valid when count is not 0
+	uint32_t last_ms; // Tick time it was last set
+	uint32_t backoff_ms;
+};
+
+struct Error_Event {
+	uint16_t sequence; // Counts every event, a gap means the consumer fell behind
+	uint8_t type;
+	uint8_t error; // Bit number, not the mask
+	uint32_t time_ms;
+};
+
 uint32_t Get_Error_State(void);
 
 void Set_Error_State(uint32_t error_bitmask);
 
 void Clear_Error_State(uint32_t error_bitmask);
 
+void Error_Reset(uint32_t error_bitmask);
+
+uint8_t Get_Error_Stats(uint8_t error, struct Error_Stats *stats);
+
+uint8_t Error_Read_Event(struct Error_Event *event);
+
 #endif /* ERROR_H_ */
@@ -0,0 +1,59 @@
+/**
+ ******************************************************************************
+ * @file           : event_log.h
+ * @brief          : Header for event_log.c file.
+ ******************************************************************************
+ */
+
+#ifndef EVENT_LOG_H_
+#define EVENT_LOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+#include "cmsis_os.h"
+
+//0: format strings only go to the unloaded .event_log_fmt section of the ELF. The task prints
+//   raw "#EVT" records and Tools/event_log_decode.py formats them from the ELF. The default, it keeps
+//   the format strings out of flash.
+//1: format strings are kept in flash and the event log task prints formatted lines, for a console
+//   without the decoder.
+#define EVENT_LOG_FORMAT_ON_DEVICE	0
+
+#define EVENT_LOG_SIZE				32 // Records, must be a power of 2
+#define EVENT_LOG_MAX_ARGS			4
+#define EVENT_LOG_TASK_PERIOD_MS	100
+
+#if EVENT_LOG_FORMAT_ON_DEVICE
+#define EVENT_LOG_FMT_ATTRIBUTE
+#else
+#define EVENT_LOG_FMT_ATTRIBUTE		__attribute__((section(".event_log_fmt"), used))
+#endif
+
+#define EVENT_LOG_NARGS(...)							EVENT_LOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define EVENT_LOG_NARGS_(_0, _1, _2, _3, _4, N, ...)	N
+
+//Records an event with up to EVENT_LOG_MAX_ARGS arguments without formatting it. Safe from tasks and interrupts.
+//Arguments are stored as 32 bit words, so only integer conversions (%u %d %x %c) can be used. Lines end without \r\n.
+#define EVENT_LOG(fmt, ...) do { \
+		static const char event_log_fmt[] EVENT_LOG_FMT_ATTRIBUTE = fmt; \
+		const uint32_t event_log_args[EVENT_LOG_MAX_ARGS] = { __VA_ARGS__ }; \
+		Event_Log_Write(event_log_fmt, EVENT_LOG_NARGS(__VA_ARGS__), event_log_args); \
+	} while (0)
+
+void Event_Log_Write(const char *fmt, uint8_t nargs, const uint32_t *args);
+
+uint32_t Get_Event_Log_Dropped(void);
+
+void vEvent_Log(void const *pvParameters);
+
+osThreadId eventLogTaskHandle;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_LOG_H_ */
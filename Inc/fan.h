@@ -0,0 +1,41 @@
+/**
+ ******************************************************************************
+ * @file           : fan.h
+ * @brief          : Header for fan.c file.
+ ******************************************************************************
+ */
+
+#ifndef FAN_H_
+#define FAN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+
+//FAN_ENn shares TIM2 with the USB PD timer server so it can not be hardware PWM.
+//The fan is burst modulated instead: on for duty% of FAN_BURST_PERIOD_MS, never switching faster than FAN_MIN_DWELL_MS.
+#define FAN_BURST_PERIOD_MS		10000
+#define FAN_MIN_DWELL_MS		2000
+#define FAN_MIN_DUTY_PERCENT	20
+
+//Duty ramps linearly between the start and full thresholds, the higher of the two demands wins
+#define FAN_TEMP_START_C		45
+#define FAN_TEMP_FULL_C			60
+#define FAN_POWER_START_MW		1000
+#define FAN_POWER_FULL_MW		5000
+
+//Keep the fan running at FAN_MIN_DUTY_PERCENT this long after the last demand
+#define FAN_SPIN_DOWN_MS		30000
+
+void Fan_Control_Update(void);
+
+uint8_t Get_Fan_Duty(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FAN_H_ */
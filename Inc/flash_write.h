@@ -0,0 +1,25 @@
+/**
+ ******************************************************************************
+ * @file           : flash_write.h
+ * @brief          : Header for flash_write.c file.
+ ******************************************************************************
+ */
+
+#ifndef FLASH_WRITE_H_
+#define FLASH_WRITE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+
+uint8_t Flash_Erase_Page(uint32_t address);
+
+uint8_t Flash_Program(uint32_t address, const void *data, uint16_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLASH_WRITE_H_ */
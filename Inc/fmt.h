@@ -0,0 +1,121 @@
+/**
+ ******************************************************************************
+ * @file           : fmt.h
+ * @brief          : Header for fmt.c file.
+ ******************************************************************************
+ */
+
+#ifndef FMT_H_
+#define FMT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include <stddef.h>
+
+//Builds the fmtbench CLI command and keeps %f in printf so it has something to compare against
+#define FMT_BENCHMARK			0
+#define FMT_BENCHMARK_RUNS		16 // Times the set of values is formatted by each side
+
+#define FMT_MAX_SCALE			9 // Largest power of ten a uint32_t holds
+
+//Writer over a caller's buffer. Output past the end is dropped, length still counts it like snprintf.
+//A stream writer has a flush callback instead, which is handed each full buffer and gives the writer the next
+//one. Its buffer is not null terminated and length only counts the characters in the current buffer.
+struct Fmt {
+	char *buffer;
+	size_t size;
+	size_t length;
+	void (*flush)(struct Fmt *fmt);
+};
+
+//Fixed point value in units of 10^-scale, written with decimals digits after the point
+struct Fmt_Fixed {
+	int32_t value;
+	uint8_t scale;
+	uint8_t decimals;
+};
+
+struct Fmt_Hex {
+	uint32_t value;
+};
+
+struct Fmt_Bin {
+	uint32_t value;
+};
+
+struct Fmt_Benchmark {
+	uint32_t values;
+	uint32_t printf_cycles; // Per value, snprintf with %.3f on a float
+	uint32_t fmt_cycles; // Per value, FMT with FMT_FIXED
+};
+
+#define FMT_FIXED(value, scale, decimals)	((struct Fmt_Fixed){ (int32_t)(value), (scale), (decimals) })
+#define FMT_HEX(value)						((struct Fmt_Hex){ (uint32_t)(value) })
+#define FMT_BIN(value)						((struct Fmt_Bin){ (uint32_t)(value) })
+
+/*
+ * FMT(&fmt, "Cell One Voltage (V) ", FMT_FIXED(microvolts, 6, 3), "\r\n") appends each argument in turn.
+ * The emitter for each argument is picked from its type at compile time, so there is no format string
+ * to parse at run time. Strings are copied, integers are written in decimal and the FMT_ wrappers
+ * select the other emitters. Takes up to 8 arguments after the writer.
+ */
+#define FMT(fmt, ...)	do { \
+		struct Fmt *fmt_writer = (fmt); \
+		FMT_CAT(FMT_EACH_, FMT_COUNT(__VA_ARGS__))(fmt_writer, __VA_ARGS__) \
+	} while (0)
+
+#define FMT_ARG(fmt, arg)	_Generic((arg), \
+		char *: Fmt_String, \
+		const char *: Fmt_String, \
+		signed char: Fmt_Signed, \
+		short: Fmt_Signed, \
+		int: Fmt_Signed, \
+		long: Fmt_Signed, \
+		unsigned char: Fmt_Unsigned, \
+		unsigned short: Fmt_Unsigned, \
+		unsigned int: Fmt_Unsigned, \
+		unsigned long: Fmt_Unsigned, \
+		struct Fmt_Fixed: Fmt_Fixed_Point, \
+		struct Fmt_Hex: Fmt_Hexadecimal, \
+		struct Fmt_Bin: Fmt_Binary)((fmt), (arg))
+
+#define FMT_CAT(a, b)		FMT_CAT_(a, b)
+#define FMT_CAT_(a, b)		a##b
+#define FMT_COUNT(...)		FMT_COUNT_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define FMT_COUNT_(a1, a2, a3, a4, a5, a6, a7, a8, count, ...)	count
+
+#define FMT_EACH_1(fmt, arg)		FMT_ARG(fmt, arg);
+#define FMT_EACH_2(fmt, arg, ...)	FMT_ARG(fmt, arg); FMT_EACH_1(fmt, __VA_ARGS__)
+#define FMT_EACH_3(fmt, arg, ...)	FMT_ARG(fmt, arg); FMT_EACH_2(fmt, __VA_ARGS__)
+#define FMT_EACH_4(fmt, arg, ...)	FMT_ARG(fmt, arg); FMT_EACH_3(fmt, __VA_ARGS__)
+#define FMT_EACH_5(fmt, arg, ...)	FMT_ARG(fmt, arg); FMT_EACH_4(fmt, __VA_ARGS__)
+#define FMT_EACH_6(fmt, arg, ...)	FMT_ARG(fmt, arg); FMT_EACH_5(fmt, __VA_ARGS__)
+#define FMT_EACH_7(fmt, arg, ...)	FMT_ARG(fmt, arg); FMT_EACH_6(fmt, __VA_ARGS__)
+#define FMT_EACH_8(fmt, arg, ...)	FMT_ARG(fmt, arg); FMT_EACH_7(fmt, __VA_ARGS__)
+
+void Fmt_Init(struct Fmt *fmt, char *buffer, size_t size);
+
+void Fmt_String(struct Fmt *fmt, const char *string);
+
+void Fmt_Unsigned(struct Fmt *fmt, uint32_t value);
+
+void Fmt_Signed(struct Fmt *fmt, int32_t value);
+
+void Fmt_Fixed_Point(struct Fmt *fmt, struct Fmt_Fixed fixed);
+
+void Fmt_Hexadecimal(struct Fmt *fmt, struct Fmt_Hex hex);
+
+void Fmt_Binary(struct Fmt *fmt, struct Fmt_Bin bin);
+
+#if FMT_BENCHMARK
+void Fmt_Run_Benchmark(struct Fmt_Benchmark *result);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FMT_H_ */
@@ -0,0 +1,42 @@
+/**
+ ******************************************************************************
+ * @file           : kv_store.h
+ * @brief          : Header for kv_store.c file.
+ ******************************************************************************
+ */
+
+#ifndef KV_STORE_H_
+#define KV_STORE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+
+//Four 2 KB pages below the session log, kept out of the FLASH region in STM32G071CBTx_FLASH.ld.
+//Records are appended to the active page. When it fills, the newest record of every key is copied
+//to the next page, which then becomes active, so erases rotate round the pages.
+#define KV_STORE_START_ADDR		0x0801D000
+#define KV_STORE_PAGES			4
+#define KV_STORE_MAGIC			0x3153564B // "KVS1"
+#define KV_MAX_KEYS				16
+#define KV_MAX_VALUE_SIZE		64 // Bytes
+
+//Keys, never reuse a number for a value with a different layout
+#define KV_KEY_ADC_SCALARS		0x0001 // Superseded by KV_KEY_ADC_CALIBRATION, still read as a fallback
+#define KV_KEY_ADC_CALIBRATION	0x0002
+#define KV_KEY_STACK_WORST		0x0003
+#define KV_KEY_PARAMS			0x0004
+
+void KV_Store_Init(void);
+
+uint8_t KV_Read(uint16_t key, void *value, uint16_t length);
+
+uint8_t KV_Write(uint16_t key, const void *value, uint16_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KV_STORE_H_ */
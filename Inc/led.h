@@ -0,0 +1,51 @@
+/**
+ ******************************************************************************
+ * @file           : led.h
+ * @brief          : Header for led.c file.
+ ******************************************************************************
+ */
+
+#ifndef LED_H_
+#define LED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+
+//Colours are a mix of the three LEDs
+#define LED_OFF					0x00
+#define LED_RED					0x01
+#define LED_GREEN				0x02
+#define LED_BLUE				0x04
+#define LED_WHITE				(LED_RED | LED_GREEN | LED_BLUE)
+#define LED_STATUS				0x08 // The charge status colour worked out by LED_Select
+
+#define LED_MAX_STEPS			3
+#define LED_STARTUP_MS			2000 // All on for this long from LED_Init, the first second is spent on ADC calibration
+
+//Patterns, the one with the highest priority of those selected is played
+#define LED_PATTERN_STATUS		0
+#define LED_PATTERN_ERROR_1		1 // Error codes blink red 1 to 6 times, in the order of the error.h bits
+#define LED_PATTERN_ERROR_2		2
+#define LED_PATTERN_ERROR_3		3
+#define LED_PATTERN_ERROR_4		4
+#define LED_PATTERN_ERROR_5		5
+#define LED_PATTERN_ERROR_6		6
+#define LED_PATTERN_NO_PD		7
+#define LED_PATTERN_PRECHARGE	8
+#define LED_PATTERN_NO_PACK		9
+#define LED_PATTERN_STARTUP		10
+#define LED_PATTERN_COUNT		11
+
+void LED_Init(void);
+
+void LED_Select(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LED_H_ */
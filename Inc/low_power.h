@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ * @file           : low_power.h
+ * @brief          : Header for low_power.c file.
+ ******************************************************************************
+ */
+
+#ifndef LOW_POWER_H_
+#define LOW_POWER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+//LPTIM1 runs from the LSI through sleep and STOP1 and wakes the core at the next FreeRTOS deadline
+#define LOW_POWER_LSI_HZ			32000 // Nominal, the LSI is measured against the core clock while awake
+#define LOW_POWER_LSI_CAL_COUNTS	4096 // Awake LPTIM counts per LSI measurement
+#define LOW_POWER_MAX_IDLE_MS		1000 // Keeps a sleep well inside one 16 bit LPTIM wrap
+
+//STOP1 is only used with no pack attached and no PD contract, when a sleep would otherwise be spent waiting on nothing
+#define LOW_POWER_ENABLE_STOP		1
+#define LOW_POWER_CONSOLE_HOLD_MS	30000 // Console traffic keeps the clocks running this long, its first character wakes from STOP1
+
+//Low_Power_Stats.stop_blocker, what kept the last idle period out of STOP1
+#define LOW_POWER_STOP_ALLOWED		0
+#define LOW_POWER_STOP_DISABLED		1
+#define LOW_POWER_STOP_PACK			2
+#define LOW_POWER_STOP_ADC			3
+#define LOW_POWER_STOP_CONTRACT		4
+#define LOW_POWER_STOP_TELEMETRY	5
+#define LOW_POWER_STOP_CONSOLE		6
+#define LOW_POWER_STOP_DMA			7
+
+struct Low_Power_Stats {
+	uint32_t sleep_ms;
+	uint32_t stop_ms;
+	uint32_t stop_count;
+	uint32_t lsi_hz;
+	uint8_t stop_blocker; // LOW_POWER_STOP_
+};
+
+void Low_Power_Init(void);
+
+void Low_Power_ADC_Sample_Done(void);
+
+void Low_Power_Console_Activity(void);
+
+void Get_Low_Power_Stats(struct Low_Power_Stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOW_POWER_H_ */
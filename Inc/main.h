@@ -140,6 +140,7 @@ void Error_Handler(void);
 #define LIPOW_MAJOR_VERSION	(uint8_t)1
 #define LIPOW_MINOR_VERSION	(uint8_t)3
 
+//Defaults for the runtime parameters in params.c
 #define ENABLE_BALANCING        0
 #define NUM_SERIES              4
 #define FACTORY_LEDS            1
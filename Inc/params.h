@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * @file           : params.h
+ * @brief          : Header for params.c file.
+ ******************************************************************************
+ */
+
+#ifndef PARAMS_H_
+#define PARAMS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+
+//Saved as one record under KV_KEY_PARAMS in the key value store
+#define PARAMS_VERSION				1 // Bump when a parameter is removed or changes meaning, stored values are then ignored
+
+#define PARAM_TYPE_UINT				0
+#define PARAM_TYPE_INT				1
+#define PARAM_TYPE_FLOAT			2
+
+//Param_Definition.flags
+#define PARAM_FLAG_IDLE_ONLY		0x01 // Safety critical, only changed with no pack on the XT60 and the charger off
+
+//Set_Param_Value results
+#define PARAM_SET_REJECTED			0 // Out of range or not a whole number
+#define PARAM_SET_OK				1
+#define PARAM_SET_LOCKED			2 // PARAM_FLAG_IDLE_ONLY while a pack is on the XT60 or charging
+
+//Every parameter is one 32 bit word so the registry can address them by offset.
+//The compile time #defines they replace are kept as the defaults.
+struct Params {
+	uint32_t max_charge_current_ma;
+	uint32_t charge_term_current_ma;
+	uint32_t max_charging_power_mw;
+	float assume_efficiency;
+	int32_t temp_throttle_thresh_c;
+	uint32_t balance_start_mv;
+	uint32_t balance_hysteresis_mv;
+	uint32_t enable_balancing;
+	uint32_t num_series;
+	uint32_t uvp_recovery_current_ma;
+};
+
+struct Param_Definition {
+	const char *name;
+	uint8_t type;
+	uint8_t offset;
+	float min;
+	float max;
+	float default_value;
+	uint8_t flags;
+};
+
+//Loaded once at boot, read directly from the control loops
+extern struct Params params;
+
+void Params_Load(void);
+
+uint8_t Params_Save(void);
+
+uint8_t Get_Param_Count(void);
+
+const struct Param_Definition *Get_Param_Definition(uint8_t index);
+
+const struct Param_Definition *Find_Param(const char *name);
+
+float Get_Param_Value(const struct Param_Definition *definition);
+
+uint8_t Set_Param_Value(const struct Param_Definition *definition, float value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PARAMS_H_ */
@@ -0,0 +1,18 @@
+/**
+ ******************************************************************************
+ * @file           : printf_config.h
+ * @brief          : Options for printf.c, included through PRINTF_INCLUDE_CONFIG_H
+ ******************************************************************************
+ */
+
+#ifndef PRINTF_CONFIG_H_
+#define PRINTF_CONFIG_H_
+
+#include "fmt.h"
+
+//Fixed point values are written with FMT, dropping %f leaves out _ftoa and the double soft float routines
+#if !FMT_BENCHMARK
+#define PRINTF_DISABLE_SUPPORT_FLOAT
+#endif
+
+#endif /* PRINTF_CONFIG_H_ */
@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * @file           : profile.h
+ * @brief          : Header for profile.c file.
+ ******************************************************************************
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+//TIM7 free runs at the core clock and its update interrupt extends it to 48 bits
+#define PROFILE_TIMER				TIM7
+#define PROFILE_CYCLES_PER_US		64 // Core clock in MHz
+#define PROFILE_RUN_TIME_SHIFT		12 // 64MHz >> 12 gives the 15.625kHz FreeRTOS run time counter, wraps after 76 hours
+#define PROFILE_MAX_TASKS			12
+
+//Interrupts with entry/exit accounting. Times are inclusive of any interrupt that nests inside.
+#define PROFILE_ISR_ADC_DMA			0
+#define PROFILE_ISR_I2C				1
+#define PROFILE_ISR_I2C_DMA			2
+#define PROFILE_ISR_UCPD			3
+#define PROFILE_ISR_USART			4
+#define PROFILE_ISR_USART_DMA		5
+#define PROFILE_ISR_COUNT			6
+
+//Place at the very start and end of an IRQ handler
+#define PROFILE_ISR_ENTER()			uint32_t profile_isr_start = Profile_ISR_Enter()
+#define PROFILE_ISR_EXIT(isr)		Profile_ISR_Exit((isr), profile_isr_start)
+
+struct Profile_Entry {
+	const char *name;
+	uint32_t count; // Task slices or interrupts
+	uint32_t max_cycles;
+	uint32_t cpu_permille;
+};
+
+uint32_t Profile_Get_Cycles(void);
+
+uint32_t Profile_ISR_Enter(void);
+
+void Profile_ISR_Exit(uint8_t isr, uint32_t start_cycles);
+
+void Profile_Timer_Overflow(void);
+
+void Profile_Suspend(void);
+
+void Profile_Resume(uint64_t skipped_cycles);
+
+void Profile_Task_Switched_In(void);
+
+void Profile_Task_Switched_Out(void);
+
+void Profile_Reset(void);
+
+uint8_t Get_Profile_Entry(uint8_t index, struct Profile_Entry *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILE_H_ */
@@ -0,0 +1,46 @@
+/**
+ ******************************************************************************
+ * @file           : rtos_static.h
+ * @brief          : Statically allocated FreeRTOS task and queue memory
+ ******************************************************************************
+ */
+
+#ifndef RTOS_STATIC_H_
+#define RTOS_STATIC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cmsis_os.h"
+
+//Stacks, TCBs and queue storage are linked into the NOLOAD .rtos section, one input section per object so
+//Tools/ram_report.py can list them by name from the map file. The kernel initialises all of it on create.
+#define RTOS_SECTION(kind, name)	__attribute__((section(".rtos." #kind "." #name)))
+
+//Use in place of osThreadDef, stacksz is in words
+#define osThreadStaticMemDef(name, thread, priority, stacksz) \
+	static uint32_t rtos_stack_##name[(stacksz)] RTOS_SECTION(stack, name); \
+	static osStaticThreadDef_t rtos_tcb_##name RTOS_SECTION(tcb, name); \
+	osThreadStaticDef(name, (thread), (priority), 0, (stacksz), rtos_stack_##name, &rtos_tcb_##name)
+
+//Use in place of osMessageQDef
+#define osMessageQStaticMemDef(name, queue_sz, type) \
+	static uint8_t rtos_queue_##name[(queue_sz) * sizeof(type)] RTOS_SECTION(queue, name); \
+	static osStaticMessageQDef_t rtos_qcb_##name RTOS_SECTION(qcb, name); \
+	osMessageQStaticDef(name, (queue_sz), type, rtos_queue_##name, &rtos_qcb_##name)
+
+//Use in place of osTimerDef
+#define osTimerStaticMemDef(name, function) \
+	static osStaticTimerDef_t rtos_tmr_##name RTOS_SECTION(tmr, name); \
+	osTimerStaticDef(name, (function), &rtos_tmr_##name)
+
+//Control block for xSemaphoreCreateMutexStatic and xSemaphoreCreateBinaryStatic
+#define RTOS_SEMAPHORE_MEM(name) \
+	static StaticSemaphore_t rtos_scb_##name RTOS_SECTION(scb, name)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTOS_STATIC_H_ */
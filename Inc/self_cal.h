@@ -0,0 +1,51 @@
+/**
+ ******************************************************************************
+ * @file           : self_cal.h
+ * @brief          : Header for self_cal.c file.
+ ******************************************************************************
+ */
+
+#ifndef SELF_CAL_H_
+#define SELF_CAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+
+#define SELF_CAL_REST_MS			900000 // Charger and balancing off this long before the pack counts as relaxed
+#define SELF_CAL_MIN_SAMPLES		240 // Regulator loops, 240 * 250ms = 1 minute
+#define SELF_CAL_MAX_BOUND_PPM		15000 // Estimates less certain than this are not offered
+//The regulator VBAT ADC is the reference, its own error is part of every bound and does not average away
+#define SELF_CAL_VBAT_LSB_UV		64000 // Regulator VBAT ADC step, taken as its absolute accuracy of +/- 1 LSB
+#define SELF_CAL_VBAT_GAIN_ERROR_PPM	5000 // Regulator VBAT ADC gain error
+
+struct Self_Cal_Channel {
+	uint8_t channel; // Adc_Calibration index
+	int32_t drift_ppm; // Regulator VBAT relative to this channel
+	uint32_t bound_ppm; // 95% confidence of the average plus the regulator VBAT ADC accuracy
+	int32_t proposed_gain; // Adc_Calibration gain that removes the drift at the rest voltage, the offset is kept
+};
+
+struct Self_Cal_Estimate {
+	uint32_t samples;
+	uint8_t resting;
+	uint8_t ready;
+	struct Self_Cal_Channel battery;
+	struct Self_Cal_Channel stack;
+	int32_t stack_vs_battery_ppm; // Top cell tap relative to the battery channel, both measure the pack
+};
+
+void Self_Cal_Update(void);
+
+void Get_Self_Cal_Estimate(struct Self_Cal_Estimate *estimate);
+
+uint8_t Self_Cal_Apply(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SELF_CAL_H_ */
@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * @file           : session_log.h
+ * @brief          : Header for session_log.c file.
+ ******************************************************************************
+ */
+
+#ifndef SESSION_LOG_H_
+#define SESSION_LOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+
+//Last two 2 KB pages of main flash, kept out of the FLASH region in STM32G071CBTx_FLASH.ld
+#define SESSION_LOG_START_ADDR		0x0801F000
+#define SESSION_LOG_PAGES			2
+#define SESSION_RECORD_SIZE			64
+#define SESSION_RECORDS_PER_PAGE	(FLASH_PAGE_SIZE / SESSION_RECORD_SIZE)
+#define SESSION_LOG_SLOTS			(SESSION_RECORDS_PER_PAGE * SESSION_LOG_PAGES)
+#define SESSION_LOG_VERSION			1
+
+#define SESSION_END_DEBOUNCE_MS		5000 // Charging must stay off this long before the session is closed
+#define SESSION_MIN_DURATION_MS		10000 // Shorter sessions are not recorded
+
+//Session_Record.termination_reason
+#define SESSION_END_COMPLETE		1
+#define SESSION_END_XT60_REMOVED	2
+#define SESSION_END_BALANCE_REMOVED	3
+#define SESSION_END_INPUT_LOST		4
+#define SESSION_END_ERROR			5
+#define SESSION_END_OTHER			6
+
+//Timestamps are milliseconds since boot, there is no RTC
+struct Session_Record {
+	uint32_t sequence;
+	uint32_t start_ms;
+	uint32_t end_ms;
+	uint32_t energy_mwh;
+	uint32_t charge_mah;
+	uint32_t throttle_ms;
+	uint16_t start_cell_mv[4];
+	uint16_t end_cell_mv[4];
+	uint16_t contract_mv;
+	uint16_t contract_ma;
+	int8_t peak_temperature_c;
+	uint8_t termination_reason;
+	uint8_t number_of_cells;
+	uint8_t version;
+	uint32_t error_state;
+	uint8_t reserved[10];
+	uint16_t crc;
+};
+
+void Session_Log_Init(void);
+
+void Session_Log_Update(void);
+
+uint16_t Get_Session_Log_Oldest_Slot(void);
+
+uint8_t Session_Log_Read(uint16_t slot, struct Session_Record *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SESSION_LOG_H_ */
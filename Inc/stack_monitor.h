@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * @file           : stack_monitor.h
+ * @brief          : Header for stack_monitor.c file.
+ ******************************************************************************
+ */
+
+#ifndef STACK_MONITOR_H_
+#define STACK_MONITOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+//Every task is found through the traceTASK_CREATE hook, including the USBPD tasks and the idle task
+#define STACK_MONITOR_MAX_TASKS			14 // Also sets the size of the stored record, which must fit KV_MAX_VALUE_SIZE
+#define STACK_MONITOR_PERIOD_MS			1000 // Software timer period
+#define STACK_MONITOR_SAVE_MS			60000 // A new worst case is written to flash at most this often
+
+//Recommended size is the worst case used plus the larger of the two margins, rounded up to 8 words
+#define STACK_MONITOR_MARGIN_PERCENT	25
+#define STACK_MONITOR_MARGIN_WORDS		16 // Covers the 8 word exception frame pushed onto the task stack
+
+struct Stack_Monitor_Entry {
+	const char *name;
+	uint16_t stack_words;
+	uint16_t used_words; // Since boot
+	uint16_t worst_words; // Since the record was last cleared, across boots
+	uint16_t recommended_words;
+};
+
+void Stack_Monitor_Init(void);
+
+void Stack_Monitor_Update(void);
+
+void Stack_Monitor_Task_Created(void *task, uint32_t stack_words);
+
+void Stack_Monitor_Task_Deleted(void *task);
+
+uint8_t Stack_Monitor_Clear(void);
+
+uint8_t Get_Stack_Monitor_Entry(uint8_t index, struct Stack_Monitor_Entry *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STACK_MONITOR_H_ */
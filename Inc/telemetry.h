@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * @file           : telemetry.h
+ * @brief          : Header for telemetry.c file.
+ ******************************************************************************
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+#include "cmsis_os.h"
+
+//Bump when the frame layout changes. Tools/telemetry_decode.py must match.
+#define TELEMETRY_VERSION			2
+#define TELEMETRY_MAX_RATE_HZ		100
+
+//Bits in Telemetry_Frame.state
+#define TELEMETRY_STATE_XT60			0x01
+#define TELEMETRY_STATE_BALANCE			0x02
+#define TELEMETRY_STATE_REGULATOR		0x04
+#define TELEMETRY_STATE_CHARGING		0x08
+#define TELEMETRY_STATE_REQUIRES_CHARGE	0x10
+#define TELEMETRY_STATE_PRECHARGE		0x20
+#define TELEMETRY_STATE_INPUT_READY		0x40
+
+//Little endian, packed. The CRC is CRC-16/CCITT-FALSE over every byte before it.
+//On the wire each frame is COBS encoded and terminated by a 0x00 byte.
+struct __attribute__((packed)) Telemetry_Frame {
+	uint8_t version;
+	uint8_t sequence;
+	uint32_t timestamp_ms;
+	uint16_t cell_mv[4];
+	uint16_t vbus_mv;
+	uint16_t vbat_mv;
+	uint16_t input_current_ma;
+	uint16_t charge_current_ma;
+	uint16_t max_charge_current_ma;
+	int8_t mcu_temperature_c;
+	uint8_t number_of_cells;
+	uint8_t state;
+	uint8_t balancing;
+	uint32_t error_state;
+	uint16_t error_event_sequence; // The oldest queued error event, one per frame
+	uint8_t error_event_type; // ERROR_EVENT_NONE when the queue is empty
+	uint8_t error_event;
+	uint32_t error_event_ms;
+	uint16_t crc;
+};
+
+void Set_Telemetry_Rate(uint8_t rate_hz);
+
+uint8_t Get_Telemetry_Rate(void);
+
+void vTelemetry(void const *pvParameters);
+
+osThreadId telemetryTaskHandle;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_H_ */
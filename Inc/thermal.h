@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ * @file           : thermal.h
+ * @brief          : Header for thermal.c file.
+ ******************************************************************************
+ */
+
+#ifndef THERMAL_H_
+#define THERMAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g0xx_hal.h"
+#include "FreeRTOS.h"
+#include "battery.h"
+
+//Off until R and tau below have been fitted for the board, the fixed temperature throttle is used instead
+#define THERMAL_MODEL_THROTTLING	0
+
+//First order RC model of the board, MCU junction temperature against dissipated power (input power - output power).
+//R is the steady state temperature rise over dissipated power, tau is the time the rise takes to reach 63% of that
+//after a power step. These are starting guesses, not fitted values. Fit them with Tools/thermal_fit.py from a
+//charge session logged with Tools/telemetry_decode.py before setting THERMAL_MODEL_THROTTLING to 1.
+#define THERMAL_R_C_PER_W			7.0f
+#define THERMAL_TAU_S				150.0f
+
+//Steady state temperature the power limit aims for
+#define THERMAL_TARGET_MARGIN_C		5
+#define THERMAL_TARGET_C			(MAX_MCU_TEMP_C_FOR_OPERATION - THERMAL_TARGET_MARGIN_C)
+
+//Loss ratio (dissipated / output power) is only learned above this output power
+#define THERMAL_MIN_LEARN_POWER_MW	2000
+#define THERMAL_LOSS_FILTER			0.05f
+
+void Thermal_Model_Update(uint32_t input_power_mw, uint32_t output_power_mw);
+
+uint32_t Get_Thermal_Power_Limit(void);
+
+uint32_t Get_Dissipated_Power(void);
+
+int32_t Get_Predicted_Temperature(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THERMAL_H_ */
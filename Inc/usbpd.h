@@ -35,6 +35,7 @@
 /* USER CODE BEGIN 0 */
 #define VOLTAGE_CHOICE_ARRAY_SIZE 5
 #define INPUT_VOLTAGE_VALID_THRESH_MV 1000
+#define USBPD_USER_IDLE_HOLD_STEPS 2 // Steps skipped after the pack is removed
 
 #define NO_USB_PD_SUPPLY 2
 #define READY 1
@@ -55,7 +56,8 @@ uint32_t Get_Max_Input_Current(void);
 uint32_t Get_Input_Voltage(void);
 
 /* USER CODE BEGIN 2 */
-
+void USBPD_User_Init(void);
+void USBPD_User_Update(void);
 /* USER CODE END 2 */
 
 #ifdef __cplusplus
@@ -41,6 +41,9 @@
 
 /* Exported typedef ----------------------------------------------------------*/
 /* Exported define -----------------------------------------------------------*/
+/* Period of the source current safety check, only run while a source contract is in place */
+#define USBPD_PWR_IF_SAFETY_PERIOD_MS   1U
+
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
 /** @defgroup USBPD_USER_PWR_IF_Exported_Macros USBPD PWR IF Exported Macros
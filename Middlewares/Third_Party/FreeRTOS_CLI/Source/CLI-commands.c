@@ -39,6 +39,17 @@
 #include "battery.h"
 #include "bq25703a_regulator.h"
 #include "error.h"
+#include "thermal.h"
+#include "fan.h"
+#include "telemetry.h"
+#include "session_log.h"
+#include "params.h"
+#include "self_cal.h"
+#include "profile.h"
+#include "low_power.h"
+#include "stack_monitor.h"
+#include "control.h"
+#include "fmt.h"
 #include "UARTCommandConsole.h"
 #include "usbpd.h"
 #include <stdlib.h>
@@ -64,6 +75,65 @@ static BaseType_t prvCalibrateCommand( char *pcWriteBuffer, size_t xWriteBufferL
  */
 static BaseType_t prvWriteOTPFlashCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
 
+/*
+ * Implements the save_cal command.
+ */
+static BaseType_t prvSaveCalCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the selfcal command.
+ */
+static BaseType_t prvSelfCalCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the profile command.
+ */
+static BaseType_t prvProfileCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the stacks command.
+ */
+static BaseType_t prvStacksCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the control command.
+ */
+static BaseType_t prvControlCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the errors command.
+ */
+static BaseType_t prvErrorsCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the fmtbench command.
+ */
+#if FMT_BENCHMARK
+	static BaseType_t prvFmtBenchCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+#endif /* FMT_BENCHMARK */
+
+/*
+ * Implements the script command.
+ */
+static BaseType_t prvScriptCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the telemetry command.
+ */
+static BaseType_t prvTelemetryCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the sessions command.
+ */
+static BaseType_t prvSessionsCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+/*
+ * Implements the get, set and save parameter commands.
+ */
+static BaseType_t prvGetParamCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prvSetParamCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prvSaveParamsCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
 /*
  * Implements the run-time-stats command.
  */
@@ -84,7 +154,8 @@ static const CLI_Command_Definition_t xStats =
 static const CLI_Command_Definition_t xCal =
 {
 	"cal", /* The command string to type. */
-	"\r\ncal:\r\n Calibrates the ADC based on a known input voltage. Expects one argument as a float in milivolts. Connect input voltage to cells 1-4 and the XT60 battery output.\r\n",
+	"\r\ncal:\r\n Calibrates the ADC based on a known input voltage. Expects one argument as a float in milivolts. Connect input voltage to cells 1-4 and the XT60 battery output.\r\n"
+	" One point sets the gain. A second point at least 1V away from the first also sets the offset. Repeating the last voltage 10C warmer or colder sets the temperature coefficient.\r\n",
 	prvCalibrateCommand, /* The function to run. */
 	1 /* One parameter are expected. */
 };
@@ -93,11 +164,138 @@ static const CLI_Command_Definition_t xCal =
 static const CLI_Command_Definition_t xOTP =
 {
 	"write_otp", /* The command string to type. */
-	"\r\nwrite_otp:\r\n Writes the calibration scalars to OTP flash. Will fail if scalars not set or out of range. Must run cal first with known accurate voltage. Can run up to ~32 times.\r\n",
+	"\r\nwrite_otp:\r\n Writes the calibration scalars to OTP flash as the factory fallback. Will fail if scalars not set or out of range. Must run cal first with known accurate voltage. Can run up to ~40 times.\r\n",
 	prvWriteOTPFlashCommand, /* The function to run. */
 	0 /* No parameters are expected. */
 };
 
+/* Structure that defines the "save_cal" command line command. */
+static const CLI_Command_Definition_t xSaveCal =
+{
+	"save_cal", /* The command string to type. */
+	"\r\nsave_cal:\r\n Writes the calibration table to flash. Used instead of OTP from the next boot. Will fail if scalars not set or out of range. Must run cal first with known accurate voltage.\r\n",
+	prvSaveCalCommand, /* The function to run. */
+	0 /* No parameters are expected. */
+};
+
+/* Structure that defines the "selfcal" command line command. */
+static const CLI_Command_Definition_t xSelfCal =
+{
+	"selfcal", /* The command string to type. */
+	"\r\nselfcal [apply]:\r\n Shows how far the battery and top cell tap readings have drifted from the regulator VBAT ADC, measured while the pack rests."
+	" The bound covers the averaging and the regulator ADC's own accuracy. apply sets the proposed gains of the channels whose drift exceeds its bound."
+	" The offset is kept. Run save_cal to keep them.\r\n",
+	prvSelfCalCommand, /* The function to run. */
+	-1 /* Zero or one parameter is expected. */
+};
+
+/* Structure that defines the "profile" command line command. */
+static const CLI_Command_Definition_t xProfile =
+{
+	"profile", /* The command string to type. */
+	"\r\nprofile [reset]:\r\n Shows the CPU share and worst case execution time of each task and interrupt since boot or the last reset."
+	" Task times exclude the profiled interrupts that preempt them.\r\n",
+	prvProfileCommand, /* The function to run. */
+	-1 /* Zero or one parameter is expected. */
+};
+
+/* Structure that defines the "stacks" command line command. */
+static const CLI_Command_Definition_t xStacks =
+{
+	"stacks", /* The command string to type. */
+	"\r\nstacks [clear]:\r\n Shows the stack size and the most used of each task in words, since boot and the worst case kept across boots,"
+	" with a recommended size. clear drops the worst case of previous boots.\r\n",
+	prvStacksCommand, /* The function to run. */
+	-1 /* Zero or one parameter is expected. */
+};
+
+/* Structure that defines the "control" command line command. */
+static const CLI_Command_Definition_t xControl =
+{
+	"control", /* The command string to type. */
+	"\r\ncontrol [reset]:\r\n Shows the period, deadline and worst case response time of each stage of the control executive, counted from the frame release,"
+	" with the deadline overruns, late frames and worst sense to actuate latency since boot or the last reset.\r\n",
+	prvControlCommand, /* The function to run. */
+	-1 /* Zero or one parameter is expected. */
+};
+
+/* Structure that defines the "errors" command line command. */
+static const CLI_Command_Definition_t xErrors =
+{
+	"errors", /* The command string to type. */
+	"\r\nerrors [reset]:\r\n Shows the policy and state of each error, how many times it has been set and when it was first and last seen,"
+	" in seconds since boot. reset releases latched errors and starts their retries over, the counts are kept.\r\n",
+	prvErrorsCommand, /* The function to run. */
+	-1 /* Zero or one parameter is expected. */
+};
+
+#if FMT_BENCHMARK
+	/* Structure that defines the "fmtbench" command line command. */
+	static const CLI_Command_Definition_t xFmtBench =
+	{
+		"fmtbench", /* The command string to type. */
+		"\r\nfmtbench:\r\n Times writing voltages to 3 decimals with snprintf %.3f and with the FMT fixed point emitter\r\n",
+		prvFmtBenchCommand, /* The function to run. */
+		0 /* No parameters are expected. */
+	};
+#endif /* FMT_BENCHMARK */
+
+/* Structure that defines the "script" command line command. */
+static const CLI_Command_Definition_t xScript =
+{
+	"script", /* The command string to type. */
+	"\r\nscript <json|csv|off>:\r\n Script mode for a test rack, from the next line. No echo or prompt, a line is \"[<seq>:]<command>[;<command>...]\""
+	" and each command answers with one JSON object or CSV record: seq, index in the line, command, output, status (ok, unknown, params or overflow).\r\n",
+	prvScriptCommand, /* The function to run. */
+	1 /* One parameter is expected. */
+};
+
+/* Structure that defines the "telemetry" command line command. */
+static const CLI_Command_Definition_t xTelemetry =
+{
+	"telemetry", /* The command string to type. */
+	"\r\ntelemetry:\r\n Streams COBS framed binary telemetry at the given rate in Hz, up to 100. 0 stops the stream. Decode with Tools/telemetry_decode.py\r\n",
+	prvTelemetryCommand, /* The function to run. */
+	1 /* One parameter is expected. */
+};
+
+/* Structure that defines the "sessions" command line command. */
+static const CLI_Command_Definition_t xSessions =
+{
+	"sessions", /* The command string to type. */
+	"\r\nsessions:\r\n Dumps the charge session history stored in flash as CSV, oldest first\r\n",
+	prvSessionsCommand, /* The function to run. */
+	0 /* No parameters are expected. */
+};
+
+/* Structure that defines the "get" command line command. */
+static const CLI_Command_Definition_t xGetParam =
+{
+	"get", /* The command string to type. */
+	"\r\nget [name]:\r\n Displays a runtime parameter with its limits, or all of them if no name is given\r\n",
+	prvGetParamCommand, /* The function to run. */
+	-1 /* Zero or one parameter is expected. */
+};
+
+/* Structure that defines the "set" command line command. */
+static const CLI_Command_Definition_t xSetParam =
+{
+	"set", /* The command string to type. */
+	"\r\nset <name> <value>:\r\n Changes a runtime parameter. Takes effect immediately, run save to keep it after a reset."
+	" num_series and enable_balancing can only be changed with no pack on the XT60 and the charger off.\r\n",
+	prvSetParamCommand, /* The function to run. */
+	2 /* Two parameters are expected. */
+};
+
+/* Structure that defines the "save" command line command. */
+static const CLI_Command_Definition_t xSaveParams =
+{
+	"save", /* The command string to type. */
+	"\r\nsave:\r\n Writes the runtime parameters to flash\r\n",
+	prvSaveParamsCommand, /* The function to run. */
+	0 /* No parameters are expected. */
+};
+
 /* Structure that defines the "task-stats" command line command.  This generates
 a table that gives information on each task in the system. */
 static const CLI_Command_Definition_t xTaskStats =
@@ -122,108 +320,109 @@ static const CLI_Command_Definition_t xTaskStats =
 
 /*-----------------------------------------------------------*/
 
-void vRegisterCLICommands(void) {
-	/* Register all the command line commands defined immediately above. */
-	FreeRTOS_CLIRegisterCommand(&xStats);
-
-	FreeRTOS_CLIRegisterCommand(&xCal);
-
-	FreeRTOS_CLIRegisterCommand(&xOTP);
+/* All the command line commands defined immediately above, in the order help lists them. */
+static const CLI_Command_Definition_t * const pxCLICommands[] = {
+	&xStats,
+	&xCal,
+	&xOTP,
+	&xSaveCal,
+	&xSelfCal,
+	&xTaskStats,
+	&xProfile,
+	&xStacks,
+	&xControl,
+	&xErrors,
+#if FMT_BENCHMARK
+	&xFmtBench,
+#endif
+	&xScript,
+	&xTelemetry,
+	&xSessions,
+	&xGetParam,
+	&xSetParam,
+	&xSaveParams,
+#if( configGENERATE_RUN_TIME_STATS == 1 )
+	&xRunTimeStats,
+#endif
+};
 
-	FreeRTOS_CLIRegisterCommand(&xTaskStats);
+/* FreeRTOS_CLIRegisterCommand takes a list item from a fixed array and asserts when it runs out. help is not one of them. */
+_Static_assert((sizeof(pxCLICommands) / sizeof(pxCLICommands[0])) <= configCOMMAND_INT_MAX_COMMANDS, "Raise configCOMMAND_INT_MAX_COMMANDS in FreeRTOSConfig.h");
 
-	#if( configGENERATE_RUN_TIME_STATS == 1 )
-	{
-		FreeRTOS_CLIRegisterCommand( &xRunTimeStats );
+void vRegisterCLICommands(void) {
+	/* Register all the command line commands defined immediately above. */
+	for (uint8_t i = 0; i < (sizeof(pxCLICommands) / sizeof(pxCLICommands[0])); i++) {
+		FreeRTOS_CLIRegisterCommand(pxCLICommands[i]);
 	}
-	#endif
 }
 /*-----------------------------------------------------------*/
 
 static BaseType_t prvStatsCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
 	/* Remove compile time warnings about unused parameters, and check the
-	 write buffer is not NULL.  NOTE - for simplicity, this example assumes the
-	 write buffer length is adequate, so does not check for buffer overflows. */
+	 write buffer is not NULL. */
 	(void) pcCommandString;
 	(void) xWriteBufferLen;
 	configASSERT(pcWriteBuffer);
 
-	float cell_voltage_float[4];
-	for (int i = 0; i < 4; i++) {
-		cell_voltage_float[i] = ((float)Get_Cell_Voltage(i)/BATTERY_ADC_MULTIPLIER);
-	}
-
-	float vdda_float = (float)Get_VDDa()/BATTERY_ADC_MULTIPLIER;
-
-	float battery_voltage = ((float)Get_Battery_Voltage()/BATTERY_ADC_MULTIPLIER);
-	float charge_current = ((float)Get_Charge_Current_ADC_Reading()/REG_ADC_MULTIPLIER);
-	float output_power = battery_voltage * charge_current;
-
-	float regulator_vbat_voltage = ((float)Get_VBAT_ADC_Reading()/REG_ADC_MULTIPLIER);
-	float vbus_voltage = ((float)Get_VBUS_ADC_Reading()/REG_ADC_MULTIPLIER);
-	float input_current = ((float)Get_Input_Current_ADC_Reading()/REG_ADC_MULTIPLIER);
-	float input_power = vbus_voltage * input_current;
-
-	float efficiency = output_power/input_power;
-
-	float max_charge_current = (float)Get_Max_Charge_Current()/1000.0f;
-
-	/* Generate a table of stats. */
-	sprintf(pcWriteBuffer,
-			"Variable                    Value\r\n"
-			"************************************************\r\n"
-			"Battery Voltage MCU(V)       %.3f\r\n"
-			"Battery Voltage Reg (V)      %.3f\r\n"
-			"Charging Current (A)         %.3f\r\n"
-			"Charging Power (W)           %.3f\r\n"
-			"Cell One Voltage (V)         %.3f\r\n"
-			"Cell Two Voltage (V)         %.3f\r\n"
-			"Cell Three Voltage (V)       %.3f\r\n"
-			"Cell Four Voltage (V)        %.3f\r\n"
-			"2 Series Voltage (V)         %.3f\r\n"
-			"3 Series Voltage (V)         %.3f\r\n"
-			"4 Series Voltage (V)         %.3f\r\n"
-			"MCU Temperature (C)          %d\r\n"
-			"VDDa (V)                     %.3f\r\n"
-			"XT60 Connected               %u\r\n"
-			"Balance Connection State     %u\r\n"
-			"Number of Cells              %u\r\n"
-			"Battery Requires Charging    %u\r\n"
-			"Balancing State/Bitmask      %b\r\n"
-			"Regulator Connection State   %d\r\n"
-			"Charging State               %u\r\n"
-			"Max Charge Current           %.3f\r\n"
-			"Vbus Voltage (V)             %.3f\r\n"
-			"Input Current (A)            %.3f\r\n"
-			"Input Power (W)              %.3f\r\n"
-			"Efficiency (OutputW/InputW)  %.3f\r\n"
-			"Battery Error State          %u\r\n",
-			battery_voltage,
-			regulator_vbat_voltage,
-			charge_current,
-			output_power,
-			cell_voltage_float[0],
-			cell_voltage_float[1],
-			cell_voltage_float[2],
-			cell_voltage_float[3],
-			(float)Get_Two_S_Voltage()/BATTERY_ADC_MULTIPLIER,
-			(float)Get_Three_S_Voltage()/BATTERY_ADC_MULTIPLIER,
-			(float)Get_Four_S_Voltage()/BATTERY_ADC_MULTIPLIER,
-			Get_MCU_Temperature(),
-			vdda_float,
-			Get_XT60_Connection_State(),
-			Get_Balance_Connection_State(),
-			Get_Number_Of_Cells(),
-			Get_Requires_Charging_State(),
-			Get_Balancing_State(),
-			Get_Regulator_Connection_State(),
-			Get_Regulator_Charging_State(),
-			max_charge_current,
-			vbus_voltage,
-			input_current,
-			input_power,
-			efficiency,
-			Get_Error_State());
+	struct Fmt xFmt;
+
+	/* Pack voltages are in microvolts, charger readings in units of REG_ADC_MULTIPLIER and limits in
+	 milliamps or milliwatts, so each is written as fixed point without converting to float. */
+	uint32_t output_power_uw = (Get_Battery_Voltage() / 1000) * (Get_Charge_Current_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000));
+	uint32_t input_power_uw = (Get_VBUS_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000)) * (Get_Input_Current_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000));
+	uint32_t efficiency_permille = (input_power_uw >= 1000) ? (output_power_uw / (input_power_uw / 1000)) : 0;
+
+	static const char * const pcStopBlockers[] = { "none", "disabled", "pack", "adc", "contract", "telemetry", "console", "dma" };
+	struct Low_Power_Stats low_power_stats;
+	Get_Low_Power_Stats(&low_power_stats);
+
+	/* Generate a table of stats.  It is longer than the output buffer, so it is
+	 streamed to the UART as it is written. */
+	UART_Stream_Begin(&xFmt);
+	FMT(&xFmt, "Variable                    Value\r\n",
+			"************************************************\r\n");
+	FMT(&xFmt, "Battery Voltage MCU(V)       ", FMT_FIXED(Get_Battery_Voltage(), 6, 3), "\r\n");
+	FMT(&xFmt, "Battery Voltage Reg (V)      ", FMT_FIXED(Get_VBAT_ADC_Reading(), 5, 3), "\r\n");
+	FMT(&xFmt, "Charging Current (A)         ", FMT_FIXED(Get_Charge_Current_ADC_Reading(), 5, 3), "\r\n");
+	FMT(&xFmt, "Charging Power (W)           ", FMT_FIXED(output_power_uw, 6, 3), "\r\n");
+	FMT(&xFmt, "Cell One Voltage (V)         ", FMT_FIXED(Get_Cell_Voltage(0), 6, 3), "\r\n");
+	FMT(&xFmt, "Cell Two Voltage (V)         ", FMT_FIXED(Get_Cell_Voltage(1), 6, 3), "\r\n");
+	FMT(&xFmt, "Cell Three Voltage (V)       ", FMT_FIXED(Get_Cell_Voltage(2), 6, 3), "\r\n");
+	FMT(&xFmt, "Cell Four Voltage (V)        ", FMT_FIXED(Get_Cell_Voltage(3), 6, 3), "\r\n");
+	FMT(&xFmt, "2 Series Voltage (V)         ", FMT_FIXED(Get_Two_S_Voltage(), 6, 3), "\r\n");
+	FMT(&xFmt, "3 Series Voltage (V)         ", FMT_FIXED(Get_Three_S_Voltage(), 6, 3), "\r\n");
+	FMT(&xFmt, "4 Series Voltage (V)         ", FMT_FIXED(Get_Four_S_Voltage(), 6, 3), "\r\n");
+	FMT(&xFmt, "MCU Temperature (C)          ", Get_MCU_Temperature(), "\r\n");
+	FMT(&xFmt, "Predicted Temperature (C)    ", Get_Predicted_Temperature(), "\r\n");
+	FMT(&xFmt, "Thermal Power Limit (W)      ", FMT_FIXED(Get_Thermal_Power_Limit(), 3, 3), "\r\n");
+	FMT(&xFmt, "Fan Duty (%)                 ", Get_Fan_Duty(), "\r\n");
+	FMT(&xFmt, "VDDa (V)                     ", FMT_FIXED(Get_VDDa(), 6, 3), "\r\n");
+	FMT(&xFmt, "XT60 Connected               ", Get_XT60_Connection_State(), "\r\n");
+	FMT(&xFmt, "Balance Connection State     ", Get_Balance_Connection_State(), "\r\n");
+	FMT(&xFmt, "Number of Cells              ", Get_Number_Of_Cells(), "\r\n");
+	FMT(&xFmt, "Battery Requires Charging    ", Get_Requires_Charging_State(), "\r\n");
+	FMT(&xFmt, "Balancing State/Bitmask      ", FMT_BIN(Get_Balancing_State()), "\r\n");
+	FMT(&xFmt, "Regulator Connection State   ", Get_Regulator_Connection_State(), "\r\n");
+	FMT(&xFmt, "Charging State               ", Get_Regulator_Charging_State(), "\r\n");
+	FMT(&xFmt, "Charger Status               0x", FMT_HEX(Get_Charger_Status()), "\r\n");
+	FMT(&xFmt, "Prochot Status               0x", FMT_HEX(Get_Prochot_Status()), "\r\n");
+	FMT(&xFmt, "Charger Fault Events         ", Get_Charger_Fault_Events(), "\r\n");
+	FMT(&xFmt, "Max Charge Current           ", FMT_FIXED(Get_Max_Charge_Current(), 3, 3), "\r\n");
+	FMT(&xFmt, "Source Current Limit (A)     ", FMT_FIXED(Get_Source_Current_Limit(), 3, 3), "\r\n");
+	FMT(&xFmt, "Vbus Voltage (V)             ", FMT_FIXED(Get_VBUS_ADC_Reading(), 5, 3), "\r\n");
+	FMT(&xFmt, "Input Current (A)            ", FMT_FIXED(Get_Input_Current_ADC_Reading(), 5, 3), "\r\n");
+	FMT(&xFmt, "Input Current Limit (A)      ", FMT_FIXED(Get_Input_Current_Limit(), 3, 3), "\r\n");
+	FMT(&xFmt, "Input Power (W)              ", FMT_FIXED(input_power_uw, 6, 3), "\r\n");
+	FMT(&xFmt, "Efficiency (OutputW/InputW)  ", FMT_FIXED(efficiency_permille, 3, 3), "\r\n");
+	FMT(&xFmt, "Battery Error State          ", Get_Error_State(), "\r\n");
+	FMT(&xFmt, "Idle Sleep Time (s)          ", low_power_stats.sleep_ms / 1000, "\r\n");
+	FMT(&xFmt, "Idle Stop Time (s)           ", low_power_stats.stop_ms / 1000, "\r\n");
+	FMT(&xFmt, "Idle Stop Count              ", low_power_stats.stop_count, "\r\n");
+	FMT(&xFmt, "Idle Stop Blocker            ", pcStopBlockers[low_power_stats.stop_blocker], "\r\n");
+	FMT(&xFmt, "LSI Frequency (Hz)           ", low_power_stats.lsi_hz, "\r\n");
+	UART_Stream_End(&xFmt);
+
+	pcWriteBuffer[0] = '\0';
 
 	/* There is no more data to return after this single string, so return
 	 pdFALSE. */
@@ -264,6 +463,233 @@ static BaseType_t prvCalibrateCommand(char *pcWriteBuffer, size_t xWriteBufferLe
 }
 /*-----------------------------------------------------------*/
 
+static BaseType_t prvScriptCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	configASSERT(pcWriteBuffer);
+
+	const char *pcParameter1;
+	BaseType_t xParameter1StringLength;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+
+	if (strncmp(pcParameter1, "json", xParameter1StringLength) == 0) {
+		UART_Set_Script_Format(CLI_SCRIPT_JSON);
+	}
+	else if (strncmp(pcParameter1, "csv", xParameter1StringLength) == 0) {
+		UART_Set_Script_Format(CLI_SCRIPT_CSV);
+	}
+	else if (strncmp(pcParameter1, "off", xParameter1StringLength) == 0) {
+		UART_Set_Script_Format(CLI_SCRIPT_OFF);
+	}
+	else {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Unknown script format, use json, csv or off\r\n");
+		return pdFALSE;
+	}
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "Script mode: %.*s\r\n", (int)xParameter1StringLength, pcParameter1);
+
+	/* There is no more data to return after this single string, so return
+	 pdFALSE. */
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvTelemetryCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void) xWriteBufferLen;
+	configASSERT(pcWriteBuffer);
+
+	const char *pcParameter1;
+	BaseType_t xParameter1StringLength;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+
+	long rate_hz = strtol(pcParameter1, NULL, 10);
+
+	if (rate_hz < 0) {
+		rate_hz = 0;
+	}
+	else if (rate_hz > TELEMETRY_MAX_RATE_HZ) {
+		rate_hz = TELEMETRY_MAX_RATE_HZ;
+	}
+
+	Set_Telemetry_Rate((uint8_t)rate_hz);
+
+	sprintf(pcWriteBuffer, "Telemetry Rate (Hz): %u\r\n", Get_Telemetry_Rate());
+
+	/* There is no more data to return after this single string, so return
+	 pdFALSE. */
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSessionsCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void) pcCommandString;
+	configASSERT(pcWriteBuffer);
+
+	static uint16_t usSlotsRead = 0;
+	struct Session_Record record;
+
+	/* Called once per line, the header first. */
+	if (usSlotsRead == 0) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "sequence,start_ms,end_ms,cells,start_cell1_mv,start_cell2_mv,start_cell3_mv,start_cell4_mv,"
+				"end_cell1_mv,end_cell2_mv,end_cell3_mv,end_cell4_mv,energy_mwh,charge_mah,contract_mv,contract_ma,"
+				"peak_temperature_c,throttle_ms,termination_reason,error_state\r\n");
+	}
+	else {
+		pcWriteBuffer[0] = '\0';
+	}
+
+	/* Skip blank slots so each call after the header prints one record. */
+	while (usSlotsRead < SESSION_LOG_SLOTS) {
+		uint16_t slot = (Get_Session_Log_Oldest_Slot() + usSlotsRead) % SESSION_LOG_SLOTS;
+		usSlotsRead++;
+
+		if (Session_Log_Read(slot, &record) == 1) {
+			size_t xLength = strlen(pcWriteBuffer);
+			snprintf(pcWriteBuffer + xLength, xWriteBufferLen - xLength, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%u,%u,%u\r\n",
+					record.sequence, record.start_ms, record.end_ms, record.number_of_cells,
+					record.start_cell_mv[0], record.start_cell_mv[1], record.start_cell_mv[2], record.start_cell_mv[3],
+					record.end_cell_mv[0], record.end_cell_mv[1], record.end_cell_mv[2], record.end_cell_mv[3],
+					record.energy_mwh, record.charge_mah, record.contract_mv, record.contract_ma,
+					record.peak_temperature_c, record.throttle_ms, record.termination_reason, record.error_state);
+			return pdTRUE;
+		}
+	}
+
+	usSlotsRead = 0;
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Float parameters are written to 3 decimals as fixed point thousandths, printf has no %f.
+ */
+static struct Fmt_Fixed prvParamFixed(float value) {
+	return FMT_FIXED((value < 0.0f) ? (value * 1000.0f - 0.5f) : (value * 1000.0f + 0.5f), 3, 3);
+}
+
+/*
+ * Writes one "name = value (min to max)" line, integers without decimals.
+ */
+static void prvFormatParam(char *pcWriteBuffer, size_t xWriteBufferLen, const struct Param_Definition *pxParam) {
+	float value = Get_Param_Value(pxParam);
+	struct Fmt xFmt;
+
+	Fmt_Init(&xFmt, pcWriteBuffer, xWriteBufferLen);
+
+	if (pxParam->type == PARAM_TYPE_FLOAT) {
+		FMT(&xFmt, pxParam->name, " = ", prvParamFixed(value), " (", prvParamFixed(pxParam->min), " to ", prvParamFixed(pxParam->max), ")\r\n");
+	}
+	else {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "%s = %d (%d to %d)\r\n", pxParam->name, (int32_t)value, (int32_t)pxParam->min, (int32_t)pxParam->max);
+	}
+}
+
+/*
+ * Copies a parameter name out of the command string so it is null terminated.
+ */
+static void prvCopyParamName(char *pcName, size_t xNameLen, const char *pcParameter, BaseType_t xParameterStringLength) {
+	if ((size_t)xParameterStringLength >= xNameLen) {
+		xParameterStringLength = xNameLen - 1;
+	}
+	memcpy(pcName, pcParameter, xParameterStringLength);
+	pcName[xParameterStringLength] = '\0';
+}
+
+static BaseType_t prvGetParamCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	configASSERT(pcWriteBuffer);
+
+	static uint8_t ucParamIndex = 0;
+	const char *pcParameter1;
+	BaseType_t xParameter1StringLength;
+	char cName[32];
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+
+	if (pcParameter1 != NULL) {
+		prvCopyParamName(cName, sizeof(cName), pcParameter1, xParameter1StringLength);
+
+		const struct Param_Definition *pxParam = Find_Param(cName);
+
+		if (pxParam == NULL) {
+			snprintf(pcWriteBuffer, xWriteBufferLen, "Unknown parameter: %s\r\n", cName);
+		}
+		else {
+			prvFormatParam(pcWriteBuffer, xWriteBufferLen, pxParam);
+		}
+		return pdFALSE;
+	}
+
+	/* No name given, list every parameter one line per call. */
+	prvFormatParam(pcWriteBuffer, xWriteBufferLen, Get_Param_Definition(ucParamIndex));
+	ucParamIndex++;
+
+	if (ucParamIndex < Get_Param_Count()) {
+		return pdTRUE;
+	}
+
+	ucParamIndex = 0;
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSetParamCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	configASSERT(pcWriteBuffer);
+
+	const char *pcParameter1, *pcParameter2;
+	BaseType_t xParameter1StringLength, xParameter2StringLength;
+	char cName[32];
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+	pcParameter2 = FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameter2StringLength);
+
+	prvCopyParamName(cName, sizeof(cName), pcParameter1, xParameter1StringLength);
+
+	const struct Param_Definition *pxParam = Find_Param(cName);
+
+	if (pxParam == NULL) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Unknown parameter: %s\r\n", cName);
+		return pdFALSE;
+	}
+
+	char *pcEnd;
+	float value = strtof(pcParameter2, &pcEnd);
+	uint8_t ucResult = (pcEnd == pcParameter2) ? PARAM_SET_REJECTED : Set_Param_Value(pxParam, value);
+
+	if (ucResult == PARAM_SET_LOCKED) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Rejected, %s can only be changed with no pack on the XT60 and the charger off\r\n", pxParam->name);
+		return pdFALSE;
+	}
+
+	if (ucResult != PARAM_SET_OK) {
+		struct Fmt xFmt;
+
+		Fmt_Init(&xFmt, pcWriteBuffer, xWriteBufferLen);
+		FMT(&xFmt, "Rejected, ", pxParam->name, " must be between ", prvParamFixed(pxParam->min), " and ", prvParamFixed(pxParam->max), "\r\n");
+		return pdFALSE;
+	}
+
+	prvFormatParam(pcWriteBuffer, xWriteBufferLen, pxParam);
+
+	/* There is no more data to return after this single string, so return
+	 pdFALSE. */
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSaveParamsCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void) pcCommandString;
+	configASSERT(pcWriteBuffer);
+
+	uint8_t result = Params_Save();
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "Params Save Result: %u\r\n", result);
+
+	/* There is no more data to return after this single string, so return
+	 pdFALSE. */
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
 static BaseType_t prvWriteOTPFlashCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
 	/* Remove compile time warnings about unused parameters, and check the
 	 write buffer is not NULL.  NOTE - for simplicity, this example assumes the
@@ -282,6 +708,247 @@ static BaseType_t prvWriteOTPFlashCommand(char *pcWriteBuffer, size_t xWriteBuff
 }
 /*-----------------------------------------------------------*/
 
+static BaseType_t prvSaveCalCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void) pcCommandString;
+	configASSERT(pcWriteBuffer);
+
+	uint8_t result = Save_Cal_To_Flash();
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "Calibration Save Result: %u\r\n", result);
+
+	/* There is no more data to return after this single string, so return
+	 pdFALSE. */
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSelfCalCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	configASSERT(pcWriteBuffer);
+
+	const char *pcParameter1;
+	BaseType_t xParameter1StringLength;
+	struct Self_Cal_Estimate estimate;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+
+	if ((pcParameter1 != NULL) && (strncmp(pcParameter1, "apply", xParameter1StringLength) == 0)) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Self Cal Apply Result: %u\r\n", Self_Cal_Apply());
+		return pdFALSE;
+	}
+
+	Get_Self_Cal_Estimate(&estimate);
+
+	if (estimate.ready == 0) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "No estimate yet. Resting: %u Samples: %u\r\n", estimate.resting, estimate.samples);
+		return pdFALSE;
+	}
+
+	snprintf(pcWriteBuffer, xWriteBufferLen,
+			"Resting: %u Samples: %u\r\n"
+			"Battery ch %u drift (ppm): %d +/- %u proposed gain: %d\r\n"
+			"Stack ch %u drift (ppm): %d +/- %u proposed gain: %d\r\n"
+			"Stack vs Battery (ppm): %d\r\n",
+			estimate.resting, estimate.samples,
+			estimate.battery.channel, estimate.battery.drift_ppm, estimate.battery.bound_ppm, estimate.battery.proposed_gain,
+			estimate.stack.channel, estimate.stack.drift_ppm, estimate.stack.bound_ppm, estimate.stack.proposed_gain,
+			estimate.stack_vs_battery_ppm);
+
+	/* There is no more data to return after this single string, so return
+	 pdFALSE. */
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvProfileCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	configASSERT(pcWriteBuffer);
+
+	static uint8_t ucProfileIndex = 0;
+	const char *pcParameter1;
+	BaseType_t xParameter1StringLength;
+	struct Profile_Entry xEntry;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+
+	if ((pcParameter1 != NULL) && (strncmp(pcParameter1, "reset", xParameter1StringLength) == 0)) {
+		Profile_Reset();
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Profile reset\r\n");
+		return pdFALSE;
+	}
+
+	/* One line per call, the header first. */
+	if (ucProfileIndex == 0) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Name             CPU %%   WCET us  WCET cycles  Count\r\n");
+		ucProfileIndex++;
+		return pdTRUE;
+	}
+
+	if (Get_Profile_Entry(ucProfileIndex - 1, &xEntry) == 0) {
+		pcWriteBuffer[0] = 0x00;
+		ucProfileIndex = 0;
+		return pdFALSE;
+	}
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "%-16s %3u.%u %9u %12u %6u\r\n", xEntry.name, xEntry.cpu_permille / 10, xEntry.cpu_permille % 10,
+			xEntry.max_cycles / PROFILE_CYCLES_PER_US, xEntry.max_cycles, xEntry.count);
+	ucProfileIndex++;
+
+	return pdTRUE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvStacksCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	configASSERT(pcWriteBuffer);
+
+	static uint8_t ucStacksIndex = 0;
+	const char *pcParameter1;
+	BaseType_t xParameter1StringLength;
+	struct Stack_Monitor_Entry xEntry;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+
+	if ((pcParameter1 != NULL) && (strncmp(pcParameter1, "clear", xParameter1StringLength) == 0)) {
+		if (Stack_Monitor_Clear() == 1) {
+			snprintf(pcWriteBuffer, xWriteBufferLen, "Stack worst case cleared\r\n");
+		}
+		else {
+			snprintf(pcWriteBuffer, xWriteBufferLen, "Failed to write flash\r\n");
+		}
+		return pdFALSE;
+	}
+
+	/* One line per call, the header first. */
+	if (ucStacksIndex == 0) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "#  Name              Size  Used  Worst  Recommended\r\n");
+		ucStacksIndex++;
+		return pdTRUE;
+	}
+
+	if (Get_Stack_Monitor_Entry(ucStacksIndex - 1, &xEntry) == 0) {
+		pcWriteBuffer[0] = 0x00;
+		ucStacksIndex = 0;
+		return pdFALSE;
+	}
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "%-2u %-16s %5u %5u %6u %12u\r\n", ucStacksIndex - 1, xEntry.name, xEntry.stack_words,
+			xEntry.used_words, xEntry.worst_words, xEntry.recommended_words);
+	ucStacksIndex++;
+
+	return pdTRUE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvControlCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	configASSERT(pcWriteBuffer);
+
+	static uint8_t ucControlIndex = 0;
+	const char *pcParameter1;
+	BaseType_t xParameter1StringLength;
+	struct Control_Stage_Stats xStage;
+	struct Control_Frame_Stats xFrame;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+
+	if ((pcParameter1 != NULL) && (strncmp(pcParameter1, "reset", xParameter1StringLength) == 0)) {
+		Control_Reset_Stats();
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Control stats reset\r\n");
+		return pdFALSE;
+	}
+
+	/* One line per call, the header first and the frame counts last. */
+	if (ucControlIndex == 0) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Stage             Period ms  Deadline ms  Worst us      Runs  Overruns\r\n");
+		ucControlIndex++;
+		return pdTRUE;
+	}
+
+	if (Get_Control_Stage_Stats(ucControlIndex - 1, &xStage) == 0) {
+		Get_Control_Frame_Stats(&xFrame);
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Frames: %u  Late: %u  Skipped: %u  Event: %u  Worst sense to actuate: %uus  Worst edge to backoff: %uus\r\n",
+				xFrame.frames, xFrame.late_frames, xFrame.skipped_frames, xFrame.event_frames, xFrame.max_latency_us, xFrame.max_event_latency_us);
+		ucControlIndex = 0;
+		return pdFALSE;
+	}
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "%-17s %9u %12u %9u %9u %9u\r\n", xStage.name, xStage.period_ms, xStage.deadline_ms,
+			xStage.max_response_us, xStage.runs, xStage.overruns);
+	ucControlIndex++;
+
+	return pdTRUE;
+}
+/*-----------------------------------------------------------*/
+static BaseType_t prvErrorsCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	configASSERT(pcWriteBuffer);
+
+	static uint8_t ucErrorIndex = 0;
+	static const char * const pcPolicies[] = { "self-clear", "retry", "latch" };
+	const char *pcParameter1;
+	const char *pcState;
+	BaseType_t xParameter1StringLength;
+	struct Error_Stats xError;
+
+	pcParameter1 = FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameter1StringLength);
+
+	if ((pcParameter1 != NULL) && (strncmp(pcParameter1, "reset", xParameter1StringLength) == 0)) {
+		Error_Reset(UINT32_MAX);
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Errors reset, state is now %u\r\n", Get_Error_State());
+		return pdFALSE;
+	}
+
+	/* One line per call, the header first. */
+	if (ucErrorIndex == 0) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Error             Policy      State          Count  Retries    First s     Last s  Backoff ms\r\n");
+		ucErrorIndex++;
+		return pdTRUE;
+	}
+
+	if (Get_Error_Stats(ucErrorIndex - 1, &xError) == 0) {
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Error state: %u\r\n", Get_Error_State());
+		ucErrorIndex = 0;
+		return pdFALSE;
+	}
+
+	if (xError.latched == 1) {
+		pcState = "latched";
+	}
+	else if ((xError.active == 1) && (xError.raised == 0)) {
+		pcState = "backing off";
+	}
+	else if (xError.active == 1) {
+		pcState = "set";
+	}
+	else {
+		pcState = "clear";
+	}
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "%-17s %-11s %-11s %8u %8u %10u %10u %11u\r\n", xError.name, pcPolicies[xError.policy], pcState,
+			xError.count, xError.retries, xError.first_ms / 1000, xError.last_ms / 1000, xError.backoff_ms);
+	ucErrorIndex++;
+
+	return pdTRUE;
+}
+/*-----------------------------------------------------------*/
+
+#if FMT_BENCHMARK
+
+static BaseType_t prvFmtBenchCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+	(void) pcCommandString;
+	configASSERT(pcWriteBuffer);
+
+	struct Fmt_Benchmark xResult;
+
+	Fmt_Run_Benchmark(&xResult);
+
+	snprintf(pcWriteBuffer, xWriteBufferLen, "%u values, snprintf: %u cycles each, FMT: %u cycles each\r\n",
+			xResult.values, xResult.printf_cycles, xResult.fmt_cycles);
+
+	/* There is no more data to return after this single string, so return
+	 pdFALSE. */
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+#endif /* FMT_BENCHMARK */
+
 static BaseType_t prvTaskStatsCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString )
 {
 const char *const pcHeader = "State   Priority  Stack    #\r\n************************************************\r\n";
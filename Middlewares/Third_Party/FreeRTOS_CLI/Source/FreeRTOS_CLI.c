@@ -46,6 +46,11 @@ one of the application files:
 	#define configAPPLICATION_PROVIDES_cOutputBuffer 0
 #endif
 
+/* The most commands that can be registered, not counting help. */
+#ifndef configCOMMAND_INT_MAX_COMMANDS
+	#define configCOMMAND_INT_MAX_COMMANDS 20
+#endif
+
 typedef struct xCOMMAND_INPUT_LIST
 {
 	const CLI_Command_Definition_t *pxCommandLineDefinition;
@@ -81,6 +86,14 @@ static CLI_Definition_List_Item_t xRegisteredCommands =
 	NULL			/* The next pointer is initialised to NULL, as there are no other registered commands yet. */
 };
 
+/* List items for the registered commands. Taken in order as commands are
+registered, there is no heap. */
+static CLI_Definition_List_Item_t xCommandListItems[ configCOMMAND_INT_MAX_COMMANDS ];
+static UBaseType_t uxCommandListItemsUsed = 0;
+
+/* Result of the last call to FreeRTOS_CLIProcessCommand(). */
+static BaseType_t xLastStatus = cliSTATUS_OK;
+
 /* A buffer into which command outputs can be written is declared here, rather
 than in the command console implementation, to allow multiple command consoles
 to share the same buffer.  For example, an application may allow access to the
@@ -111,12 +124,13 @@ BaseType_t xReturn = pdFAIL;
 	/* Check the parameter is not NULL. */
 	configASSERT( pxCommandToRegister );
 
-	/* Create a new list item that will reference the command being registered. */
-	pxNewListItem = ( CLI_Definition_List_Item_t * ) pvPortMalloc( sizeof( CLI_Definition_List_Item_t ) );
-	configASSERT( pxNewListItem );
+	/* Take a list item that will reference the command being registered. */
+	configASSERT( uxCommandListItemsUsed < configCOMMAND_INT_MAX_COMMANDS );
 
-	if( pxNewListItem != NULL )
+	if( uxCommandListItemsUsed < configCOMMAND_INT_MAX_COMMANDS )
 	{
+		pxNewListItem = &xCommandListItems[ uxCommandListItemsUsed++ ];
+
 		taskENTER_CRITICAL();
 		{
 			/* Reference the command being registered from the newly created
@@ -193,9 +207,12 @@ size_t xCommandStringLength;
 		was incorrect. */
 		strncpy( pcWriteBuffer, "Incorrect command parameter(s).  Enter \"help\" to view a list of available commands.\r\n\r\n", xWriteBufferLen );
 		pxCommand = NULL;
+		xLastStatus = cliSTATUS_BAD_PARAMETERS;
 	}
 	else if( pxCommand != NULL )
 	{
+		xLastStatus = cliSTATUS_OK;
+
 		/* Call the callback function that is registered to this command. */
 		xReturn = pxCommand->pxCommandLineDefinition->pxCommandInterpreter( pcWriteBuffer, xWriteBufferLen, pcCommandInput );
 
@@ -212,12 +229,19 @@ size_t xCommandStringLength;
 		/* pxCommand was NULL, the command was not found. */
 		strncpy( pcWriteBuffer, "Command not recognized.  Enter 'help' to view a list of available commands.\r\n\r\n", xWriteBufferLen );
 		xReturn = pdFALSE;
+		xLastStatus = cliSTATUS_UNKNOWN_COMMAND;
 	}
 
 	return xReturn;
 }
 /*-----------------------------------------------------------*/
 
+BaseType_t FreeRTOS_CLIGetStatus( void )
+{
+	return xLastStatus;
+}
+/*-----------------------------------------------------------*/
+
 char *FreeRTOS_CLIGetOutputBuffer( void )
 {
 	return cOutputBuffer;
@@ -28,6 +28,7 @@
 /* Standard includes. */
 #include "string.h"
 #include "stdio.h"
+#include "stdlib.h"
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
@@ -38,9 +39,11 @@
 #include "main.h"
 #include "UARTCommandConsole.h"
 #include "printf.h"
+#include "low_power.h"
 
-/* Dimensions the buffer into which input characters are placed. */
-#define cmdMAX_INPUT_SIZE	50
+/* Dimensions the buffer into which input characters are placed.  Long
+ enough for a script line of several commands. */
+#define cmdMAX_INPUT_SIZE	128
 
 /* DEL acts as a backspace. */
 #define cmdASCII_DEL		( 0x7F )
@@ -49,11 +52,148 @@
  available. */
 #define cmdMAX_MUTEX_WAIT	pdMS_TO_TICKS( 300 )
 
-/* Flag to indicate if DMA transfer has completed */
-static volatile uint8_t sUart_tx_ready = 0;
+/* Size of the transmit ring buffer.  Must be a power of 2. */
+#define cmdTX_BUFFER_SIZE	1024
+#define cmdTX_BUFFER_MASK	( cmdTX_BUFFER_SIZE - 1 )
+
+/* Transmit ring buffer.  The task holding xTxMutex_CLI is the only producer
+ and moves usTxHead, the DMA complete interrupt is the only consumer and moves
+ usTxTail.  usTxDMALength is the length of the transfer in flight, 0 when the
+ DMA is idle. */
+static uint8_t ucTxBuffer[cmdTX_BUFFER_SIZE];
+static volatile uint16_t usTxHead = 0;
+static volatile uint16_t usTxTail = 0;
+static volatile uint16_t usTxDMALength = 0;
+
+/* Set while the producer is blocked on a full buffer. */
+static volatile uint8_t ucTxWaitingForSpace = 0;
+
+/* Most of the ring a stream writer fills before handing it to the DMA.  Small
+ enough that the first bytes of a long command go out while the rest is still
+ being written, and that xTxMutex_CLI, held while a chunk is written, is given
+ back often. */
+#define cmdTX_STREAM_CHUNK	64
+
+/* Set while a stream writer holds xTxMutex_CLI for the chunk it is writing. */
+static uint8_t ucTxStreamOpen = 0;
+
+/* Set while the console task holds xTxMutex_CLI for a script record, a stream
+ writer opened by the command writes into the record without taking it. */
+static uint8_t ucScriptRecordOpen = 0;
+
+/* Script mode output format, CLI_SCRIPT_.  A change asked for by a command is
+ applied once the line it is on has finished. */
+static volatile uint8_t ucScriptFormat = CLI_SCRIPT_OFF;
+static uint8_t ucScriptFormatRequested = CLI_SCRIPT_OFF;
+
+/* Sequence ID of the last script line. */
+static uint32_t ulScriptSeq = 0;
+
+/* One command of a script line, zero filled past its end. */
+static char cScriptCommand[cmdMAX_INPUT_SIZE];
+
+/* In script mode a stream writer fills this, then it is escaped into the
+ ring buffer. */
+static char cScriptStreamChunk[cmdTX_STREAM_CHUNK];
+
+/* Field names of the record status, by cliSTATUS_ value. */
+static const char * const pcScriptStatus[] = { "ok", "unknown", "params" };
+
+/* Size of the circular receive DMA buffer.  Holds about 2.8 ms of input at
+ 921600 baud while a command is being processed. */
+#define cmdRX_BUFFER_SIZE	256
+
+/* The DMA writes ucRxBuffer continuously, usRxReadIndex is the next character
+ the console task has not consumed yet. */
+static uint8_t ucRxBuffer[cmdRX_BUFFER_SIZE];
+static uint16_t usRxReadIndex = 0;
 
 /*-----------------------------------------------------------*/
 
+/*
+ * Starts a DMA transfer of the longest contiguous block waiting in the ring
+ * buffer.  Must be called with interrupts masked or from the DMA complete
+ * interrupt, and only when no transfer is in flight.
+ */
+static void prvUARTStartTransmit(void);
+
+/*
+ * Waits for room in the transmit ring buffer.  Returns the free space that is
+ * contiguous from usTxHead, or 0 if the UART has stalled.  Must be called
+ * holding xTxMutex_CLI.
+ */
+static uint16_t prvTxWaitForSpace(void);
+
+/*
+ * Passes usLength bytes written at usTxHead to the DMA.  Must be called
+ * holding xTxMutex_CLI.
+ */
+static void prvTxCommit(uint16_t usLength);
+
+/*
+ * Copies usSize bytes into the ring buffer and starts the DMA.  Returns the
+ * number copied, fewer if the UART has stalled.  Must be called holding
+ * xTxMutex_CLI.
+ */
+static uint16_t prvTxWrite(const uint8_t *pucData, uint16_t usSize);
+
+/*
+ * Flush callback of a stream writer.  Commits the chunk it has written in
+ * place, gives xTxMutex_CLI back so other output can go between chunks, then
+ * takes it again and points the writer at the next free space in the ring.
+ */
+static void prvUARTStreamFlush(struct Fmt *pxFmt);
+
+/*
+ * Flush callback of a stream writer in script mode.  Escapes the chunk into
+ * the ring buffer.
+ */
+static void prvUARTScriptStreamFlush(struct Fmt *pxFmt);
+
+/*
+ * Runs each command of a script line and writes a record for each.
+ */
+static void prvScriptRunLine(char *pcLine, char *pcOutputString, uint8_t ucOverflow);
+
+/*
+ * Runs one command of a script line, its output goes into the record.
+ */
+static void prvScriptRunCommand(uint8_t ucFormat, uint32_t ulSeq, uint8_t ucIndex, const char *pcCommand, char *pcOutputString);
+
+/*
+ * Writes the start of a record up to the command output, and the end of a
+ * record from the status.  Must be called holding xTxMutex_CLI.
+ */
+static void prvScriptRecordStart(uint8_t ucFormat, uint32_t ulSeq, uint8_t ucIndex, const char *pcCommand);
+static void prvScriptRecordEnd(uint8_t ucFormat, const char *pcStatus);
+
+/*
+ * Writes to the ring buffer, escaped for a string field of the format if
+ * xEscape is pdTRUE.  Must be called holding xTxMutex_CLI.
+ */
+static void prvScriptWrite(uint8_t ucFormat, const char *pcData, size_t xLength, BaseType_t xEscape);
+
+/*
+ * prvScriptWrite() for a whole string.  Must be called holding xTxMutex_CLI.
+ */
+static void prvScriptPut(uint8_t ucFormat, const char *pcData, BaseType_t xEscape);
+
+/*
+ * (Re)starts the circular receive DMA and the idle line interrupt.
+ */
+static void prvUARTStartReceive(void);
+
+/*
+ * Returns the next received character, blocking the console task until one
+ * arrives.
+ */
+static signed char prvUARTGetChar(void);
+
+/*
+ * Wakes the console task from the receive interrupts.
+ */
+static void prvUARTNotifyConsoleFromISR(void);
+
 /*-----------------------------------------------------------*/
 
 /* Const messages output by the command console. */
@@ -71,6 +211,7 @@ extern UART_HandleTypeDef huart1;
 void prvUARTCommandConsoleTask(void const *pvParameters) {
 	signed char cRxedChar = '\0';
 	uint8_t ucInputIndex = 0;
+	uint8_t ucInputOverflow = 0;
 	char *pcOutputString;
 	static char cInputString[cmdMAX_INPUT_SIZE], cLastInputString[cmdMAX_INPUT_SIZE];
 	BaseType_t xReturned;
@@ -87,13 +228,39 @@ void prvUARTCommandConsoleTask(void const *pvParameters) {
 	snprintf(firmware_verion, sizeof(firmware_verion), "%sFirmware Version: %u.%u\r\n\r\n>", pcWelcomeMessage, (uint8_t)LIPOW_MAJOR_VERSION, (uint8_t)LIPOW_MINOR_VERSION);
 	UART_Transfer((uint8_t *) firmware_verion, (unsigned short) strlen(firmware_verion));
 
+	prvUARTStartReceive();
+
 	for (;;) {
-		/* Wait for the next character.  The while loop is used in case
-		 INCLUDE_vTaskSuspend is not set to 1 - in which case portMAX_DELAY will
-		 be a genuine block time rather than an infinite block time. */
-		//while( xSerialGetChar( xPort, &cRxedChar, portMAX_DELAY ) != pdPASS );
-		while (HAL_UART_Receive_DMA(&huart1, (uint8_t *) &cRxedChar, 1) != HAL_OK)
-			;
+		/* Wait for the next character. */
+		cRxedChar = prvUARTGetChar();
+
+		/* Keep the clocks running while someone is typing. */
+		Low_Power_Console_Activity();
+
+		if (ucScriptFormat != CLI_SCRIPT_OFF) {
+			/* Script mode, no echo and no editing.  The CR of a CR LF ends the
+			 line and the LF is then an empty line, which is ignored rather
+			 than repeating the last command. */
+			if ((cRxedChar == '\n') || (cRxedChar == '\r')) {
+				if ((ucInputIndex > 0) || (ucInputOverflow == 1)) {
+					prvScriptRunLine(cInputString, pcOutputString, ucInputOverflow);
+				}
+				ucScriptFormat = ucScriptFormatRequested;
+				ucInputIndex = 0;
+				ucInputOverflow = 0;
+				memset(cInputString, 0x00, cmdMAX_INPUT_SIZE);
+			}
+			else if ((cRxedChar >= ' ') && (cRxedChar <= '~')) {
+				if (ucInputIndex < (cmdMAX_INPUT_SIZE - 1)) {
+					cInputString[ucInputIndex] = cRxedChar;
+					ucInputIndex++;
+				}
+				else {
+					ucInputOverflow = 1;
+				}
+			}
+			continue;
+		}
 
 		/* Echo the character back. */
 		//xSerialPutChar( xPort, cRxedChar, portMAX_DELAY );
@@ -134,7 +301,11 @@ void prvUARTCommandConsoleTask(void const *pvParameters) {
 			ucInputIndex = 0;
 			memset(cInputString, 0x00, cmdMAX_INPUT_SIZE);
 
-			UART_Transfer((uint8_t *) pcEndOfOutputMessage, (unsigned short) strlen(pcEndOfOutputMessage));
+			/* No prompt if the command switched to script mode. */
+			ucScriptFormat = ucScriptFormatRequested;
+			if (ucScriptFormat == CLI_SCRIPT_OFF) {
+				UART_Transfer((uint8_t *) pcEndOfOutputMessage, (unsigned short) strlen(pcEndOfOutputMessage));
+			}
 		} else {
 			if (cRxedChar == '\r') {
 				/* Ignore the character. */
@@ -148,9 +319,10 @@ void prvUARTCommandConsoleTask(void const *pvParameters) {
 			} else {
 				/* A character was entered.  Add it to the string entered so
 				 far.  When a \n is entered the complete	string will be
-				 passed to the command interpreter. */
+				 passed to the command interpreter.  The last byte is kept
+				 for the terminator. */
 				if ((cRxedChar >= ' ') && (cRxedChar <= '~')) {
-					if (ucInputIndex < cmdMAX_INPUT_SIZE) {
+					if (ucInputIndex < (cmdMAX_INPUT_SIZE - 1)) {
 						cInputString[ucInputIndex] = cRxedChar;
 						ucInputIndex++;
 					}
@@ -163,21 +335,480 @@ void prvUARTCommandConsoleTask(void const *pvParameters) {
 
 void UART_Transfer(uint8_t *pData, uint16_t Size) {
 	if ( xSemaphoreTake( xTxMutex_CLI, cmdMAX_MUTEX_WAIT ) == pdPASS) {
-		//Set the flag to not ready
-		sUart_tx_ready = 0;
-		while (HAL_UART_Transmit_DMA(&huart1, pData, Size) != HAL_OK)
-			;
-		// Wait for the transfer to finish
-		while (sUart_tx_ready != 1)
-			;
+		prvTxWrite(pData, Size);
+		xSemaphoreGive(xTxMutex_CLI);
+	}
+}
+/*-----------------------------------------------------------*/
+
+static uint16_t prvTxWrite(const uint8_t *pucData, uint16_t usSize) {
+	uint16_t usWritten = 0;
+
+	while (usSize > 0) {
+		/* Copy up to the free space or the end of the buffer, whichever comes
+		 first.  Give up on the rest of the message if the UART has stalled. */
+		uint16_t usChunk = prvTxWaitForSpace();
+		if (usChunk == 0) {
+			break;
+		}
+		if (usChunk > usSize) {
+			usChunk = usSize;
+		}
+
+		memcpy(&ucTxBuffer[usTxHead], pucData, usChunk);
+		pucData += usChunk;
+		usSize -= usChunk;
+		usWritten += usChunk;
+
+		prvTxCommit(usChunk);
+	}
+
+	return usWritten;
+}
+/*-----------------------------------------------------------*/
+
+void UART_Stream_Begin(struct Fmt *pxFmt) {
+	/* With no stream open the writer drops everything, like a full buffer. */
+	Fmt_Init(pxFmt, NULL, 0);
+
+	if (ucScriptFormat != CLI_SCRIPT_OFF) {
+		/* The command is running inside a record, which already holds the
+		 UART.  The output is a field of it, so it has to be escaped on the
+		 way into the ring. */
+		if (ucScriptRecordOpen == 1) {
+			pxFmt->buffer = cScriptStreamChunk;
+			pxFmt->size = sizeof(cScriptStreamChunk);
+			pxFmt->flush = prvUARTScriptStreamFlush;
+		}
+	}
+	else {
+		/* No space yet, so the first character flushes and takes the UART
+		 for the first chunk. */
+		pxFmt->flush = prvUARTStreamFlush;
+	}
+}
+/*-----------------------------------------------------------*/
+
+void UART_Stream_End(struct Fmt *pxFmt) {
+	if (pxFmt->flush == prvUARTScriptStreamFlush) {
+		/* The record gives the UART back once the command has finished. */
+		prvUARTScriptStreamFlush(pxFmt);
+	}
+	else if (ucTxStreamOpen == 1) {
+		if (pxFmt->flush != NULL) {
+			prvTxCommit(pxFmt->length);
+		}
+		ucTxStreamOpen = 0;
+		xSemaphoreGive(xTxMutex_CLI);
+	}
+	pxFmt->flush = NULL;
+	pxFmt->buffer = NULL;
+	pxFmt->size = 0;
+}
+/*-----------------------------------------------------------*/
+
+static void prvUARTStreamFlush(struct Fmt *pxFmt) {
+	uint16_t usChunk = 0;
+
+	if (ucTxStreamOpen == 1) {
+		/* The characters were written straight into the ring, so handing them
+		 to the DMA is only a move of the head. */
+		prvTxCommit(pxFmt->length);
+
+		/* Other writers get the UART between chunks, so a long command never
+		 holds them off for more than one chunk. */
+		ucTxStreamOpen = 0;
+		xSemaphoreGive(xTxMutex_CLI);
+	}
+	pxFmt->length = 0;
+
+	if ( xSemaphoreTake( xTxMutex_CLI, cmdMAX_MUTEX_WAIT ) == pdPASS) {
+		usChunk = prvTxWaitForSpace();
+		if (usChunk > cmdTX_STREAM_CHUNK) {
+			usChunk = cmdTX_STREAM_CHUNK;
+		}
+
+		if (usChunk == 0) {
+			xSemaphoreGive(xTxMutex_CLI);
+		}
+		else {
+			ucTxStreamOpen = 1;
+		}
+	}
+
+	if (usChunk == 0) {
+		/* Not taken or stalled, drop the rest of the output. */
+		pxFmt->flush = NULL;
+		pxFmt->buffer = NULL;
+		pxFmt->size = 0;
+		return;
+	}
+
+	/* The next chunk is reserved by holding the UART, nothing else moves
+	 usTxHead until it is committed. */
+	pxFmt->buffer = (char *) &ucTxBuffer[usTxHead];
+	pxFmt->size = usChunk;
+}
+/*-----------------------------------------------------------*/
+
+static void prvUARTScriptStreamFlush(struct Fmt *pxFmt) {
+	prvScriptWrite(ucScriptFormat, pxFmt->buffer, pxFmt->length, pdTRUE);
+	pxFmt->length = 0;
+}
+/*-----------------------------------------------------------*/
+
+void UART_Set_Script_Format(uint8_t ucFormat) {
+	ucScriptFormatRequested = ucFormat;
+}
+/*-----------------------------------------------------------*/
+
+uint8_t UART_Get_Script_Format(void) {
+	return ucScriptFormat;
+}
+/*-----------------------------------------------------------*/
+
+static void prvScriptRunLine(char *pcLine, char *pcOutputString, uint8_t ucOverflow) {
+	uint8_t ucFormat = ucScriptFormat;
+	uint8_t ucIndex = 0;
+	char *pcEnd;
+	uint32_t ulSeq = strtoul(pcLine, &pcEnd, 10);
+
+	/* A line can start with "<seq>:" to set its sequence ID, otherwise it is
+	 one more than the last line. */
+	if ((pcEnd != pcLine) && (*pcEnd == ':')) {
+		pcLine = pcEnd + 1;
+	}
+	else {
+		ulSeq = ulScriptSeq + 1;
+	}
+	ulScriptSeq = ulSeq;
+
+	/* Nothing on a line that did not fit is run, part of a command could do
+	 the wrong thing. */
+	if (ucOverflow == 1) {
+		if ( xSemaphoreTake( xTxMutex_CLI, cmdMAX_MUTEX_WAIT ) == pdPASS) {
+			prvScriptRecordStart(ucFormat, ulSeq, 0, "");
+			prvScriptRecordEnd(ucFormat, "overflow");
+			xSemaphoreGive(xTxMutex_CLI);
+		}
+		return;
+	}
+
+	while (pcLine != NULL) {
+		char *pcNext = strchr(pcLine, ';');
+		if (pcNext != NULL) {
+			*pcNext++ = '\0';
+		}
+
+		/* Trim the spaces around the command. */
+		while (*pcLine == ' ') {
+			pcLine++;
+		}
+		size_t xLength = strlen(pcLine);
+		while ((xLength > 0) && (pcLine[xLength - 1] == ' ')) {
+			pcLine[--xLength] = '\0';
+		}
+
+		if (xLength > 0) {
+			prvScriptRunCommand(ucFormat, ulSeq, ucIndex, pcLine, pcOutputString);
+			ucIndex++;
+		}
+
+		pcLine = pcNext;
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvScriptRunCommand(uint8_t ucFormat, uint32_t ulSeq, uint8_t ucIndex, const char *pcCommand, char *pcOutputString) {
+	BaseType_t xReturned;
+
+	/* The interpreter looks past the end of a short command, so it gets a
+	 copy with nothing after it. */
+	strncpy(cScriptCommand, pcCommand, cmdMAX_INPUT_SIZE - 1);
+
+	/* The whole record is written under one hold of the UART so nothing else
+	 can land in the middle of it.  The command still runs if the UART cannot
+	 be taken, only its record is lost. */
+	if ( xSemaphoreTake( xTxMutex_CLI, cmdMAX_MUTEX_WAIT ) == pdPASS) {
+		ucScriptRecordOpen = 1;
+		prvScriptRecordStart(ucFormat, ulSeq, ucIndex, cScriptCommand);
+	}
+
+	do {
+		xReturned = FreeRTOS_CLIProcessCommand(cScriptCommand, pcOutputString, configCOMMAND_INT_MAX_OUTPUT_SIZE);
+		if (ucScriptRecordOpen == 1) {
+			prvScriptPut(ucFormat, pcOutputString, pdTRUE);
+		}
+	} while (xReturned != pdFALSE);
+
+	if (ucScriptRecordOpen == 1) {
+		prvScriptRecordEnd(ucFormat, pcScriptStatus[FreeRTOS_CLIGetStatus()]);
+		ucScriptRecordOpen = 0;
 		xSemaphoreGive(xTxMutex_CLI);
 	}
 }
 /*-----------------------------------------------------------*/
 
+static void prvScriptRecordStart(uint8_t ucFormat, uint32_t ulSeq, uint8_t ucIndex, const char *pcCommand) {
+	char cField[40];
+	struct Fmt xFmt;
+
+	/* JSON {"seq":42,"n":0,"cmd":"stats","out":"...","status":"ok"}
+	 CSV 42,0,"stats","...",ok */
+	Fmt_Init(&xFmt, cField, sizeof(cField));
+	if (ucFormat == CLI_SCRIPT_JSON) {
+		FMT(&xFmt, "{\"seq\":", ulSeq, ",\"n\":", ucIndex, ",\"cmd\":\"");
+	}
+	else {
+		FMT(&xFmt, ulSeq, ",", ucIndex, ",\"");
+	}
+
+	prvScriptPut(ucFormat, cField, pdFALSE);
+	prvScriptPut(ucFormat, pcCommand, pdTRUE);
+	prvScriptPut(ucFormat, (ucFormat == CLI_SCRIPT_JSON) ? "\",\"out\":\"" : "\",\"", pdFALSE);
+}
+/*-----------------------------------------------------------*/
+
+static void prvScriptRecordEnd(uint8_t ucFormat, const char *pcStatus) {
+	if (ucFormat == CLI_SCRIPT_JSON) {
+		prvScriptPut(ucFormat, "\",\"status\":\"", pdFALSE);
+		prvScriptPut(ucFormat, pcStatus, pdFALSE);
+		prvScriptPut(ucFormat, "\"}\r\n", pdFALSE);
+	}
+	else {
+		prvScriptPut(ucFormat, "\",", pdFALSE);
+		prvScriptPut(ucFormat, pcStatus, pdFALSE);
+		prvScriptPut(ucFormat, "\r\n", pdFALSE);
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvScriptPut(uint8_t ucFormat, const char *pcData, BaseType_t xEscape) {
+	prvScriptWrite(ucFormat, pcData, strlen(pcData), xEscape);
+}
+/*-----------------------------------------------------------*/
+
+static void prvScriptWrite(uint8_t ucFormat, const char *pcData, size_t xLength, BaseType_t xEscape) {
+	static const char cHex[] = "0123456789abcdef";
+	char cEscaped[32];
+	uint16_t usUsed = 0;
+
+	if (xEscape == pdFALSE) {
+		prvTxWrite((const uint8_t *) pcData, xLength);
+		return;
+	}
+
+	/* JSON escapes quotes, backslashes and control characters.  CSV doubles
+	 quotes and backslash escapes the rest the same way, \\, \r, \n and \xHH,
+	 so every record is one line and the output can be recovered exactly. */
+	for (size_t i = 0; i < xLength; i++) {
+		uint8_t ucChar = (uint8_t) pcData[i];
+
+		if (usUsed > (sizeof(cEscaped) - 6)) {
+			prvTxWrite((const uint8_t *) cEscaped, usUsed);
+			usUsed = 0;
+		}
+
+		if (ucFormat == CLI_SCRIPT_JSON) {
+			if ((ucChar == '"') || (ucChar == '\\')) {
+				cEscaped[usUsed++] = '\\';
+				cEscaped[usUsed++] = ucChar;
+			}
+			else if (ucChar == '\r') {
+				cEscaped[usUsed++] = '\\';
+				cEscaped[usUsed++] = 'r';
+			}
+			else if (ucChar == '\n') {
+				cEscaped[usUsed++] = '\\';
+				cEscaped[usUsed++] = 'n';
+			}
+			else if (ucChar < ' ') {
+				memcpy(&cEscaped[usUsed], "\\u00", 4);
+				usUsed += 4;
+				cEscaped[usUsed++] = cHex[ucChar >> 4];
+				cEscaped[usUsed++] = cHex[ucChar & 0x0F];
+			}
+			else {
+				cEscaped[usUsed++] = ucChar;
+			}
+		}
+		else {
+			if (ucChar == '"') {
+				cEscaped[usUsed++] = '"';
+				cEscaped[usUsed++] = '"';
+			}
+			else if (ucChar == '\\') {
+				cEscaped[usUsed++] = '\\';
+				cEscaped[usUsed++] = '\\';
+			}
+			else if (ucChar == '\r') {
+				cEscaped[usUsed++] = '\\';
+				cEscaped[usUsed++] = 'r';
+			}
+			else if (ucChar == '\n') {
+				cEscaped[usUsed++] = '\\';
+				cEscaped[usUsed++] = 'n';
+			}
+			else if (ucChar < ' ') {
+				cEscaped[usUsed++] = '\\';
+				cEscaped[usUsed++] = 'x';
+				cEscaped[usUsed++] = cHex[ucChar >> 4];
+				cEscaped[usUsed++] = cHex[ucChar & 0x0F];
+			}
+			else {
+				cEscaped[usUsed++] = ucChar;
+			}
+		}
+	}
+
+	if (usUsed > 0) {
+		prvTxWrite((const uint8_t *) cEscaped, usUsed);
+	}
+}
+/*-----------------------------------------------------------*/
+
+static uint16_t prvTxWaitForSpace(void) {
+	for (;;) {
+		uint16_t usHead = usTxHead;
+		uint16_t usFree = cmdTX_BUFFER_MASK - ((usHead - usTxTail) & cmdTX_BUFFER_MASK);
+
+		if (usFree != 0) {
+			uint16_t usContiguous = cmdTX_BUFFER_SIZE - usHead;
+			return (usContiguous < usFree) ? usContiguous : usFree;
+		}
+
+		/* Buffer is full, block until the DMA has drained some of it.  The
+		 flag is set with interrupts masked so a completion between the check
+		 above and the wait cannot be missed. */
+		taskENTER_CRITICAL();
+		ucTxWaitingForSpace = (usHead == ((usTxTail - 1) & cmdTX_BUFFER_MASK));
+		taskEXIT_CRITICAL();
+
+		if ((ucTxWaitingForSpace == 1) && (xSemaphoreTake(xTxSpace_CLI, cmdMAX_MUTEX_WAIT) != pdPASS)) {
+			ucTxWaitingForSpace = 0;
+			return 0;
+		}
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvTxCommit(uint16_t usLength) {
+	if (usLength == 0) {
+		return;
+	}
+
+	usTxHead = (usTxHead + usLength) & cmdTX_BUFFER_MASK;
+
+	taskENTER_CRITICAL();
+	if (usTxDMALength == 0) {
+		prvUARTStartTransmit();
+	}
+	taskEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
+
+static void prvUARTStartReceive(void) {
+	usRxReadIndex = 0;
+
+	if (HAL_UART_Receive_DMA(&huart1, ucRxBuffer, cmdRX_BUFFER_SIZE) == HAL_OK) {
+		__HAL_UART_CLEAR_IDLEFLAG(&huart1);
+		__HAL_UART_ENABLE_IT(&huart1, UART_IT_IDLE);
+	}
+}
+/*-----------------------------------------------------------*/
+
+static signed char prvUARTGetChar(void) {
+	signed char cRxedChar;
+
+	for (;;) {
+		/* The DMA counts down from the buffer size to the next write position. */
+		uint16_t usRxWriteIndex = (cmdRX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart1.hdmarx)) % cmdRX_BUFFER_SIZE;
+
+		if (usRxReadIndex != usRxWriteIndex) {
+			break;
+		}
+
+		/* Sleep until the line goes idle or half the buffer has filled. */
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		/* A framing or noise error stops the DMA, start it again. */
+		if (huart1.RxState == HAL_UART_STATE_READY) {
+			prvUARTStartReceive();
+		}
+	}
+
+	cRxedChar = (signed char) ucRxBuffer[usRxReadIndex];
+	usRxReadIndex = (usRxReadIndex + 1) % cmdRX_BUFFER_SIZE;
+
+	return cRxedChar;
+}
+/*-----------------------------------------------------------*/
+
+static void prvUARTStartTransmit(void) {
+	uint16_t usHead = usTxHead;
+	uint16_t usTail = usTxTail;
+
+	if (usHead == usTail) {
+		return;
+	}
+
+	/* Stop at the end of the buffer, the wrapped part is chained from the
+	 complete callback. */
+	uint16_t usLength = (usHead > usTail) ? (usHead - usTail) : (cmdTX_BUFFER_SIZE - usTail);
+
+	if (HAL_UART_Transmit_DMA(&huart1, &ucTxBuffer[usTail], usLength) == HAL_OK) {
+		usTxDMALength = usLength;
+	}
+}
+/*-----------------------------------------------------------*/
+
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
 	if (huart->Instance == USART1) {
-		sUart_tx_ready = 1;
+		usTxTail = (usTxTail + usTxDMALength) & cmdTX_BUFFER_MASK;
+		usTxDMALength = 0;
+
+		prvUARTStartTransmit();
+
+		if (ucTxWaitingForSpace == 1) {
+			BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+			ucTxWaitingForSpace = 0;
+			xSemaphoreGiveFromISR(xTxSpace_CLI, &xHigherPriorityTaskWoken);
+			portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+		}
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvUARTNotifyConsoleFromISR(void) {
+	if (CLITaskHandle != NULL) {
+		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(CLITaskHandle, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 	}
 }
+/*-----------------------------------------------------------*/
 
+void UART_RX_Idle_Callback(void) {
+	prvUARTNotifyConsoleFromISR();
+}
+/*-----------------------------------------------------------*/
+
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart) {
+	if (huart->Instance == USART1) {
+		prvUARTNotifyConsoleFromISR();
+	}
+}
+/*-----------------------------------------------------------*/
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+	if (huart->Instance == USART1) {
+		prvUARTNotifyConsoleFromISR();
+	}
+}
+/*-----------------------------------------------------------*/
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+	if (huart->Instance == USART1) {
+		prvUARTNotifyConsoleFromISR();
+	}
+}
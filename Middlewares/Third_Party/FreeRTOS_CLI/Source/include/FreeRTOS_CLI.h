@@ -48,6 +48,11 @@ typedef struct xCOMMAND_LINE_INPUT
 /* For backward compatibility. */
 #define xCommandLineInput CLI_Command_Definition_t
 
+/* Results of the last command, from FreeRTOS_CLIGetStatus(). */
+#define cliSTATUS_OK					0
+#define cliSTATUS_UNKNOWN_COMMAND		1
+#define cliSTATUS_BAD_PARAMETERS		2
+
 /*
  * Register the command passed in using the pxCommandToRegister parameter.
  * Registering a command adds the command to the list of commands that are
@@ -84,6 +89,13 @@ BaseType_t FreeRTOS_CLIProcessCommand( const char * const pcCommandInput, char *
  */
 char *FreeRTOS_CLIGetOutputBuffer( void );
 
+/*
+ * Returns one of the cliSTATUS_ values for the last call to
+ * FreeRTOS_CLIProcessCommand(), so a caller can tell an error apart from the
+ * output of a command.
+ */
+BaseType_t FreeRTOS_CLIGetStatus( void );
+
 /*
  * Return a pointer to the xParameterNumber'th word in pcCommandString.
  */
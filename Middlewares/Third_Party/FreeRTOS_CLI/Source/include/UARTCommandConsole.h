@@ -30,6 +30,14 @@
 
 #include "stm32g0xx_hal.h"
 #include "cmsis_os.h"
+#include "fmt.h"
+
+/* Output formats of script mode, set with the script command.  In script
+ mode nothing is echoed, there is no prompt, a line can hold several commands
+ separated by ';' and each command answers with one record on one line. */
+#define CLI_SCRIPT_OFF		0
+#define CLI_SCRIPT_JSON		1
+#define CLI_SCRIPT_CSV		2
 
 /*
  * The task that implements the command console processing.
@@ -38,6 +46,35 @@ void prvUARTCommandConsoleTask(void const *pvParameters);
 
 void UART_Transfer(uint8_t *pData, uint16_t Size);
 
+/*
+ * Opens a writer straight onto the transmit ring buffer, for command output
+ * too long for the CLI output buffer.  Characters are formatted in place at
+ * the head of the ring, and each chunk goes to the DMA as soon as it is full,
+ * so sending starts while the rest is being written.  The UART is held while a
+ * chunk is being written and given back between chunks, so other output can
+ * come between them, but the command must not print while it streams.  If the
+ * UART cannot be taken or stalls the rest of the output is dropped.
+ */
+void UART_Stream_Begin(struct Fmt *pxFmt);
+
+/*
+ * Sends what is left in the writer and releases the UART.
+ */
+void UART_Stream_End(struct Fmt *pxFmt);
+
+/*
+ * Switches between the interactive console and script mode, CLI_SCRIPT_
+ * values.  Takes effect from the next command.
+ */
+void UART_Set_Script_Format(uint8_t ucFormat);
+
+uint8_t UART_Get_Script_Format(void);
+
+/*
+ * Called from the USART interrupt when the receive line goes idle.
+ */
+void UART_RX_Idle_Callback(void);
+
 /*
  * Register commands that can be used with FreeRTOS+CLI through the UDP socket.
  * The commands are defined in CLI-commands.c.
@@ -47,6 +84,10 @@ void vRegisterCLICommands(void);
 /* Used to guard access to the UART in case messages are sent to the UART from
  more than one task. */
 extern SemaphoreHandle_t xTxMutex_CLI;
+
+/* Given from the transmit complete interrupt when a task is waiting for room
+ in the transmit buffer. */
+extern SemaphoreHandle_t xTxSpace_CLI;
 osThreadId CLITaskHandle;
 
 #endif /* UART_COMMAND_CONSOLE_H */
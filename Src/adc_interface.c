@@ -12,11 +12,24 @@
 
 #include "task.h"
 #include "printf.h"
+#include "event_log.h"
+#include "params.h"
+#include "kv_store.h"
+#include "flash_write.h"
 #include "string.h"
 
 extern ADC_HandleTypeDef hadc1;
 
+_Static_assert(sizeof(struct Adc_Calibration) <= KV_MAX_VALUE_SIZE, "Adc_Calibration must fit in one key value record");
+
 /* Private typedef -----------------------------------------------------------*/
+struct Adc_Cal_Point {
+	int32_t reference_uv;
+	uint32_t reading[SCALAR_ARRAY_SIZE];
+	int32_t temperature_c;
+	uint8_t valid;
+};
+
 struct Adc {
 	uint32_t bat_voltage;
 	uint32_t cell_voltage[4];
@@ -31,17 +44,103 @@ struct Adc {
 /* Private variables ---------------------------------------------------------*/
 struct Adc adc_values;
 uint32_t adc_buffer[7];
-static volatile uint32_t adc_scalars[SCALAR_ARRAY_SIZE], adc_offset[SCALAR_ARRAY_SIZE], adc_buffer_filtered[7], adc_filtered_output[7];
+static volatile uint32_t adc_buffer_filtered[7], adc_filtered_output[7];
+static volatile int32_t adc_gain[SCALAR_ARRAY_SIZE], adc_offset[SCALAR_ARRAY_SIZE];
+struct Adc_Calibration adc_calibration;
+struct Adc_Cal_Point adc_cal_point;
 static volatile uint32_t adc_sum_count;
+static volatile uint8_t adc_reading_ready;
+static TickType_t adc_reading_tick;
 static volatile uint16_t vrefint_cal;
-static volatile uint8_t cal_present;
 
 /* Private function prototypes -----------------------------------------------*/
 uint8_t Set_Battery_Voltage(uint32_t adc_reading);
 uint8_t Set_Cell_Voltage(uint8_t cell_number, uint32_t adc_reading);
 uint8_t Set_MCU_Temperature(uint32_t adc_reading);
 uint8_t Set_VDDa(uint32_t adc_reading);
-uint8_t Read_Scalars_From_Flash(void);
+uint32_t Apply_Calibration(uint8_t channel, uint32_t adc_reading);
+void Update_ADC_Compensation(void);
+uint8_t Calibration_Valid(const struct Adc_Calibration *calibration);
+void Scalars_To_Calibration(const uint32_t *scalars, struct Adc_Calibration *calibration);
+uint8_t Scalars_Valid(const uint32_t *scalars);
+uint8_t Read_Scalars_From_OTP(uint32_t *scalars);
+uint8_t Read_Calibration_From_Flash(void);
+
+/**
+ * @brief Converts a reading to volts * BATTERY_ADC_MULTIPLIER with one multiply-add
+ * @param channel 0 battery, 1 cell 1, 2 to 4 the 2S to 4S taps
+ */
+uint32_t Apply_Calibration(uint8_t channel, uint32_t adc_reading) {
+	int32_t voltage = (((int32_t)adc_reading * adc_gain[channel]) + adc_offset[channel]) >> ADC_CAL_GAIN_SHIFT;
+
+	return (voltage > 0) ? (uint32_t)voltage : 0;
+}
+
+/**
+ * @brief Folds the temperature coefficients into the gains used by Apply_Calibration. Called once per filtered sample set.
+ */
+void Update_ADC_Compensation(void) {
+	float delta_c = (float)(adc_values.temperature - adc_calibration.temperature_c);
+
+	for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+		float correction = (float)adc_calibration.tempco_ppm[i] * delta_c * 0.000001f;
+
+		adc_gain[i] = adc_calibration.gain[i] + (int32_t)((float)adc_calibration.gain[i] * correction);
+		adc_offset[i] = adc_calibration.offset_uv[i] * (1 << ADC_CAL_GAIN_SHIFT);
+	}
+}
+
+/**
+ * @brief Gets a copy of the calibration table
+ */
+void Get_ADC_Calibration(struct Adc_Calibration *calibration) {
+	memcpy(calibration, &adc_calibration, sizeof(struct Adc_Calibration));
+}
+
+/**
+ * @brief Replaces the calibration table, used by the background self calibration
+ * @retval uint8_t 1 if successful, 0 if out of range
+ */
+uint8_t Set_ADC_Calibration(const struct Adc_Calibration *calibration) {
+	if (Calibration_Valid(calibration) == 0) {
+		return 0;
+	}
+
+	adc_calibration = *calibration;
+	Update_ADC_Compensation();
+
+	return 1;
+}
+
+/**
+ * @brief Checks a calibration table is in the range a calibration can produce
+ * @retval uint8_t 1 if valid, 0 if not
+ */
+uint8_t Calibration_Valid(const struct Adc_Calibration *calibration) {
+	for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+		if ((calibration->gain[i] < (ADC_CAL_MIN_GAIN_UV << ADC_CAL_GAIN_SHIFT)) || (calibration->gain[i] > (ADC_CAL_MAX_GAIN_UV << ADC_CAL_GAIN_SHIFT))) {
+			return 0;
+		}
+		if ((calibration->offset_uv[i] < -ADC_CAL_MAX_OFFSET_UV) || (calibration->offset_uv[i] > ADC_CAL_MAX_OFFSET_UV)) {
+			return 0;
+		}
+		if ((calibration->tempco_ppm[i] < -ADC_CAL_MAX_TEMPCO_PPM) || (calibration->tempco_ppm[i] > ADC_CAL_MAX_TEMPCO_PPM)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief Builds a gain only table from the single point scalars kept in OTP
+ */
+void Scalars_To_Calibration(const uint32_t *scalars, struct Adc_Calibration *calibration) {
+	memset(calibration, 0, sizeof(struct Adc_Calibration));
+
+	for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+		calibration->gain[i] = (int32_t)scalars[i] << ADC_CAL_GAIN_SHIFT;
+	}
+}
 
 /**
  * @brief Gets the battery voltage that was read in from the ADC
@@ -62,7 +161,7 @@ uint8_t Set_Battery_Voltage(uint32_t adc_reading) {
 		return 0;
 	}
 
-	adc_values.bat_voltage = adc_reading * adc_scalars[0];
+	adc_values.bat_voltage = Apply_Calibration(0, adc_reading);
 
 	return 1;
 }
@@ -97,7 +196,7 @@ uint8_t Set_Cell_Voltage(uint8_t cell_number, uint32_t adc_reading) {
 			return 0;
 		}
 		else {
-			adc_values.cell_voltage[0] = adc_reading * adc_scalars[1];
+			adc_values.cell_voltage[0] = Apply_Calibration(1, adc_reading);
 
 			if (adc_values.cell_voltage[0] > CELL_MAX_VOLTAGE) {
 				adc_values.cell_voltage[0] = 0;
@@ -113,7 +212,7 @@ uint8_t Set_Cell_Voltage(uint8_t cell_number, uint32_t adc_reading) {
 			return 0;
 		}
 		else {
-			adc_values.two_s_battery_voltage = adc_reading * adc_scalars[2];
+			adc_values.two_s_battery_voltage = Apply_Calibration(2, adc_reading);
 
 			if (adc_values.two_s_battery_voltage > TWO_S_MAX_VOLTAGE) {
 				adc_values.two_s_battery_voltage = 0;
@@ -136,7 +235,7 @@ uint8_t Set_Cell_Voltage(uint8_t cell_number, uint32_t adc_reading) {
 			return 0;
 		}
 		else {
-			adc_values.three_s_battery_voltage = adc_reading * adc_scalars[3];
+			adc_values.three_s_battery_voltage = Apply_Calibration(3, adc_reading);
 
 			if (adc_values.three_s_battery_voltage > THREE_S_MAX_VOLTAGE) {
 				adc_values.three_s_battery_voltage = 0;
@@ -159,7 +258,7 @@ uint8_t Set_Cell_Voltage(uint8_t cell_number, uint32_t adc_reading) {
 			return 0;
 		}
 		else {
-			adc_values.four_s_battery_voltage = adc_reading * adc_scalars[4];
+			adc_values.four_s_battery_voltage = Apply_Calibration(4, adc_reading);
 
 			if (adc_values.four_s_battery_voltage > FOUR_S_MAX_VOLTAGE) {
 				adc_values.four_s_battery_voltage = 0;
@@ -225,95 +324,148 @@ uint8_t Set_VDDa(uint32_t adc_reading) {
 }
 
 /**
- * @brief  Calculates and sets the ADC scalars based on a reference voltage input
+ * @brief  Adds a calibration point from a reference voltage connected to cells 1-4 and the XT60.
+ * The first point at or above ADC_CAL_MIN_SPAN_UV sets the gains. A second point at least ADC_CAL_MIN_SPAN_UV
+ * away sets gain and offset. Repeating the last point at least ADC_CAL_MIN_TC_DELTA_C warmer or colder sets
+ * the temperature coefficients.
  * @param  reference_voltage: Reference voltage in milivolts
  * @retval uint8_t 1 if successful, 0 if error
  */
 uint8_t Calibrate_ADC(float reference_voltage_mv) {
+	struct Adc_Calibration calibration = adc_calibration;
+	struct Adc_Cal_Point point;
 
-	if (reference_voltage_mv > 4200.0f) {
+	if ((reference_voltage_mv < 0.0f) || (reference_voltage_mv > 4200.0f)) {
 		return 0;
 	}
 
-	printf("Input Reference Voltage in mv: %.3f\r\n", reference_voltage_mv);
+	point.reference_uv = (int32_t)(reference_voltage_mv * 1000);
+	point.temperature_c = adc_values.temperature;
+	point.valid = 1;
 
-	if (reference_voltage_mv < 0.01f) {
-		for (int i = 0; i < 5; i++) {
-			adc_offset[i] = adc_filtered_output[i];
+	for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+		point.reading[i] = adc_filtered_output[i];
+	}
+
+	EVENT_LOG("Input Reference Voltage in uV: %u at %d C", point.reference_uv, point.temperature_c);
 
-			printf("ADC Channel %u offset: %u\r\n", i, adc_offset[i]);
+	int32_t span_uv = point.reference_uv - adc_cal_point.reference_uv;
+	int32_t delta_c = point.temperature_c - adc_cal_point.temperature_c;
+
+	if ((adc_cal_point.valid == 1) && (span_uv <= ADC_CAL_SAME_POINT_UV) && (span_uv >= -ADC_CAL_SAME_POINT_UV) &&
+			((delta_c >= ADC_CAL_MIN_TC_DELTA_C) || (delta_c <= -ADC_CAL_MIN_TC_DELTA_C))) {
+		//Same voltage at another temperature. The gain has to change by the inverse of the reading to give the same voltage.
+		for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+			if (point.reading[i] == 0) {
+				return 0;
+			}
+			float drift = ((float)adc_cal_point.reading[i] / (float)point.reading[i]) - 1.0f;
+			calibration.tempco_ppm[i] = (int16_t)((drift * 1000000.0f) / (float)delta_c);
+
+			EVENT_LOG("ADC Channel %u tempco: %d ppm/C", i, calibration.tempco_ppm[i]);
 		}
+		//Keep the earlier point so a third reading at yet another temperature is measured from it too
+		point = adc_cal_point;
 	}
-	else {
-		for (int i = 0; i < 5; i++) {
-			float scale = (reference_voltage_mv * BATTERY_ADC_MULTIPLIER) / (adc_filtered_output[i] * 1000);
-			adc_scalars[i] = (uint32_t)scale;
+	else if ((adc_cal_point.valid == 1) && ((span_uv >= ADC_CAL_MIN_SPAN_UV) || (span_uv <= -ADC_CAL_MIN_SPAN_UV))) {
+		for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+			int32_t counts = (int32_t)point.reading[i] - (int32_t)adc_cal_point.reading[i];
+			if (counts == 0) {
+				return 0;
+			}
+			float gain = (float)span_uv / (float)counts;
 
-			printf("ADC Channel %u scalar: %u\r\n", i, adc_scalars[i]);
+			calibration.gain[i] = (int32_t)(gain * (1 << ADC_CAL_GAIN_SHIFT));
+			calibration.offset_uv[i] = point.reference_uv - (int32_t)(gain * (float)point.reading[i]);
+
+			EVENT_LOG("ADC Channel %u gain: %u offset: %d", i, calibration.gain[i], calibration.offset_uv[i]);
 		}
+		calibration.temperature_c = (int16_t)((point.temperature_c + adc_cal_point.temperature_c) / 2);
+	}
+	else if (point.reference_uv >= ADC_CAL_MIN_SPAN_UV) {
+		for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+			if (point.reading[i] == 0) {
+				return 0;
+			}
+			calibration.gain[i] = (int32_t)(((float)point.reference_uv * (1 << ADC_CAL_GAIN_SHIFT)) / (float)point.reading[i]);
+			calibration.offset_uv[i] = 0;
+
+			EVENT_LOG("ADC Channel %u gain: %u", i, calibration.gain[i]);
+		}
+		calibration.temperature_c = (int16_t)point.temperature_c;
+	}
+	else {
+		//Too low to set a gain from on its own, kept as the first of two points
+		adc_cal_point = point;
+		return 1;
 	}
 
+	adc_cal_point = point;
+
+	if (Calibration_Valid(&calibration) == 0) {
+		EVENT_LOG("Calibration out of range, not applied");
+		return 0;
+	}
+
+	adc_calibration = calibration;
+	Update_ADC_Compensation();
+
 	return 1;
 }
 
-void vRead_ADC(void const *pvParameters) {
+/**
+ * @brief Calibrates the ADC and starts the DMA. Called once by the control executive before its first frame, blocks for about 1s.
+ */
+void ADC_Start(void) {
 	// calibrate ADC
 	vTaskDelay(500 / portTICK_PERIOD_MS);
 	while (HAL_ADCEx_Calibration_Start(&hadc1) != HAL_OK);
 	vTaskDelay(500 / portTICK_PERIOD_MS);
 	vrefint_cal = (uint32_t)(*VREFINT_CAL_ADDR); // VREFINT calibration value
 
-	//Read the scalars out of OTP flash
-	Read_Scalars_From_Flash();
+	//Read the calibration out of the key value store, or OTP
+	Read_Calibration_From_Flash();
 
 	adc_sum_count = 0;
-
-	static uint32_t thread_notification;
-	const TickType_t xMaxBlockTime = pdMS_TO_TICKS(500);
+	adc_reading_ready = 0;
+	adc_reading_tick = xTaskGetTickCount();
 
 	// Start the DMA ADC
 	HAL_ADC_Start_DMA(&hadc1, adc_buffer, hadc1.Init.NbrOfConversion);
+}
 
-	for (;;) {
-		/* Wait to be notified of an interrupt. */
-		thread_notification = ulTaskNotifyTake(pdTRUE, xMaxBlockTime);
-
-		if (thread_notification) {
-
-			/* A notification was received. */
-			Set_Battery_Voltage(adc_filtered_output[0]);
+/**
+ * @brief Sense stage of the control executive. Takes in the latest filtered reading if the DMA interrupt has
+ * finished one since the last call. A reading finished while a frame is late is replaced by the next one.
+ * @retval uint8_t 1 if there was a new reading, 0 if not
+ */
+uint8_t ADC_Update(void) {
+	if (adc_reading_ready == 0) {
+		if ((xTaskGetTickCount() - adc_reading_tick) >= pdMS_TO_TICKS(ADC_READING_TIMEOUT_MS)) {
+			printf("Did Not Receive an ADC Notification\r\n");
+			adc_reading_tick = xTaskGetTickCount();
+		}
+		return 0;
+	}
 
-#if ENABLE_BALANCING
-			for (int i = 0; i < 4; i++) {
-          Set_Cell_Voltage(i, adc_filtered_output[i+1]);
-      }
-//#else
-//			for (int i = 0; i < NUM_SERIES; i++) {
-//          Set_Cell_Voltage(i, adc_filtered_output[i+1]);
-//      }
-//
-//			for (int i = NUM_SERIES; i < 4 ; i++) {
-//			  Set_Cell_Voltage(i, adc_filtered_output[i+1]);
-//      }
-//  battery_state.balance_port_connected = CONNECTED;
-//  battery_state.number_of_cells = NUM_SERIES;
-//  Clear_Error_State(CELL_CONNECTION_ERROR);
-#endif
+	adc_reading_ready = 0;
+	adc_reading_tick = xTaskGetTickCount();
 
+	Set_Battery_Voltage(adc_filtered_output[0]);
 
+	if (params.enable_balancing) {
+		for (int i = 0; i < 4; i++) {
+			Set_Cell_Voltage(i, adc_filtered_output[i+1]);
+		}
+	}
 
-			Set_MCU_Temperature(adc_filtered_output[5]);
+	Set_MCU_Temperature(adc_filtered_output[5]);
 
-			Set_VDDa(adc_filtered_output[6]);
+	Update_ADC_Compensation();
 
-			/* Determines battery connection state and performs balancing */
-			Battery_Connection_State();
+	Set_VDDa(adc_filtered_output[6]);
 
-		} else {
-			/* Did not receive a notification within the expected time. */
-			printf("Did Not Receive an ADC Notification\r\n");
-		}
-	}
+	return 1;
 }
 
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
@@ -343,9 +495,8 @@ void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
 		// Clear the buffer
 		memset((uint32_t *)adc_buffer_filtered, 0, sizeof(adc_buffer_filtered));
 
-		BaseType_t should_context_switch = pdFALSE;
-		vTaskNotifyGiveFromISR(adcTaskHandle, &should_context_switch);
-		portYIELD_FROM_ISR(should_context_switch);
+		// Picked up by the next sense stage, the control executive is not woken for it
+		adc_reading_ready = 1;
 	}
 }
 
@@ -362,14 +513,17 @@ uint32_t Get_Four_S_Voltage() {
 }
 
 /**
- * @brief  Writes the cal result to OTP Flash
- * @retval uint8_t 1 if successful, 0 if error
+ * @brief  Writes the cal gains to OTP Flash as the factory fallback. Offsets and temperature coefficients are not kept.
+ * OTP only has room for ~40 of these ever.
+ * @retval uint8_t 0 if successful, 1 if error
  */
 uint8_t Write_Cal_To_OTP_Flash() {
-	HAL_StatusTypeDef status;
+	uint32_t adc_scalars[SCALAR_ARRAY_SIZE];
 
 	/* Check input parameters */
 	for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+		adc_scalars[i] = (uint32_t)((adc_calibration.gain[i] + (1 << (ADC_CAL_GAIN_SHIFT - 1))) >> ADC_CAL_GAIN_SHIFT);
+
 		if ((adc_scalars[i] < 750) || (adc_scalars[i] > 5000)) {
 			printf("ERROR: ADC Scalar %u Not Set or Out of Range\r\n", i);
 			/* Return error */
@@ -377,11 +531,6 @@ uint8_t Write_Cal_To_OTP_Flash() {
 		}
 	}
 
-	if (HAL_FLASH_Unlock() != HAL_OK) {
-		printf("ERROR: Could not unlock Flash\r\n");
-		return 1;
-	}
-
 	uint32_t address = OTP_START_ADDR;
 	uint32_t temp_address = OTP_START_ADDR;
 
@@ -416,77 +565,96 @@ uint8_t Write_Cal_To_OTP_Flash() {
 
 		printf("Writing 0x%016llx to address: 0x%08x\r\n", (uint64_t)data_in_64, (uint32_t)(address + (i * BYTES_IN_UINT64)));
 
-		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, (address + (i * BYTES_IN_UINT64)), data_in_64);
-
-		if (status != HAL_OK) {
+		if (Flash_Program((address + (i * BYTES_IN_UINT64)), &data_in_64, BYTES_IN_UINT64) == 0) {
 			printf("ERROR: Write scalar #%u to OTP Flash Failed\r\n", i);
-
-			if (HAL_FLASH_Lock() != HAL_OK) {
-				printf("ERROR: Could not lock Flash\r\n");
-				return 1;
-			}
-
 			/* Return error */
 			return 1;
 		}
 	}
 
-	if (HAL_FLASH_Lock() != HAL_OK) {
-		printf("ERROR: Could not lock Flash\r\n");
-		return 1;
-	}
-
 	return 0;
 }
 
 /**
- * @brief  Read the cal values from OTP Flash
- * @retval uint8_t 1 if successful, 0 if error
+ * @brief  Checks scalars are in the range a calibration can produce
+ * @retval uint8_t 1 if valid, 0 if not
  */
-uint8_t Read_Scalars_From_Flash() {
-	uint32_t address = OTP_START_ADDR;
-
-	uint32_t temp_scalars[SCALAR_ARRAY_SIZE] = {0};
-
-	uint8_t t = SCALAR_ARRAY_SIZE - 1;
-
-	for (int i = OTP_SIZE; i >= 0; i--) {
+uint8_t Scalars_Valid(const uint32_t *scalars) {
+	for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+		if ((scalars[i] < 750) || (scalars[i] > 5000)) {
+			return 0;
+		}
+	}
+	return 1;
+}
 
-		uint32_t value = *(uint32_t *)(address + (i * BYTES_IN_UINT32));
+/**
+ * @brief  Writes the calibration table to the flash key value store. Can be repeated as often as needed.
+ * @retval uint8_t 1 if successful, 0 if error
+ */
+uint8_t Save_Cal_To_Flash() {
+	if (Calibration_Valid(&adc_calibration) == 0) {
+		return 0;
+	}
 
-		if ((value > 750) && (value < 5000)) {
-			printf("OTP Value %u at address: 0x%08x\r\n", value, (uint32_t)(address + (i * BYTES_IN_UINT32)));
+	return KV_Write(KV_KEY_ADC_CALIBRATION, &adc_calibration, sizeof(adc_calibration));
+}
 
-			if (cal_present == 0) {
-				temp_scalars[t] = value;
-			}
+/**
+ * @brief  Finds the newest factory calibration in OTP. Records are three doublewords, written back to back.
+ * @retval uint8_t 1 if found, 0 if OTP is blank
+ */
+uint8_t Read_Scalars_From_OTP(uint32_t *scalars) {
+	const uint32_t record_size = 3 * BYTES_IN_UINT64;
+	uint32_t record[SCALAR_ARRAY_SIZE];
+	uint8_t found = 0;
 
-			if(t == 0) {
-				cal_present = cal_present + 1;
-				t = SCALAR_ARRAY_SIZE;
-			}
+	for (uint32_t address = OTP_START_ADDR; (address + record_size) <= (OTP_START_ADDR + (OTP_SIZE * BYTES_IN_UINT64)); address += record_size) {
+		memcpy(record, (const void *)address, sizeof(record));
 
-			t--;
+		if (Scalars_Valid(record) == 0) {
+			break;
 		}
-	}
 
-	if (cal_present != 0) {
+		memcpy(scalars, record, sizeof(record));
+		found = 1;
+	}
 
-		for (int y = 0; y < SCALAR_ARRAY_SIZE; y++) {
-			adc_scalars[y] = temp_scalars[y];
-		}
+	return found;
+}
 
-		printf("Calibration values already present. 32 total calibrations can be performed. Number of calibrations performed: %u\r\n", cal_present);
-		printf("Using these calibration values:\r\n");
+/**
+ * @brief  Loads the calibration table from the flash key value store. Falls back to gain only scalars
+ * saved by older firmware, then to OTP if nothing has been saved.
+ * @retval uint8_t 1 if successful, 0 if not calibrated
+ */
+uint8_t Read_Calibration_From_Flash() {
+	struct Adc_Calibration calibration;
+	uint32_t scalars[SCALAR_ARRAY_SIZE];
 
-		for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
-			printf("Scalar: %u  Value: %u\r\n", i, adc_scalars[i]);
-		}
+	if ((KV_Read(KV_KEY_ADC_CALIBRATION, &calibration, sizeof(calibration)) == 1) && (Calibration_Valid(&calibration) == 1)) {
+		EVENT_LOG("ADC calibration loaded from flash");
+	}
+	else if ((KV_Read(KV_KEY_ADC_SCALARS, scalars, sizeof(scalars)) == 1) && (Scalars_Valid(scalars) == 1)) {
+		Scalars_To_Calibration(scalars, &calibration);
+		EVENT_LOG("ADC calibration loaded from flash scalars");
+	}
+	else if (Read_Scalars_From_OTP(scalars) == 1) {
+		Scalars_To_Calibration(scalars, &calibration);
+		EVENT_LOG("ADC calibration loaded from OTP factory values");
+	}
+	else {
+		EVENT_LOG("NOT CALIBRATED. Connect known good voltage to cells 1-4 and XT60 in the range of 3.3V - 4V, run cal, then save_cal");
 		return 0;
 	}
 
-	cal_present = 0;
-	printf("NOT CALIBRATED. Connect known good voltage to cells 1-4 and XT60 in the range of 3.3V - 4V and run cal command.\r\nThen write then to flash with write_otp\r\n");
+	adc_calibration = calibration;
+
+	//No temperature reading yet, start from the calibration temperature
+	for (int i = 0; i < SCALAR_ARRAY_SIZE; i++) {
+		adc_gain[i] = adc_calibration.gain[i];
+		adc_offset[i] = adc_calibration.offset_uv[i] * (1 << ADC_CAL_GAIN_SHIFT);
+	}
 
 	return 1;
 }
@@ -9,6 +9,7 @@
 #include "battery.h"
 #include "bq25703a_regulator.h"
 #include "main.h"
+#include "params.h"
 #include "printf.h"
 
 /* Private typedef -----------------------------------------------------------*/
@@ -26,6 +27,7 @@ struct Battery {
 volatile struct Battery battery_state;
 
 static uint8_t cell_connected_bitmask = 0;
+static uint8_t balancing_was_enabled = 0;
 
 /* Private function prototypes -----------------------------------------------*/
 void Balance_Battery(void);
@@ -38,7 +40,7 @@ void MCU_Temperature_Safety_Check(void);
  */
 void Balance_Battery()
 {
-	if ( ENABLE_BALANCING && (battery_state.balance_port_connected == CONNECTED) && (Get_Error_State() == 0) ) {
+	if ( params.enable_balancing && (battery_state.balance_port_connected == CONNECTED) && (Get_Error_State() == 0) ) {
 
 		uint32_t min_cell_voltage = Get_Cell_Voltage(0);
 		uint32_t max_cell_voltage = Get_Cell_Voltage(0);
@@ -64,10 +66,10 @@ void Balance_Battery()
 			scalar = 1.0f;
 		}
 
-		if ( ((max_cell_voltage - min_cell_voltage) >= ((float)CELL_DELTA_V_ENABLE_BALANCING * scalar)) && (min_cell_voltage > MIN_CELL_V_FOR_BALANCING) && (battery_state.balancing_enabled == 0)) {
+		if ( ((max_cell_voltage - min_cell_voltage) >= ((float)(params.balance_start_mv * (BATTERY_ADC_MULTIPLIER / 1000)) * scalar)) && (min_cell_voltage > MIN_CELL_V_FOR_BALANCING) && (battery_state.balancing_enabled == 0)) {
 			battery_state.balancing_enabled = 1;
 		}
-		else if ( (((max_cell_voltage - min_cell_voltage) < ((float)CELL_BALANCING_HYSTERESIS_V * scalar)) && (battery_state.balancing_enabled == 1)) || (min_cell_voltage < MIN_CELL_V_FOR_BALANCING) ) {
+		else if ( (((max_cell_voltage - min_cell_voltage) < ((float)(params.balance_hysteresis_mv * (BATTERY_ADC_MULTIPLIER / 1000)) * scalar)) && (battery_state.balancing_enabled == 1)) || (min_cell_voltage < MIN_CELL_V_FOR_BALANCING) ) {
 			battery_state.balancing_enabled = 0;
 		}
 
@@ -99,6 +101,9 @@ void Balance_Battery()
  */
 void Balance_Connection_State()
 {
+	/* Any of the upper taps means a pack was on the balance connector last pass */
+	uint8_t pack_was_connected = (cell_connected_bitmask & 0b1110) ? 1 : 0;
+
 	if (( Get_Four_S_Voltage() > VOLTAGE_CONNECTED_THRESHOLD ) && ( Get_Cell_Voltage(3) > VOLTAGE_CONNECTED_THRESHOLD )) {
 		cell_connected_bitmask |= 0b1000;
 	}
@@ -157,6 +162,10 @@ void Balance_Connection_State()
 	else {
 		battery_state.number_of_cells = 0;
 		Clear_Error_State(CELL_CONNECTION_ERROR);
+		/* A latched cell voltage error belongs to the pack that was just unplugged */
+		if (pack_was_connected == 1) {
+			Error_Reset(CELL_VOLTAGE_ERROR);
+		}
 	}
 
 	if ( battery_state.number_of_cells > 1 ) {
@@ -209,26 +218,37 @@ void Battery_Connection_State()
 
 
 
-#if ENABLE_BALANCING
-	Balance_Connection_State();
-#else
-	battery_state.balance_port_connected = CONNECTED;
-	battery_state.number_of_cells = NUM_SERIES;
-  Clear_Error_State(CELL_CONNECTION_ERROR);
-#endif
+	if (params.enable_balancing) {
+		Balance_Connection_State();
+	}
+	else {
+		//No cell taps to count, so num_series sets the cell count and with it the charge voltage
+		battery_state.balance_port_connected = CONNECTED;
+		battery_state.number_of_cells = params.num_series;
+		Clear_Error_State(CELL_CONNECTION_ERROR);
+	}
 
 	MCU_Temperature_Safety_Check();
 
-#if ENABLE_BALANCING
-	Cell_Voltage_Safety_Check();
-#endif
+	//Balancing was switched off. Balance_Battery and Cell_Voltage_Safety_Check no longer run to release what they set.
+	if ((params.enable_balancing == 0) && (balancing_was_enabled == 1)) {
+		Balancing_GPIO_Control(0);
+		battery_state.balancing_enabled = 0;
+		battery_state.cell_balance_bitmask = 0;
+		battery_state.cell_over_voltage = 0;
+		Clear_Error_State(CELL_VOLTAGE_ERROR);
+		Error_Reset(CELL_VOLTAGE_ERROR);
+	}
+	balancing_was_enabled = params.enable_balancing;
+
+	if (params.enable_balancing) {
+		Cell_Voltage_Safety_Check();
 
-#if ENABLE_BALANCING
-	//Only update the balancing state if charging is off
-	if (Get_Regulator_Charging_State() == 0) {
-		Balance_Battery();
+		//Only update the balancing state if charging is off
+		if (Get_Regulator_Charging_State() == 0) {
+			Balance_Battery();
+		}
 	}
-#endif
 
 	if ((battery_state.xt60_connected == CONNECTED) && (battery_state.balance_port_connected == CONNECTED)){
 		if (Get_Battery_Voltage() < (battery_state.number_of_cells * CELL_VOLTAGE_TO_ENABLE_CHARGING)) {
@@ -10,9 +10,15 @@
 #include "battery.h"
 #include "error.h"
 #include "main.h"
+#include "thermal.h"
+#include "fan.h"
+#include "session_log.h"
+#include "params.h"
+#include "self_cal.h"
 #include "string.h"
 #include "printf.h"
 #include "usbpd.h"
+#include "control.h"
 
 extern I2C_HandleTypeDef hi2c1;
 
@@ -29,11 +35,53 @@ struct Regulator {
 	uint32_t charge_current;
 	uint32_t input_current;
 	uint32_t max_charge_current_ma;
+	uint32_t input_current_dpm_ma;
+	uint16_t charger_status;
+	uint8_t prochot_status;
+	uint32_t fault_events;
+	uint8_t thermal_throttled;
+};
+
+struct Input_Current_Loop {
+	int32_t integral_ma;
+	int32_t trim_ma;
+	TickType_t last_tick;
+};
+
+struct Source_Limit {
+	uint32_t limit_ma;
+	uint32_t known_good_ma;
+	uint32_t known_bad_ma;
+	uint32_t applied_ma;
+	TickType_t stable_start; // Last droop or probe step
+	uint8_t settled;
+};
+
+enum UVP_Recovery_State {
+	UVP_RECOVERY_CHECK,
+	UVP_RECOVERY_PULSE,
+	UVP_RECOVERY_SETTLE,
+	UVP_RECOVERY_DONE
+};
+
+struct UVP_Recovery {
+	uint8_t state;
+	uint8_t steps; // Frames left in this state after the current one
+	uint16_t attempts;
+	uint8_t first_pulse;
 };
 
 /* Private variables ---------------------------------------------------------*/
 struct Regulator regulator;
+struct Input_Current_Loop input_current_loop;
+struct Source_Limit source_limit;
+static uint8_t charger_backoff_pending = 0;
 uint8_t precharging_state=0;
+static TickType_t charger_hold_start = 0;
+static TickType_t charger_hold_ticks = 0;
+static TickType_t input_low_start = 0;
+static uint8_t input_low = 0;
+struct UVP_Recovery uvp_recovery;
 
 /* The maximum time to wait for the mutex that guards the UART to become
  available. */
@@ -47,13 +95,27 @@ void I2C_Write_Two_Byte_Register(uint8_t addr_to_write, uint8_t lsb_data, uint8_
 void I2C_Read_Register(uint8_t addr_to_read, uint8_t *pData, uint16_t size);
 uint8_t Query_Regulator_Connection(void);
 uint8_t Read_Charge_Okay(void);
+void Regulator_Check_Input(void);
+void Regulator_Apply_Backoff(void);
 void Read_Charge_Status(void);
+void Read_Prochot_Status(void);
 void Regulator_Set_ADC_Option(void);
+void Regulator_Start_ADC(void);
 void Regulator_Read_ADC(void);
+void Regulator_Hold_Off(uint32_t hold_ms);
 void Regulator_HI_Z(uint8_t hi_z_en);
 void Regulator_OTG_EN(uint8_t otg_en);
 void Regulator_Set_Charge_Option_0(void);
 void Set_Charge_Voltage(uint8_t number_of_cells);
+void Set_Charge_Current(uint32_t charge_current_limit);
+void Set_Input_Current_Limit(uint32_t input_current_limit_ma);
+void Read_Input_Current_Limit_In_Use(void);
+uint32_t Input_Current_Loop_Update(uint32_t feedforward_ma);
+uint32_t Calculate_Power_mW(uint32_t voltage, uint32_t current);
+void Input_Current_Loop_Reset(void);
+void Source_Limit_Reset(void);
+uint8_t Source_Droop_Detected(void);
+uint32_t Source_Limit_Update(uint32_t requested_ma);
 
 /**
  * @brief Returns whether the regulator is connected over I2C
@@ -111,6 +173,54 @@ uint32_t Get_Max_Charge_Current() {
 	return regulator.max_charge_current_ma;
 }
 
+/**
+ * @brief Gets the input current limit the regulator is using (IIN_DPM)
+ * @retval Input current limit in miliamps
+ */
+uint32_t Get_Input_Current_Limit() {
+	return regulator.input_current_dpm_ma;
+}
+
+/**
+ * @brief Gets the charge current limit learned from source droops this session
+ * @retval Charge current limit in miliamps
+ */
+uint32_t Get_Source_Current_Limit() {
+	return source_limit.limit_ma;
+}
+
+/**
+ * @brief Gets the last ChargerStatus register value
+ * @retval ChargerStatus, MSB in the upper byte
+ */
+uint16_t Get_Charger_Status() {
+	return regulator.charger_status;
+}
+
+/**
+ * @brief Gets the ProchotStatus bits read on the last PROCHOT event
+ * @retval ProchotStatus LSB
+ */
+uint8_t Get_Prochot_Status() {
+	return regulator.prochot_status;
+}
+
+/**
+ * @brief Gets the number of PROCHOT and charger fault events handled since boot
+ * @retval Event count
+ */
+uint32_t Get_Charger_Fault_Events() {
+	return regulator.fault_events;
+}
+
+/**
+ * @brief Gets whether the charge power was cut back for temperature on the last control loop
+ * @retval uint8_t 1 if throttled, 0 if not
+ */
+uint8_t Get_Thermal_Throttle_State() {
+	return regulator.thermal_throttled;
+}
+
 /**
  * @brief Returns whether we are in the precharge state or not
  * @retval uint8_t 1 or 0
@@ -249,6 +359,8 @@ void Read_Charge_Status() {
 	uint8_t data[2];
 	I2C_Read_Register(CHARGE_STATUS_ADDR, data, 2);
 
+	regulator.charger_status = ((uint16_t)data[1] << 8) | data[0];
+
 	if (data[1] & CHARGING_ENABLED_MASK) {
 		regulator.charging_status = 1;
 	}
@@ -257,6 +369,84 @@ void Read_Charge_Status() {
 	}
 }
 
+/**
+ * @brief Reads ProchotStatus register. Reading clears the latched status bits.
+ */
+void Read_Prochot_Status() {
+	uint8_t data[2];
+	I2C_Read_Register(PROCHOT_STATUS_ADDR, data, 2);
+
+	regulator.prochot_status = data[0];
+}
+
+/**
+ * @brief Checks CHRG_OK. A drop is a source droop first, it backs the charge current off through the source limit
+ * and leaves the charge gate open so the search can find what the source sustains. It only becomes
+ * VOLTAGE_INPUT_ERROR once CHRG_OK has stayed low for SOURCE_INPUT_DEBOUNCE_MS or the PD contract has gone.
+ */
+void Regulator_Check_Input(void) {
+	if (Read_Charge_Okay() == 1) {
+		input_low = 0;
+		Clear_Error_State(VOLTAGE_INPUT_ERROR);
+		return;
+	}
+
+	//Regulator registers may have reset with VBUS, force IIN_HOST to be rewritten
+	regulator.input_current_limit = UINT8_MAX;
+
+	if (input_low == 0) {
+		input_low = 1;
+		input_low_start = xTaskGetTickCount();
+		charger_backoff_pending = 1;
+	}
+
+	if ((Get_Input_Power_Ready() != READY) || ((xTaskGetTickCount() - input_low_start) >= pdMS_TO_TICKS(SOURCE_INPUT_DEBOUNCE_MS))) {
+		Set_Error_State(VOLTAGE_INPUT_ERROR);
+	}
+}
+
+/**
+ * @brief Acts on CHRG_OK and PROCHOT edges. Backs the charge current off straight away, then reads why the charger complained.
+ * @param events REGULATOR_EVENT_ bits set by the EXTI callbacks
+ */
+void Handle_Charger_Events(uint32_t events) {
+
+	//The edge alone is reason to back off, so the charge current is written ahead of the status reads
+	if (events & (REGULATOR_EVENT_CHRG_OK_FALL | REGULATOR_EVENT_PROCHOT)) {
+		charger_backoff_pending = 1;
+		Regulator_Apply_Backoff();
+	}
+
+	if (events & REGULATOR_EVENT_PROCHOT) {
+		Read_Prochot_Status();
+	}
+
+	Read_Charge_Status();
+
+	if ((events & REGULATOR_EVENT_PROCHOT) || (regulator.charger_status & CHARGER_FAULT_MASK)) {
+		regulator.fault_events++;
+	}
+
+	if (regulator.charger_status & CHARGER_FAULT_MASK) {
+		charger_backoff_pending = 1;
+	}
+
+	Regulator_Check_Input();
+
+	Regulator_Apply_Backoff();
+}
+
+/**
+ * @brief Writes a pending backoff to the charger now rather than on the next pass of the control loop
+ */
+void Regulator_Apply_Backoff(void) {
+#if SOURCE_DROOP_DETECTION
+	if ((charger_backoff_pending == 1) && (source_limit.applied_ma != 0)) {
+		Set_Charge_Current(Source_Limit_Update(source_limit.applied_ma));
+	}
+#endif
+}
+
 /**
  * @brief Sets the Regulators ADC settings
  */
@@ -268,19 +458,26 @@ void Regulator_Set_ADC_Option() {
 }
 
 /**
- * @brief Initiates and reads a single ADC conversion on the regulator
+ * @brief Starts a single ADC conversion on the regulator
  */
-void Regulator_Read_ADC() {
-	TickType_t xDelay = 80 / portTICK_PERIOD_MS;
-
+void Regulator_Start_ADC() {
 	uint8_t ADC_msb_3B = ADC_START_CONVERSION_MASK;
 
 	I2C_Write_Register((ADC_OPTION_ADDR+1), (uint8_t *) &ADC_msb_3B);
+}
+
+/**
+ * @brief Reads the ADC conversion started by the last call and starts the next. The conversion is long
+ * finished by the next sense stage, so the readings are one step old instead of being waited on.
+ */
+void Regulator_Read_ADC() {
+	uint8_t ADC_msb_3B = 0;
+
+	I2C_Read_Register((ADC_OPTION_ADDR+1), (uint8_t *) &ADC_msb_3B, 1);
 
-	/* Wait for the conversion to finish */
-	while (ADC_msb_3B & (1<<6)) {
-		vTaskDelay(xDelay);
-		I2C_Read_Register((ADC_OPTION_ADDR+1), (uint8_t *) &ADC_msb_3B, 1);
+	/* Keep the last readings if the conversion has not finished */
+	if (ADC_msb_3B & (1<<6)) {
+		return;
 	}
 
 	uint8_t temp = 0;
@@ -299,6 +496,8 @@ void Regulator_Read_ADC() {
 
 	I2C_Read_Register(VBUS_ADC_ADDR, (uint8_t *) &temp, 1);
 	regulator.vbus_voltage = (temp * VBUS_ADC_SCALE) + VBUS_ADC_OFFSET;
+
+	Regulator_Start_ADC();
 }
 
 /**
@@ -308,11 +507,9 @@ void Regulator_Read_ADC() {
 void Regulator_HI_Z(uint8_t hi_z_en) {
 	if (hi_z_en == 1) {
 		HAL_GPIO_WritePin(ILIM_HIZ_GPIO_Port, ILIM_HIZ_Pin, GPIO_PIN_RESET);
-		HAL_GPIO_WritePin(GPIOA, FAN_ENn_Pin, GPIO_PIN_SET); // Evil hack to turn the fan off along with the regulator
 	}
 	else {
 		HAL_GPIO_WritePin(ILIM_HIZ_GPIO_Port, ILIM_HIZ_Pin, GPIO_PIN_SET);
-		HAL_GPIO_WritePin(GPIOA, FAN_ENn_Pin, GPIO_PIN_RESET); // Evil hack to turn the fan on along with the regulator
 	}
 }
 
@@ -350,8 +547,8 @@ void Set_Charge_Current(uint32_t charge_current_limit) {
 
 	uint32_t charge_current = 0;
 
-	if (charge_current_limit > MAX_CHARGE_CURRENT_MA) {
-		charge_current_limit = MAX_CHARGE_CURRENT_MA;
+	if (charge_current_limit > params.max_charge_current_ma) {
+		charge_current_limit = params.max_charge_current_ma;
 	}
 
 	regulator.max_charge_current_ma = charge_current_limit;
@@ -378,6 +575,186 @@ void Set_Charge_Current(uint32_t charge_current_limit) {
 	return;
 }
 
+/**
+ * @brief Sets the host input current limit (IIN_HOST). From 0mA to 6.35A in 50mA steps. 7 bit value.
+ * @param input_current_limit_ma Input current limit in mA
+ */
+void Set_Input_Current_Limit(uint32_t input_current_limit_ma) {
+
+	uint32_t input_current = input_current_limit_ma / INPUT_CURRENT_STEP_MA;
+
+	if (input_current > INPUT_CURRENT_REG_MAX) {
+		input_current = INPUT_CURRENT_REG_MAX;
+	}
+
+	//Only write the register when the limit changes
+	if (input_current == regulator.input_current_limit) {
+		return;
+	}
+
+	regulator.input_current_limit = (uint8_t)input_current;
+
+	I2C_Write_Two_Byte_Register(INPUT_CURRENT_HOST_ADDR, 0, (uint8_t)input_current);
+
+	return;
+}
+
+/**
+ * @brief Reads the input current limit in use by the regulator (IIN_DPM). Can be lower than IIN_HOST after ICO or VINDPM.
+ */
+void Read_Input_Current_Limit_In_Use() {
+	uint8_t data[2];
+	I2C_Read_Register(INPUT_CURRENT_DPM_ADDR, data, 2);
+
+	regulator.input_current_dpm_ma = (data[1] & INPUT_CURRENT_REG_MAX) * INPUT_CURRENT_STEP_MA;
+}
+
+/**
+ * @brief Clears the input current loop state. Called whenever charging is stopped.
+ */
+void Input_Current_Loop_Reset() {
+	input_current_loop.integral_ma = 0;
+	input_current_loop.trim_ma = 0;
+	input_current_loop.last_tick = xTaskGetTickCount() - pdMS_TO_TICKS(INPUT_CURRENT_LOOP_PERIOD_MS);
+}
+
+/**
+ * @brief PI loop that trims the charge current so the measured input current sits at INPUT_CURRENT_TARGET_PERCENT of the contract
+ * @param feedforward_ma Open loop charge current estimate in mA from Calculate_Max_Charge_Power
+ * @retval Charge current in mA
+ */
+uint32_t Input_Current_Loop_Update(uint32_t feedforward_ma) {
+
+	uint32_t target_ma = (Get_Max_Input_Current() * INPUT_CURRENT_TARGET_PERCENT) / 100;
+
+	//The regulator may have lowered its own limit, never regulate above it
+	if ((regulator.input_current_dpm_ma != 0) && (target_ma > regulator.input_current_dpm_ma)) {
+		target_ma = regulator.input_current_dpm_ma;
+	}
+
+	uint32_t input_current_ma = regulator.input_current / (REG_ADC_MULTIPLIER / 1000);
+	uint32_t vbat_mv = regulator.vbat_voltage / (REG_ADC_MULTIPLIER / 1000);
+	uint32_t vbus_mv = regulator.vbus_voltage / (REG_ADC_MULTIPLIER / 1000);
+
+	if (vbat_mv == 0) {
+		return feedforward_ma;
+	}
+
+	//Refer the input current error to the output side of the regulator
+	int32_t error_ma = (((int32_t)target_ma - (int32_t)input_current_ma) * (int32_t)vbus_mv) / (int32_t)vbat_mv;
+
+	//The trim may remove all of the feedforward or recover the assume_efficiency margin, nothing more.
+	//Since the feedforward already carries the thermal derate, so does the upper bound.
+	int32_t trim_max_ma = (int32_t)(feedforward_ma / params.assume_efficiency) - (int32_t)feedforward_ma;
+	int32_t trim_min_ma = -(int32_t)feedforward_ma;
+
+	//Integrate over the time since the last update, an extra update from an event frame adds only its share
+	TickType_t now = xTaskGetTickCount();
+	int32_t elapsed_ms = (int32_t)((now - input_current_loop.last_tick) * portTICK_PERIOD_MS);
+	input_current_loop.last_tick = now;
+	if (elapsed_ms > INPUT_CURRENT_LOOP_PERIOD_MS) {
+		elapsed_ms = INPUT_CURRENT_LOOP_PERIOD_MS;
+	}
+
+	int32_t integral_ma = input_current_loop.integral_ma + ((error_ma * INPUT_CURRENT_LOOP_KI_PERCENT * elapsed_ms) / (100 * INPUT_CURRENT_LOOP_PERIOD_MS));
+
+	if (integral_ma > trim_max_ma) {
+		integral_ma = trim_max_ma;
+	}
+	if (integral_ma < trim_min_ma) {
+		integral_ma = trim_min_ma;
+	}
+	input_current_loop.integral_ma = integral_ma;
+
+	int32_t trim_ma = ((error_ma * INPUT_CURRENT_LOOP_KP_PERCENT) / 100) + integral_ma;
+
+	if (trim_ma > trim_max_ma) {
+		trim_ma = trim_max_ma;
+	}
+	if (trim_ma < trim_min_ma) {
+		trim_ma = trim_min_ma;
+	}
+	input_current_loop.trim_ma = trim_ma;
+
+	return (uint32_t)((int32_t)feedforward_ma + trim_ma);
+}
+
+/**
+ * @brief Forgets the learned source limit. Called when the PD contract goes away.
+ */
+void Source_Limit_Reset() {
+	source_limit.limit_ma = params.max_charge_current_ma;
+	source_limit.known_good_ma = 0;
+	source_limit.known_bad_ma = 0;
+	source_limit.applied_ma = 0;
+	source_limit.stable_start = xTaskGetTickCount();
+	source_limit.settled = 0;
+	charger_backoff_pending = 0;
+}
+
+/**
+ * @brief Checks for a CHRG_OK falling edge, PROCHOT or charger fault since the last call or VBUS sagging below the contract voltage
+ * @retval uint8_t 1 if the source drooped, 0 if not
+ */
+uint8_t Source_Droop_Detected() {
+	uint8_t droop = charger_backoff_pending;
+	charger_backoff_pending = 0;
+
+	uint32_t vbus_mv = regulator.vbus_voltage / (REG_ADC_MULTIPLIER / 1000);
+
+	if ((Get_Input_Voltage() > SOURCE_DROOP_THRESH_MV) && (vbus_mv < (Get_Input_Voltage() - SOURCE_DROOP_THRESH_MV))) {
+		droop = 1;
+	}
+
+	return droop;
+}
+
+/**
+ * @brief Steps the charge current down on a droop and binary searches back up between the last good and bad currents
+ * @param requested_ma Charge current in mA the rest of the control loop is asking for
+ * @retval Charge current in mA limited to what the source can sustain
+ */
+uint32_t Source_Limit_Update(uint32_t requested_ma) {
+
+	if (Source_Droop_Detected() && (source_limit.applied_ma != 0)) {
+		//The current that was set when the source drooped is too much
+		source_limit.known_bad_ma = source_limit.applied_ma;
+		source_limit.stable_start = xTaskGetTickCount();
+		source_limit.settled = 0;
+
+		if ((source_limit.known_good_ma != 0) && (source_limit.known_good_ma < source_limit.known_bad_ma)) {
+			source_limit.limit_ma = source_limit.known_good_ma;
+		}
+		else {
+			//Source got weaker than the last good value, start the search over from below
+			source_limit.known_good_ma = 0;
+			source_limit.limit_ma = (source_limit.known_bad_ma * SOURCE_DROOP_BACKOFF_PERCENT) / 100;
+		}
+	}
+	else if ((source_limit.settled == 0) && (source_limit.known_bad_ma != 0) && (requested_ma > source_limit.limit_ma)) {
+		//Timed rather than counted, so the extra frames of charger pin events do not hurry the probe
+		if ((xTaskGetTickCount() - source_limit.stable_start) >= pdMS_TO_TICKS(SOURCE_DROOP_STABLE_MS)) {
+			source_limit.stable_start = xTaskGetTickCount();
+			source_limit.known_good_ma = source_limit.limit_ma;
+
+			if ((source_limit.known_bad_ma - source_limit.known_good_ma) <= SOURCE_DROOP_RESOLUTION_MA) {
+				source_limit.settled = 1;
+			}
+			else {
+				source_limit.limit_ma = (source_limit.known_good_ma + source_limit.known_bad_ma) / 2;
+			}
+		}
+	}
+
+	if (requested_ma > source_limit.limit_ma) {
+		requested_ma = source_limit.limit_ma;
+	}
+
+	source_limit.applied_ma = requested_ma;
+
+	return requested_ma;
+}
+
 /**
  * @brief Sets the charging voltage based on the number of cells. 1 - 4.192V, 2 - 8.400V, 3 - 12.592V, 4 - 16.800V
  * @param number_of_cells number of cells connected
@@ -390,13 +767,15 @@ void Set_Charge_Voltage(uint8_t number_of_cells) {
 	uint8_t	minimum_system_voltage_value = MIN_VOLT_ADD_1024_MV;
 
 #if FIXED_VOLTAGE_CHARGING
-	uint16_t target_charge_voltage = FIXED_VOLTAGE_SETPOINT;
-	uint16_t fastcharge_threshold = FIXED_VOLTAGE_PRECHARGE;
-
-
-	max_charge_register_1_value = (target_charge_voltage & 0xFF00) >> 8;
-  max_charge_register_2_value = (target_charge_voltage & 0x00FF);
-  minimum_system_voltage_value = (fastcharge_threshold & 0xFF00) >> 8;
+	//The cell count comes from the balance lead, or from num_series with balancing off, never a fixed 4S
+	if ((number_of_cells > 0) && (number_of_cells < 5)) {
+		uint16_t target_charge_voltage = FIXED_VOLTAGE_CELL_SETPOINT * number_of_cells;
+		uint16_t fastcharge_threshold = FIXED_VOLTAGE_CELL_PRECHARGE * number_of_cells;
+
+		max_charge_register_1_value = (target_charge_voltage & 0xFF00) >> 8;
+		max_charge_register_2_value = (target_charge_voltage & 0x00FF);
+		minimum_system_voltage_value = (fastcharge_threshold & 0xFF00) >> 8;
+	}
 
 #else
 	if ((number_of_cells > 0) || (number_of_cells < 5)) {
@@ -438,24 +817,44 @@ void Set_Charge_Voltage(uint8_t number_of_cells) {
 }
 
 /**
- * @brief Calculates the max charge power based on temperature of MCU
+ * @brief Multiplies two regulator ADC readings into power
+ * @param voltage Voltage in volts * REG_ADC_MULTIPLIER
+ * @param current Current in amps * REG_ADC_MULTIPLIER
+ * @retval Power in mW
+ */
+uint32_t Calculate_Power_mW(uint32_t voltage, uint32_t current) {
+	return ((voltage / (REG_ADC_MULTIPLIER / 1000)) * (current / (REG_ADC_MULTIPLIER / 1000))) / 1000;
+}
+
+/**
+ * @brief Calculates the max charge power based on the PD contract and the thermal limit
  * @retval Max charging power in mW
  */
 uint32_t Calculate_Max_Charge_Power() {
 
-	//Account for system losses with ASSUME_EFFICIENCY fudge factor to not overload source
-	uint32_t charging_power_mw = (((float)(regulator.vbus_voltage/REG_ADC_MULTIPLIER) * Get_Max_Input_Current()) * ASSUME_EFFICIENCY);
+	//Account for system losses with assume_efficiency fudge factor to not overload source
+	uint32_t charging_power_mw = (((float)(regulator.vbus_voltage/REG_ADC_MULTIPLIER) * Get_Max_Input_Current()) * params.assume_efficiency);
 
-	if (charging_power_mw > MAX_CHARGING_POWER) {
-		charging_power_mw = MAX_CHARGING_POWER;
+	if (charging_power_mw > params.max_charging_power_mw) {
+		charging_power_mw = params.max_charging_power_mw;
 	}
 
 	if (charging_power_mw > Get_Max_Input_Power()){
-		charging_power_mw = Get_Max_Input_Power() * ASSUME_EFFICIENCY;
+		charging_power_mw = Get_Max_Input_Power() * params.assume_efficiency;
 	}
 
+	regulator.thermal_throttled = 0;
+
+#if THERMAL_MODEL_THROTTLING
+	//Limit charging power so the predicted steady state temperature stays under the target
+	if (charging_power_mw > Get_Thermal_Power_Limit()) {
+		charging_power_mw = Get_Thermal_Power_Limit();
+		regulator.thermal_throttled = 1;
+	}
+#else
 	//Throttle charging power if temperature is too high
-	if (Get_MCU_Temperature() > TEMP_THROTTLE_THRESH_C){
+	if (Get_MCU_Temperature() > params.temp_throttle_thresh_c){
+		regulator.thermal_throttled = 1;
 		float temperature = (float)Get_MCU_Temperature();
 
 		float power_scalar = 1.0f - ((float)(0.0333 * temperature) - 1.66f);
@@ -469,6 +868,7 @@ uint32_t Calculate_Max_Charge_Power() {
 
 		charging_power_mw = charging_power_mw * power_scalar;
 	}
+#endif
 
 	return charging_power_mw;
 }
@@ -479,29 +879,48 @@ uint32_t Calculate_Max_Charge_Power() {
  */
 void Control_Charger_Output() {
 
-	TickType_t xDelay = 500 / portTICK_PERIOD_MS;
+	static TickType_t termination_start = 0; // When the charge current fell under the termination current
+	static uint8_t terminating = 0;
 
-	static uint16_t termination_counter = 0; // Variable to keep track of termination samples
 
-
-#if ENABLE_BALANCING
-	uint8_t  balance_connection_state = Get_Balance_Connection_State();
-#else
 	uint8_t  balance_connection_state = CONNECTED;
-#endif
+	if (params.enable_balancing) {
+		balance_connection_state = Get_Balance_Connection_State();
+	}
 
 	//Charging for USB PD enabled supplies
 	if ((Get_XT60_Connection_State() == CONNECTED) && (balance_connection_state == CONNECTED) && (Get_Error_State() == 0) && (Get_Input_Power_Ready() == READY) && (Get_Cell_Over_Voltage_State() == 0)) {
 
-#if ENABLE_BALANCING
-		Set_Charge_Voltage(Get_Number_Of_Cells());
-#else
-		Set_Charge_Voltage(NUM_SERIES);
-#endif
+		if (params.enable_balancing) {
+			Set_Charge_Voltage(Get_Number_Of_Cells());
+		}
+		else {
+			Set_Charge_Voltage(params.num_series);
+		}
 
 
 		uint32_t charging_current_ma = ((Calculate_Max_Charge_Power()) / (float)(Get_Battery_Voltage() / BATTERY_ADC_MULTIPLIER));
 
+		//Hard ceiling at the contract current, the regulator enforces this on its own
+		Set_Input_Current_Limit(Get_Max_Input_Current());
+
+#if INPUT_CURRENT_CLOSED_LOOP
+		Read_Input_Current_Limit_In_Use();
+		charging_current_ma = Input_Current_Loop_Update(charging_current_ma);
+#endif
+
+#if SOURCE_DROOP_DETECTION
+		charging_current_ma = Source_Limit_Update(charging_current_ma);
+#endif
+
+#if THERMAL_MODEL_THROTTLING
+		//The input current loop may trim above the feedforward, never above the thermal limit
+		uint32_t thermal_limit_ma = Get_Thermal_Power_Limit() / (float)(Get_Battery_Voltage() / BATTERY_ADC_MULTIPLIER);
+		if (charging_current_ma > thermal_limit_ma) {
+			charging_current_ma = thermal_limit_ma;
+		}
+#endif
+
 		Set_Charge_Current(charging_current_ma);
 
 		Regulator_HI_Z(0);
@@ -509,20 +928,23 @@ void Control_Charger_Output() {
 		//Check if XT60 was disconnected
 		if (regulator.vbat_voltage > (BATTERY_DISCONNECT_THRESH * Get_Number_Of_Cells())) {
 			Regulator_HI_Z(1);
-			vTaskDelay(xDelay*2);
-			Regulator_HI_Z(0);
+			Regulator_Hold_Off(1000);
+			return;
 		}
 
 		float charge_current_meas_ma = ((float)Get_Charge_Current_ADC_Reading()/REG_ADC_MULTIPLIER)*1000;
 
-		if ((Get_Requires_Charging_State() == 0) && (charge_current_meas_ma < CHARGE_TERM_CURRENT_MA)){
-		  termination_counter++;
-		  if(termination_counter > 3){
+		if ((Get_Requires_Charging_State() == 0) && (charge_current_meas_ma < params.charge_term_current_ma)){
+		  if (terminating == 0) {
+		    terminating = 1;
+		    termination_start = xTaskGetTickCount();
+		  }
+		  if ((xTaskGetTickCount() - termination_start) >= pdMS_TO_TICKS(CHARGE_TERM_DEBOUNCE_MS)) {
 		    Regulator_HI_Z(1);
-		    vTaskDelay(xDelay);
+		    Regulator_Hold_Off(500);
 		  }
 		}else{
-		  termination_counter = 0;
+		  terminating = 0;
 		}
 	}
 	// Case to handle non USB PD supplies. Limited to 5V 500mA.
@@ -545,19 +967,19 @@ void Control_Charger_Output() {
 		Regulator_HI_Z(1);
 		Set_Charge_Voltage(0);
 		Set_Charge_Current(0);
+		Input_Current_Loop_Reset();
+
+		//A new contract starts a new session
+		if (Get_Input_Power_Ready() != READY) {
+			Source_Limit_Reset();
+		}
 	}
 }
 
 /**
- * @brief Main regulator task
+ * @brief Puts the regulator into a safe state and sets it up. Called once by the control executive before its first frame.
  */
-void vRegulator(void const *pvParameters) {
-
-	TickType_t xDelay = 250 / portTICK_PERIOD_MS;
-
-	/* Precharge timeout at bootup for 3s * precharge_timeout */
-	static uint16_t precharge_timeout = 300; //Up to 3*300 second UVP recovery precharge
-	static uint8_t initial_precharge_wakeup = 1; //Apply a longer wakeup pulse to see if that's able to wake up the BQ
+void Regulator_Init(void) {
 
 	/* Disable the output of the regulator for safety */
 	Regulator_HI_Z(1);
@@ -565,6 +987,13 @@ void vRegulator(void const *pvParameters) {
 	/* Disable OTG mode */
 	Regulator_OTG_EN(0);
 
+	/* IIN_HOST has not been written yet */
+	regulator.input_current_limit = UINT8_MAX;
+
+	Source_Limit_Reset();
+
+	Session_Log_Init();
+
 	/* Check if the regulator is connected */
 	regulator.connected = Query_Regulator_Connection();
 
@@ -574,90 +1003,131 @@ void vRegulator(void const *pvParameters) {
 	/* Setup the ADC on the Regulator */
 	Regulator_Set_ADC_Option();
 
-	vTaskDelay(xDelay); //This was just added to test if init can be made smoother
+	/* The first sense stage reads this conversion */
+	Regulator_Start_ADC();
 
-	for (;;) {
+	/* Boot time UVP recovery starts with a longer wakeup pulse to see if that's able to wake up the BQ */
+	uvp_recovery.state = UVP_RECOVERY_CHECK;
+	uvp_recovery.attempts = UVP_RECOVERY_ATTEMPTS;
+	uvp_recovery.first_pulse = 1;
+}
 
-		//Check if power into regulator is okay
-		if (Read_Charge_Okay() != 1) {
-			Set_Error_State(VOLTAGE_INPUT_ERROR);
-		}
-		else if ((Get_Error_State() & VOLTAGE_INPUT_ERROR) == VOLTAGE_INPUT_ERROR) {
-			Clear_Error_State(VOLTAGE_INPUT_ERROR);
-		}
+/**
+ * @brief Keeps the output in HI_Z for a while, in place of Control_Charger_Output waiting with the output off
+ * @param hold_ms Time before the actuate stage drives the output again
+ */
+void Regulator_Hold_Off(uint32_t hold_ms) {
+	charger_hold_start = xTaskGetTickCount();
+	charger_hold_ticks = pdMS_TO_TICKS(hold_ms);
+}
 
-		//Check if STM32G0 can communicate with regulator
-		if ((Get_Error_State() & REGULATOR_COMMUNICATION_ERROR) == REGULATOR_COMMUNICATION_ERROR) {
-			regulator.connected = 0;
-		}
+/**
+ * @brief Sense stage. Reads the charger status and ADC.
+ */
+void Regulator_Sense(void) {
 
-    Read_Charge_Status();
+	//Check if power into regulator is okay
+	Regulator_Check_Input();
 
-    Regulator_Read_ADC();
+	//Check if STM32G0 can communicate with regulator
+	if ((Get_Error_State() & REGULATOR_COMMUNICATION_ERROR) == REGULATOR_COMMUNICATION_ERROR) {
+		regulator.connected = 0;
+	}
 
-#if ATTEMPT_UVP_RECOVERY
-		/* Loop through here upon bootup to try recovering a UVP pack */
-		float regulator_vbat_voltage = ((float)Get_VBAT_ADC_Reading()/REG_ADC_MULTIPLIER);
-
-		// Precharge until we exceed 12.4V or we hit the timeout. Leave at least one in precharge_timeout as a flag to disable the regulator after this loop
-		while((precharge_timeout>1) && (regulator_vbat_voltage < (NUM_SERIES * 3.1))){
-		  precharging_state = 1;
-
-      uint8_t ticks = 0;
-      if(initial_precharge_wakeup){
-        initial_precharge_wakeup = 0;
-        ticks = 20;
-      }else{
-        ticks = 12;
-      }
-
-      while(ticks){
-        Set_Charge_Voltage(NUM_SERIES);
-        Set_Charge_Current(UVP_RECOVERY_CURRENT_MA);
-        Regulator_HI_Z(0);
-        Read_Charge_Status();
-        Regulator_Read_ADC();
-
-        vTaskDelay(xDelay);
-        ticks--;
-      }
-
-      //Regulator_Read_ADC(); //TBD
-      //Read_Charge_Status(); // TBD
-
-		  regulator_vbat_voltage = ((float)Get_VBAT_ADC_Reading()/REG_ADC_MULTIPLIER);
-		  precharge_timeout = precharge_timeout - 1;
-		}
+	Read_Charge_Status();
 
-		if(precharge_timeout){
-		  precharging_state = 0;
-		  precharge_timeout = 0;
-      Regulator_HI_Z(1);
+	Regulator_Read_ADC();
+}
 
-      uint8_t ticks = 4;
+/**
+ * @brief Estimate stage. Steps the thermal model on the power just read and the self calibration.
+ */
+void Regulator_Estimate(void) {
+	Thermal_Model_Update(Calculate_Power_mW(regulator.vbus_voltage, regulator.input_current), Calculate_Power_mW(regulator.vbat_voltage, regulator.charge_current));
 
-      while(ticks){
-        vTaskDelay(xDelay);
-        Read_Charge_Status();
-        Regulator_Read_ADC();
-        ticks--;
-      }
-      //Read_Charge_Status(); // TBD
-      //Regulator_Read_ADC(); // TBD
+	Self_Cal_Update();
+}
 
+/**
+ * @brief Decide stage. Steps the boot time UVP recovery, which owns the output until it is done.
+ * A pack below 3.1V per cell gets UVP_RECOVERY_PULSE_STEPS of precharge current, then is checked again,
+ * until it is above that or the attempts run out. The output is then held off for UVP_RECOVERY_SETTLE_STEPS.
+ */
+void Regulator_Decide(void) {
+#if ATTEMPT_UVP_RECOVERY
+	float regulator_vbat_voltage;
+
+	switch (uvp_recovery.state) {
+	case UVP_RECOVERY_PULSE:
+		if (uvp_recovery.steps > 0) {
+			uvp_recovery.steps--;
+			break;
 		}
+		uvp_recovery.attempts--;
+		/* Pulse finished, check the pack in this frame */
+		/* no break */
+	case UVP_RECOVERY_CHECK:
+		regulator_vbat_voltage = ((float)Get_VBAT_ADC_Reading()/REG_ADC_MULTIPLIER);
+
+		// Precharge until we exceed 3.1V per cell or we hit the timeout
+		if ((uvp_recovery.attempts > 0) && (regulator_vbat_voltage < (params.num_series * 3.1))) {
+			precharging_state = 1;
+			uvp_recovery.state = UVP_RECOVERY_PULSE;
+			uvp_recovery.steps = (uvp_recovery.first_pulse == 1) ? (UVP_RECOVERY_FIRST_PULSE_STEPS - 1) : (UVP_RECOVERY_PULSE_STEPS - 1);
+			uvp_recovery.first_pulse = 0;
+		}
+		else {
+			precharging_state = 0;
+			uvp_recovery.state = UVP_RECOVERY_SETTLE;
+			uvp_recovery.steps = UVP_RECOVERY_SETTLE_STEPS - 1;
+		}
+		break;
+	case UVP_RECOVERY_SETTLE:
+		if (uvp_recovery.steps > 0) {
+			uvp_recovery.steps--;
+		}
+		else {
+			uvp_recovery.state = UVP_RECOVERY_DONE;
+		}
+		break;
+	default:
+		break;
+	}
 #endif
 
 #if CONTINUOUS_UVP_RECOVERY
-		uint16_t zero_volt_tracker = 0;
-		if (regulator_vbat_voltage < (NUM_SERIES * 3.1)){
-		  zero_volt_tracker++;
-		}
+	uint16_t zero_volt_tracker = 0;
+	if (((float)Get_VBAT_ADC_Reading()/REG_ADC_MULTIPLIER) < (params.num_series * 3.1)){
+	  zero_volt_tracker++;
+	}
 #endif
+}
+
+/**
+ * @brief Actuate stage. Drives the fan and the charger output.
+ */
+void Regulator_Actuate(void) {
 
+	Fan_Control_Update();
+
+#if ATTEMPT_UVP_RECOVERY
+	if (uvp_recovery.state == UVP_RECOVERY_PULSE) {
+		Set_Charge_Voltage(params.num_series);
+		Set_Charge_Current(params.uvp_recovery_current_ma);
+		Regulator_HI_Z(0);
+		return;
+	}
+	else if (uvp_recovery.state == UVP_RECOVERY_SETTLE) {
+		Regulator_HI_Z(1);
+		return;
+	}
+#endif
 
+	if ((xTaskGetTickCount() - charger_hold_start) < charger_hold_ticks) {
+		return;
+	}
 
-#if ENABLE_BALANCING
+	if (params.enable_balancing) {
 		uint8_t timer_count = 0;
 
 		timer_count++;
@@ -670,10 +1140,29 @@ void vRegulator(void const *pvParameters) {
 		else {
 			Regulator_HI_Z(1);
 		}
-#else
+	}
+	else {
 		Control_Charger_Output();
-#endif
+	}
+}
 
-		vTaskDelay(xDelay);
+/**
+ * @brief CHRG_OK falling edge means the source drooped or went away. PROCHOT falling edge means the charger flagged a fault.
+ */
+void HAL_GPIO_EXTI_Falling_Callback(uint16_t GPIO_Pin) {
+	if (GPIO_Pin == CHRG_OK_Pin) {
+		Control_Notify_From_ISR(REGULATOR_EVENT_CHRG_OK_FALL);
+	}
+	else if (GPIO_Pin == PROTCHOT_Pin) {
+		Control_Notify_From_ISR(REGULATOR_EVENT_PROCHOT);
+	}
+}
+
+/**
+ * @brief CHRG_OK rising edge. The source is back, wake the control executive so charging resumes without waiting a frame.
+ */
+void HAL_GPIO_EXTI_Rising_Callback(uint16_t GPIO_Pin) {
+	if (GPIO_Pin == CHRG_OK_Pin) {
+		Control_Notify_From_ISR(REGULATOR_EVENT_CHRG_OK_RISE);
 	}
 }
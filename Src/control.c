@@ -0,0 +1,325 @@
+/**
+ ******************************************************************************
+ * @file           : control.c
+ * @brief          : Cooperative control executive for the ADC, regulator, USB PD contract and LEDs
+ ******************************************************************************
+ */
+
+#include "control.h"
+#include "main.h"
+#include "adc_interface.h"
+#include "battery.h"
+#include "bq25703a_regulator.h"
+#include "usbpd.h"
+#include "session_log.h"
+#include "low_power.h"
+#include "profile.h"
+#include "event_log.h"
+#include "led.h"
+#include "string.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct Control_Stage {
+	const char *name;
+	uint8_t stage; // CONTROL_STAGE_
+	uint16_t period_ms;
+	uint16_t deadline_ms;
+	uint8_t on_event; // Also run in the frame released by a charger pin event. Only stages whose timing is not counted in frames.
+	void (*run)(void);
+};
+
+struct Control_Stage_Record {
+	uint32_t runs;
+	uint32_t overruns;
+	uint32_t max_response_us;
+};
+
+struct Control {
+	uint32_t frame_count;
+	uint8_t new_reading;
+	volatile uint8_t event_pending; // An edge has been notified and not handled yet
+	volatile uint32_t event_cycles; // Profile cycles of the first edge not handled yet
+	struct Control_Stage_Record stages[CONTROL_STAGE_COUNT];
+	struct Control_Frame_Stats frame_stats;
+};
+
+/* Private function prototypes -----------------------------------------------*/
+void Control_Sense_ADC(void);
+void Control_Estimate_Pack(void);
+uint32_t Control_Run_Frame(TickType_t release_tick, uint32_t events);
+void Control_Handle_Events(uint32_t events);
+uint32_t Control_Poll_Events(void);
+
+/* Private variables ---------------------------------------------------------*/
+//Rate monotonic within each stage. Shorter periods come first, the deadlines grow down the table.
+static const struct Control_Stage control_stages[CONTROL_STAGE_COUNT] = {
+	{ "sense adc",			CONTROL_STAGE_SENSE,	125,	10,		0,	Control_Sense_ADC },
+	{ "sense charger",		CONTROL_STAGE_SENSE,	250,	25,		1,	Regulator_Sense },
+	{ "estimate pack",		CONTROL_STAGE_ESTIMATE,	125,	30,		0,	Control_Estimate_Pack },
+	{ "estimate charger",	CONTROL_STAGE_ESTIMATE,	250,	35,		1,	Regulator_Estimate },
+	{ "decide charger",		CONTROL_STAGE_DECIDE,	250,	40,		0,	Regulator_Decide },
+	{ "actuate charger",	CONTROL_STAGE_ACTUATE,	250,	60,		1,	Regulator_Actuate },
+	{ "actuate pd",			CONTROL_STAGE_ACTUATE,	500,	70,		0,	USBPD_User_Update },
+	{ "indicate leds",		CONTROL_STAGE_INDICATE,	250,	75,		0,	LED_Select },
+	{ "indicate log",		CONTROL_STAGE_INDICATE,	250,	CONTROL_FRAME_MS,	0,	Session_Log_Update },
+};
+
+struct Control control;
+
+/**
+ * @brief Control executive task. Starts each module, then releases a frame every CONTROL_FRAME_MS and runs the
+ * stages due in it to completion, in table order. A charger pin event is handled straight away, between two stages
+ * if a frame is running, then releases an extra frame.
+ */
+void vControl(void const *pvParameters) {
+	const TickType_t frame_ticks = pdMS_TO_TICKS(CONTROL_FRAME_MS);
+
+	for (uint8_t i = 0; i < CONTROL_STAGE_COUNT; i++) {
+		configASSERT((control_stages[i].period_ms % CONTROL_FRAME_MS) == 0);
+		configASSERT((i == 0) || (control_stages[i].stage >= control_stages[i - 1].stage));
+	}
+
+	/* Regulator first, it puts the charger output in HI_Z */
+	Regulator_Init();
+	LED_Init();
+	ADC_Start();
+	USBPD_User_Init();
+
+	TickType_t last_release = xTaskGetTickCount();
+	uint32_t handled_events = Control_Run_Frame(last_release, 0);
+
+	for (;;) {
+		TickType_t since = xTaskGetTickCount() - last_release;
+		uint32_t events = 0;
+
+		if (handled_events != 0) {
+			/* Events already handled in the last frame still get the frame of their own */
+			handled_events = Control_Run_Frame(xTaskGetTickCount(), handled_events);
+			continue;
+		}
+
+		if (since < frame_ticks) {
+			/* Wait for the next release or a charger pin event */
+			if (xTaskNotifyWait(0, UINT32_MAX, &events, frame_ticks - since) == pdTRUE) {
+				Control_Handle_Events(events);
+				handled_events = Control_Run_Frame(xTaskGetTickCount(), events);
+				continue;
+			}
+			last_release += frame_ticks;
+		}
+		else {
+			/* The last frame ran past this release. Run the latest release due, not every one missed back to back. */
+			TickType_t frames = since / frame_ticks;
+
+			control.frame_stats.late_frames++;
+			control.frame_stats.skipped_frames += frames - 1;
+			control.frame_count += frames - 1;
+			last_release += frames * frame_ticks;
+		}
+
+		handled_events = Control_Run_Frame(last_release, 0);
+	}
+}
+
+/**
+ * @brief Runs the stages due in one frame and checks each against its deadline. A charger pin event that arrives
+ * while the frame runs is handled before the next stage rather than waiting for the frame to finish.
+ * @param release_tick Tick the frame was due to start
+ * @param events REGULATOR_EVENT_ bits for a frame released by a charger pin event, already handled, 0 for a periodic frame
+ * @retval uint32_t REGULATOR_EVENT_ bits handled during the frame, which are owed a frame of their own
+ */
+uint32_t Control_Run_Frame(TickType_t release_tick, uint32_t events) {
+	uint32_t start_cycles = Profile_Get_Cycles();
+	uint32_t cycles_per_us = SystemCoreClock / 1000000;
+	uint32_t release_delay_us = (xTaskGetTickCount() - release_tick) * (1000000 / configTICK_RATE_HZ);
+	uint32_t latency_us = 0;
+	uint32_t handled_events = 0;
+
+	for (uint8_t i = 0; i < CONTROL_STAGE_COUNT; i++) {
+		const struct Control_Stage *stage = &control_stages[i];
+		struct Control_Stage_Record *record = &control.stages[i];
+		uint8_t due;
+
+		handled_events |= Control_Poll_Events();
+
+		if (events != 0) {
+			due = stage->on_event;
+		}
+		else {
+			due = ((control.frame_count % (stage->period_ms / CONTROL_FRAME_MS)) == 0) ? 1 : 0;
+		}
+
+		if (due == 0) {
+			continue;
+		}
+
+		stage->run();
+
+		uint32_t run_us = (Profile_Get_Cycles() - start_cycles) / cycles_per_us;
+		uint32_t response_us = release_delay_us + run_us;
+
+		if (stage->stage == CONTROL_STAGE_ACTUATE) {
+			latency_us = run_us;
+		}
+
+		taskENTER_CRITICAL();
+		record->runs++;
+		if (response_us > (stage->deadline_ms * 1000U)) {
+			record->overruns++;
+		}
+		uint8_t new_worst = (response_us > record->max_response_us) ? 1 : 0;
+		if (new_worst == 1) {
+			record->max_response_us = response_us;
+		}
+		taskEXIT_CRITICAL();
+
+		//Only a new worst case is logged, so a stage that keeps overrunning does not flood the log
+		if ((new_worst == 1) && (response_us > (stage->deadline_ms * 1000U))) {
+			EVENT_LOG("Control: stage %u missed its %ums deadline, %uus", i, stage->deadline_ms, response_us);
+		}
+	}
+
+	taskENTER_CRITICAL();
+	if (events != 0) {
+		control.frame_stats.event_frames++;
+	}
+	else {
+		control.frame_stats.frames++;
+		control.frame_count++;
+	}
+	if (latency_us > control.frame_stats.max_latency_us) {
+		control.frame_stats.max_latency_us = latency_us;
+	}
+	taskEXIT_CRITICAL();
+
+	return handled_events;
+}
+
+/**
+ * @brief Backs the charger off for charger pin events and records the time from the first edge to the backoff
+ * being written
+ * @param events REGULATOR_EVENT_ bits notified by the EXTI callbacks
+ */
+void Control_Handle_Events(uint32_t events) {
+	uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+	//Taken before handling, so an edge during the handling gets a time of its own
+	taskENTER_CRITICAL();
+	uint8_t timed = control.event_pending;
+	uint32_t event_cycles = control.event_cycles;
+	control.event_pending = 0;
+	taskEXIT_CRITICAL();
+
+	Handle_Charger_Events(events);
+
+	if (timed == 0) {
+		return;
+	}
+
+	uint32_t event_latency_us = (Profile_Get_Cycles() - event_cycles) / cycles_per_us;
+
+	taskENTER_CRITICAL();
+	if (event_latency_us > control.frame_stats.max_event_latency_us) {
+		control.frame_stats.max_event_latency_us = event_latency_us;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Handles any charger pin event notified since the last check, without waiting
+ * @retval uint32_t REGULATOR_EVENT_ bits handled, 0 if there were none
+ */
+uint32_t Control_Poll_Events(void) {
+	uint32_t events = 0;
+
+	if ((xTaskNotifyWait(0, UINT32_MAX, &events, 0) == pdTRUE) && (events != 0)) {
+		Control_Handle_Events(events);
+	}
+
+	return events;
+}
+
+/**
+ * @brief Sense stage for the ADC
+ */
+void Control_Sense_ADC(void) {
+	if (ADC_Update() == 1) {
+		control.new_reading = 1;
+	}
+}
+
+/**
+ * @brief Estimate stage for the pack. Works out the connection state from a new ADC reading, which also
+ * drives the balancing, then lets the tickless idle use STOP1 again.
+ */
+void Control_Estimate_Pack(void) {
+	if (control.new_reading == 0) {
+		return;
+	}
+	control.new_reading = 0;
+
+	/* Determines battery connection state and performs balancing */
+	Battery_Connection_State();
+
+	Low_Power_ADC_Sample_Done();
+}
+
+/**
+ * @brief Passes a charger pin event to the control executive
+ * @param events REGULATOR_EVENT_ bits to set
+ */
+void Control_Notify_From_ISR(uint32_t events) {
+	if (controlTaskHandle != NULL) {
+		BaseType_t should_context_switch = pdFALSE;
+
+		if (control.event_pending == 0) {
+			control.event_cycles = Profile_Get_Cycles();
+			control.event_pending = 1;
+		}
+
+		xTaskNotifyFromISR(controlTaskHandle, events, eSetBits, &should_context_switch);
+		portYIELD_FROM_ISR(should_context_switch);
+	}
+}
+
+/**
+ * @brief Clears the overrun counts and worst case times
+ */
+void Control_Reset_Stats(void) {
+	taskENTER_CRITICAL();
+	memset(control.stages, 0, sizeof(control.stages));
+	memset(&control.frame_stats, 0, sizeof(control.frame_stats));
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Gets the frame counts, the worst sense to actuate latency and the worst charger pin edge to backoff latency
+ */
+void Get_Control_Frame_Stats(struct Control_Frame_Stats *stats) {
+	taskENTER_CRITICAL();
+	memcpy(stats, &control.frame_stats, sizeof(struct Control_Frame_Stats));
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Gets the timing of one stage
+ * @param index 0 upwards, in the order the stages run
+ * @retval uint8_t 1 if stats was filled, 0 if index is past the end
+ */
+uint8_t Get_Control_Stage_Stats(uint8_t index, struct Control_Stage_Stats *stats) {
+	if (index >= CONTROL_STAGE_COUNT) {
+		return 0;
+	}
+
+	stats->name = control_stages[index].name;
+	stats->period_ms = control_stages[index].period_ms;
+	stats->deadline_ms = control_stages[index].deadline_ms;
+
+	taskENTER_CRITICAL();
+	stats->runs = control.stages[index].runs;
+	stats->overruns = control.stages[index].overruns;
+	stats->max_response_us = control.stages[index].max_response_us;
+	taskEXIT_CRITICAL();
+
+	return 1;
+}
@@ -0,0 +1,30 @@
+/**
+ ******************************************************************************
+ * @file           : crc.c
+ * @brief          : Checksums for telemetry frames and flash records
+ ******************************************************************************
+ */
+
+#include "crc.h"
+
+/**
+ * @brief CRC-16/CCITT-FALSE. Polynomial 0x1021, initial value 0xFFFF.
+ * @retval CRC of the data
+ */
+uint16_t CRC16_CCITT(const uint8_t *data, uint32_t length) {
+	uint16_t crc = 0xFFFF;
+
+	while (length--) {
+		crc ^= (uint16_t)(*data++) << 8;
+		for (uint8_t i = 0; i < 8; i++) {
+			if (crc & 0x8000) {
+				crc = (crc << 1) ^ 0x1021;
+			}
+			else {
+				crc = crc << 1;
+			}
+		}
+	}
+
+	return crc;
+}
@@ -6,21 +6,310 @@
  */
 
 #include "error.h"
+#include "event_log.h"
+#include "task.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct Error_Policy {
+	const char *name;
+	uint8_t policy; // ERROR_POLICY_
+	uint16_t retry_ms; // First back-off of a RETRY error
+	uint8_t max_retries; // Retries before a RETRY error latches, 0 never latches
+};
+
+struct Error_Record {
+	uint8_t raised;
+	uint8_t latched;
+	uint8_t retries;
+	uint8_t recently_cleared; // Cleared by its condition going away rather than by Error_Reset
+	uint32_t count;
+	uint32_t first_ms;
+	uint32_t last_ms;
+	uint32_t gone_ms; // When the condition went away, the back-off counts from here
+	uint32_t cleared_ms;
+	uint32_t backoff_ms;
+};
+
+struct Error_Manager {
+	struct Error_Record records[ERROR_COUNT];
+	struct Error_Event events[ERROR_EVENT_QUEUE_LENGTH];
+	uint8_t event_head;
+	uint8_t event_tail;
+	uint16_t event_sequence;
+};
+
+/* Private variables ---------------------------------------------------------*/
+//In the order of the error bits. A CHRG_OK drop is debounced by the regulator before it becomes an input
+//error, so the input error clears with its condition rather than holding the charge gate shut.
+static const struct Error_Policy error_policies[ERROR_COUNT] = {
+	{ "cell connection",	ERROR_POLICY_SELF_CLEAR,	0,		0 },
+	{ "cell voltage",		ERROR_POLICY_RETRY,			5000,	3 },
+	{ "xt60 voltage",		ERROR_POLICY_SELF_CLEAR,	0,		0 },
+	{ "mcu over temp",		ERROR_POLICY_SELF_CLEAR,	0,		0 },
+	{ "regulator comms",	ERROR_POLICY_SELF_CLEAR,	0,		0 },
+	{ "input voltage",		ERROR_POLICY_SELF_CLEAR,	0,		0 },
+};
 
 volatile uint32_t error_state;
+struct Error_Manager error_manager;
+
+/* Private function prototypes -----------------------------------------------*/
+uint8_t Error_Raise(uint8_t error, uint32_t now_ms);
+uint8_t Error_Drop(uint8_t error, uint32_t now_ms);
+void Error_Push_Event(uint8_t error, uint8_t type, uint32_t now_ms);
+void Error_Log_Event(uint8_t error, uint8_t type);
 
 /**
  * @brief Returns the error state
- * @retval uint32_t NO_ERROR if no error. Other errors are defined in battery.h
+ * @retval uint32_t NO_ERROR if no error. Other errors are defined in error.h
  */
 uint32_t Get_Error_State(void) {
 	return error_state;
 }
 
+/**
+ * @brief Sets errors whose condition is present. Safe to call on every pass, only the first set of an
+ * occurrence counts it and queues an event.
+ * @param error_bitmask Errors from error.h
+ */
 void Set_Error_State(uint32_t error_bitmask) {
-	error_state |= error_bitmask;
+	uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	uint8_t types[ERROR_COUNT];
+
+	taskENTER_CRITICAL();
+	for (uint8_t i = 0; i < ERROR_COUNT; i++) {
+		types[i] = (error_bitmask & (1UL << i)) ? Error_Raise(i, now_ms) : ERROR_EVENT_NONE;
+	}
+	taskEXIT_CRITICAL();
+
+	for (uint8_t i = 0; i < ERROR_COUNT; i++) {
+		Error_Log_Event(i, types[i]);
+	}
 }
 
+/**
+ * @brief Clears errors whose condition has gone, as their policy allows. A RETRY error clears on the first
+ * call after its back-off, so callers keep clearing on every pass while the condition stays away.
+ * @param error_bitmask Errors from error.h
+ */
 void Clear_Error_State(uint32_t error_bitmask) {
-	error_state &= ~error_bitmask;
+	uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	uint8_t types[ERROR_COUNT];
+
+	taskENTER_CRITICAL();
+	for (uint8_t i = 0; i < ERROR_COUNT; i++) {
+		types[i] = (error_bitmask & (1UL << i)) ? Error_Drop(i, now_ms) : ERROR_EVENT_NONE;
+	}
+	taskEXIT_CRITICAL();
+
+	for (uint8_t i = 0; i < ERROR_COUNT; i++) {
+		Error_Log_Event(i, types[i]);
+	}
+}
+
+/**
+ * @brief Releases latched errors and starts their retries over. An error whose condition has gone clears now,
+ * one still present stays set until it goes. The counts and times are kept.
+ * @param error_bitmask Errors from error.h
+ */
+void Error_Reset(uint32_t error_bitmask) {
+	uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	uint8_t types[ERROR_COUNT];
+
+	taskENTER_CRITICAL();
+	for (uint8_t i = 0; i < ERROR_COUNT; i++) {
+		struct Error_Record *record = &error_manager.records[i];
+		uint32_t bit = 1UL << i;
+
+		types[i] = ERROR_EVENT_NONE;
+		if ((error_bitmask & bit) == 0) {
+			continue;
+		}
+
+		record->retries = 0;
+		record->recently_cleared = 0;
+		record->backoff_ms = error_policies[i].retry_ms;
+
+		if ((record->latched == 1) || ((error_state & bit) && (record->raised == 0))) {
+			record->latched = 0;
+			if (record->raised == 0) {
+				error_state &= ~bit;
+				record->cleared_ms = now_ms;
+			}
+			Error_Push_Event(i, ERROR_EVENT_RESET, now_ms);
+			types[i] = ERROR_EVENT_RESET;
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	for (uint8_t i = 0; i < ERROR_COUNT; i++) {
+		Error_Log_Event(i, types[i]);
+	}
+}
+
+/**
+ * @brief Marks an error's condition present. Called in a critical section.
+ * @param error Bit number of the error
+ * @retval uint8_t ERROR_EVENT_ to log, ERROR_EVENT_NONE if it was already set
+ */
+uint8_t Error_Raise(uint8_t error, uint32_t now_ms) {
+	const struct Error_Policy *policy = &error_policies[error];
+	struct Error_Record *record = &error_manager.records[error];
+	uint32_t bit = 1UL << error;
+
+	record->last_ms = now_ms;
+
+	if (record->raised == 1) {
+		return ERROR_EVENT_NONE;
+	}
+	record->raised = 1;
+
+	/* Back before its back-off ran out, still the same occurrence */
+	if (error_state & bit) {
+		return ERROR_EVENT_NONE;
+	}
+
+	if ((record->recently_cleared == 1) && ((now_ms - record->cleared_ms) < ERROR_RETRY_WINDOW_MS)) {
+		if (record->retries < UINT8_MAX) {
+			record->retries++;
+		}
+	}
+	else {
+		record->retries = 0;
+	}
+
+	if (record->count == 0) {
+		record->first_ms = now_ms;
+	}
+	record->count++;
+	record->backoff_ms = (uint32_t)policy->retry_ms << ((record->retries < ERROR_MAX_BACKOFF_SHIFT) ? record->retries : ERROR_MAX_BACKOFF_SHIFT);
+
+	error_state |= bit;
+	Error_Push_Event(error, ERROR_EVENT_SET, now_ms);
+
+	if (policy->policy == ERROR_POLICY_LATCH) {
+		record->latched = 1;
+	}
+	else if ((policy->policy == ERROR_POLICY_RETRY) && (policy->max_retries != 0) && (record->retries >= policy->max_retries)) {
+		record->latched = 1;
+		Error_Push_Event(error, ERROR_EVENT_LATCH, now_ms);
+		return ERROR_EVENT_LATCH;
+	}
+
+	return ERROR_EVENT_SET;
+}
+
+/**
+ * @brief Marks an error's condition gone and clears the error if its policy allows. Called in a critical section.
+ * @param error Bit number of the error
+ * @retval uint8_t ERROR_EVENT_CLEAR if it cleared, otherwise ERROR_EVENT_NONE
+ */
+uint8_t Error_Drop(uint8_t error, uint32_t now_ms) {
+	struct Error_Record *record = &error_manager.records[error];
+	uint32_t bit = 1UL << error;
+
+	if (record->raised == 1) {
+		record->raised = 0;
+		record->gone_ms = now_ms;
+	}
+
+	if (((error_state & bit) == 0) || (record->latched == 1)) {
+		return ERROR_EVENT_NONE;
+	}
+
+	if ((error_policies[error].policy == ERROR_POLICY_RETRY) && ((now_ms - record->gone_ms) < record->backoff_ms)) {
+		return ERROR_EVENT_NONE;
+	}
+
+	error_state &= ~bit;
+	record->cleared_ms = now_ms;
+	record->recently_cleared = 1;
+	Error_Push_Event(error, ERROR_EVENT_CLEAR, now_ms);
+
+	return ERROR_EVENT_CLEAR;
+}
+
+/**
+ * @brief Queues an event for telemetry, dropping the oldest if the queue is full. Called in a critical section.
+ */
+void Error_Push_Event(uint8_t error, uint8_t type, uint32_t now_ms) {
+	struct Error_Event *event = &error_manager.events[error_manager.event_head & (ERROR_EVENT_QUEUE_LENGTH - 1)];
+
+	event->sequence = error_manager.event_sequence++;
+	event->type = type;
+	event->error = error;
+	event->time_ms = now_ms;
+
+	error_manager.event_head++;
+	if ((uint8_t)(error_manager.event_head - error_manager.event_tail) > ERROR_EVENT_QUEUE_LENGTH) {
+		error_manager.event_tail++;
+	}
+}
+
+/**
+ * @brief Writes a transition to the event log, outside the critical section
+ */
+void Error_Log_Event(uint8_t error, uint8_t type) {
+	switch (type) {
+	case ERROR_EVENT_SET:
+		EVENT_LOG("Error: %u set", error);
+		break;
+	case ERROR_EVENT_CLEAR:
+		EVENT_LOG("Error: %u cleared", error);
+		break;
+	case ERROR_EVENT_LATCH:
+		EVENT_LOG("Error: %u latched after %u retries", error, error_manager.records[error].retries);
+		break;
+	case ERROR_EVENT_RESET:
+		EVENT_LOG("Error: %u reset", error);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Gets the policy, state, count and times of one error
+ * @param error Bit number of the error, 0 upwards
+ * @retval uint8_t 1 if stats was filled, 0 if error is past the last
+ */
+uint8_t Get_Error_Stats(uint8_t error, struct Error_Stats *stats) {
+	if (error >= ERROR_COUNT) {
+		return 0;
+	}
+
+	stats->name = error_policies[error].name;
+	stats->policy = error_policies[error].policy;
+
+	taskENTER_CRITICAL();
+	const struct Error_Record *record = &error_manager.records[error];
+	stats->active = (error_state & (1UL << error)) ? 1 : 0;
+	stats->raised = record->raised;
+	stats->latched = record->latched;
+	stats->retries = record->retries;
+	stats->count = record->count;
+	stats->first_ms = record->first_ms;
+	stats->last_ms = record->last_ms;
+	stats->backoff_ms = record->backoff_ms;
+	taskEXIT_CRITICAL();
+
+	return 1;
+}
+
+/**
+ * @brief Takes the oldest error event off the queue
+ * @retval uint8_t 1 if event was filled, 0 if the queue is empty
+ */
+uint8_t Error_Read_Event(struct Error_Event *event) {
+	uint8_t read = 0;
+
+	taskENTER_CRITICAL();
+	if (error_manager.event_head != error_manager.event_tail) {
+		*event = error_manager.events[error_manager.event_tail & (ERROR_EVENT_QUEUE_LENGTH - 1)];
+		error_manager.event_tail++;
+		read = 1;
+	}
+	taskEXIT_CRITICAL();
+
+	return read;
 }
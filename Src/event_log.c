@@ -0,0 +1,117 @@
+/**
+ ******************************************************************************
+ * @file           : event_log.c
+ * @brief          : RAM ring buffer of binary events formatted after the fact
+ ******************************************************************************
+ */
+
+#include "event_log.h"
+#include "printf.h"
+
+#include "task.h"
+
+#define EVENT_LOG_MASK		(EVENT_LOG_SIZE - 1)
+
+/* Private typedef -----------------------------------------------------------*/
+struct Event_Record {
+	uint32_t timestamp_ms;
+	const char *fmt;
+	uint32_t args[EVENT_LOG_MAX_ARGS];
+	uint8_t nargs;
+};
+
+struct Event_Log {
+	struct Event_Record records[EVENT_LOG_SIZE];
+	uint32_t head;
+	uint32_t tail;
+	uint32_t dropped;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Event_Log event_log;
+
+/* Private function prototypes -----------------------------------------------*/
+uint8_t Event_Log_Read(struct Event_Record *record);
+
+/**
+ * @brief Appends an event to the ring. Overwrites the oldest event when full. Use EVENT_LOG rather than calling this.
+ * @param fmt Format string, only dereferenced when EVENT_LOG_FORMAT_ON_DEVICE is set
+ * @param nargs Number of valid words in args
+ * @param args Raw arguments
+ */
+void Event_Log_Write(const char *fmt, uint8_t nargs, const uint32_t *args) {
+	UBaseType_t saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+
+	struct Event_Record *record = &event_log.records[event_log.head & EVENT_LOG_MASK];
+
+	event_log.head++;
+	if ((event_log.head - event_log.tail) > EVENT_LOG_SIZE) {
+		event_log.tail++;
+		event_log.dropped++;
+	}
+
+	record->timestamp_ms = HAL_GetTick();
+	record->fmt = fmt;
+	record->nargs = nargs;
+	for (uint8_t i = 0; i < nargs; i++) {
+		record->args[i] = args[i];
+	}
+
+	taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+}
+
+/**
+ * @brief Takes the oldest event out of the ring
+ * @retval uint8_t 1 if an event was copied to record, 0 if the ring is empty
+ */
+uint8_t Event_Log_Read(struct Event_Record *record) {
+	uint8_t result = 0;
+
+	taskENTER_CRITICAL();
+	if (event_log.tail != event_log.head) {
+		*record = event_log.records[event_log.tail & EVENT_LOG_MASK];
+		event_log.tail++;
+		result = 1;
+	}
+	taskEXIT_CRITICAL();
+
+	return result;
+}
+
+/**
+ * @brief Gets the number of events overwritten before they were printed
+ * @retval Dropped event count since boot
+ */
+uint32_t Get_Event_Log_Dropped(void) {
+	return event_log.dropped;
+}
+
+void vEvent_Log(void const *pvParameters) {
+	TickType_t xDelay = EVENT_LOG_TASK_PERIOD_MS / portTICK_PERIOD_MS;
+
+	struct Event_Record record;
+	uint32_t reported_dropped = 0;
+
+	for (;;) {
+		while (Event_Log_Read(&record) == 1) {
+			for (uint8_t i = record.nargs; i < EVENT_LOG_MAX_ARGS; i++) {
+				record.args[i] = 0;
+			}
+#if EVENT_LOG_FORMAT_ON_DEVICE
+			printf("[%u] ", record.timestamp_ms);
+			printf(record.fmt, record.args[0], record.args[1], record.args[2], record.args[3]);
+			printf("\r\n");
+#else
+			printf("#EVT %u %x %u %x %x %x %x\r\n", record.timestamp_ms, (uint32_t)record.fmt, record.nargs,
+					record.args[0], record.args[1], record.args[2], record.args[3]);
+#endif
+		}
+
+		if (event_log.dropped != reported_dropped) {
+			printf("[%u] %u events dropped\r\n", HAL_GetTick(), event_log.dropped - reported_dropped);
+			reported_dropped = event_log.dropped;
+		}
+
+		vTaskDelay(xDelay);
+	}
+}
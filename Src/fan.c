@@ -0,0 +1,124 @@
+/**
+ ******************************************************************************
+ * @file           : fan.c
+ * @brief          : Fan control based on temperature and dissipated power
+ ******************************************************************************
+ */
+
+#include "fan.h"
+#include "adc_interface.h"
+#include "thermal.h"
+#include "main.h"
+
+#include "task.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct Fan {
+	uint8_t duty_percent;
+	uint8_t on;
+	uint8_t spinning_down;
+	TickType_t last_switch_tick;
+	TickType_t last_demand_tick;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Fan fan;
+
+/* Private function prototypes -----------------------------------------------*/
+uint8_t Fan_Ramp(int32_t value, int32_t start, int32_t full);
+void Fan_Output(uint8_t on);
+
+/**
+ * @brief Gets the duty the fan is being driven at
+ * @retval Duty in percent
+ */
+uint8_t Get_Fan_Duty(void) {
+	return fan.duty_percent;
+}
+
+/**
+ * @brief Maps a value linearly onto 0 - 100 percent
+ * @retval Duty in percent
+ */
+uint8_t Fan_Ramp(int32_t value, int32_t start, int32_t full) {
+	if (value <= start) {
+		return 0;
+	}
+	if (value >= full) {
+		return 100;
+	}
+	return (uint8_t)(((value - start) * 100) / (full - start));
+}
+
+/**
+ * @brief Drives the FAN_ENn pin
+ * @param on 1 turns the fan on, 0 turns it off
+ */
+void Fan_Output(uint8_t on) {
+	if (on == 1) {
+		HAL_GPIO_WritePin(FAN_ENn_GPIO_Port, FAN_ENn_Pin, GPIO_PIN_RESET);
+	}
+	else {
+		HAL_GPIO_WritePin(FAN_ENn_GPIO_Port, FAN_ENn_Pin, GPIO_PIN_SET);
+	}
+	fan.on = on;
+	fan.last_switch_tick = xTaskGetTickCount();
+}
+
+/**
+ * @brief Recalculates the fan duty and steps the burst modulation. Called once per regulator loop.
+ */
+void Fan_Control_Update(void) {
+
+	TickType_t now = xTaskGetTickCount();
+
+	uint8_t temperature_duty = Fan_Ramp(Get_MCU_Temperature(), FAN_TEMP_START_C, FAN_TEMP_FULL_C);
+	uint8_t power_duty = Fan_Ramp((int32_t)Get_Dissipated_Power(), FAN_POWER_START_MW, FAN_POWER_FULL_MW);
+
+	uint8_t duty = (temperature_duty > power_duty) ? temperature_duty : power_duty;
+
+	if (duty != 0) {
+		fan.last_demand_tick = now;
+		fan.spinning_down = 1;
+	}
+	else if (fan.spinning_down && ((now - fan.last_demand_tick) < pdMS_TO_TICKS(FAN_SPIN_DOWN_MS))) {
+		duty = FAN_MIN_DUTY_PERCENT;
+	}
+	else {
+		fan.spinning_down = 0;
+	}
+
+	if ((duty != 0) && (duty < FAN_MIN_DUTY_PERCENT)) {
+		duty = FAN_MIN_DUTY_PERCENT;
+	}
+
+	fan.duty_percent = duty;
+
+	uint32_t on_time_ms = (FAN_BURST_PERIOD_MS * duty) / 100;
+	uint32_t off_time_ms = FAN_BURST_PERIOD_MS - on_time_ms;
+
+	//Stretch short bursts to the dwell time and run continuously when the off time would be too short
+	if ((on_time_ms != 0) && (on_time_ms < FAN_MIN_DWELL_MS)) {
+		on_time_ms = FAN_MIN_DWELL_MS;
+	}
+	if (off_time_ms < FAN_MIN_DWELL_MS) {
+		off_time_ms = 0;
+	}
+
+	TickType_t elapsed = now - fan.last_switch_tick;
+
+	if (elapsed < pdMS_TO_TICKS(FAN_MIN_DWELL_MS)) {
+		return;
+	}
+
+	if (fan.on == 1) {
+		if ((on_time_ms == 0) || ((off_time_ms != 0) && (elapsed >= pdMS_TO_TICKS(on_time_ms)))) {
+			Fan_Output(0);
+		}
+	}
+	else {
+		if ((on_time_ms != 0) && (elapsed >= pdMS_TO_TICKS(off_time_ms))) {
+			Fan_Output(1);
+		}
+	}
+}
@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * @file           : flash_write.c
+ * @brief          : Erases and programs main flash and OTP for every module that stores data
+ ******************************************************************************
+ */
+
+#include "flash_write.h"
+#include "string.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+//Every writer goes through here. The flash has one control register and one lock, so a task that locked
+//it while another was part way through a sequence would fail the other's program. The scheduler is
+//suspended for each operation, the CPU stalls on flash fetches while programming anyway.
+
+/**
+ * @brief Erases the 2 KB page an address is in
+ * @retval uint8_t 1 if successful, 0 if error
+ */
+uint8_t Flash_Erase_Page(uint32_t address) {
+	FLASH_EraseInitTypeDef erase = {
+		.TypeErase = FLASH_TYPEERASE_PAGES,
+		.Page = (address - FLASH_BASE) / FLASH_PAGE_SIZE,
+		.NbPages = 1,
+	};
+	uint32_t page_error;
+
+	vTaskSuspendAll();
+
+	HAL_StatusTypeDef status = HAL_FLASH_Unlock();
+
+	if (status == HAL_OK) {
+		status = HAL_FLASHEx_Erase(&erase, &page_error);
+	}
+
+	HAL_FLASH_Lock();
+
+	xTaskResumeAll();
+
+	return (status == HAL_OK);
+}
+
+/**
+ * @brief Programs whole doublewords into erased flash
+ * @param length Multiple of 8 bytes
+ * @retval uint8_t 1 if successful, 0 if error
+ */
+uint8_t Flash_Program(uint32_t address, const void *data, uint16_t length) {
+	vTaskSuspendAll();
+
+	HAL_StatusTypeDef status = HAL_FLASH_Unlock();
+
+	for (uint16_t i = 0; (i < length) && (status == HAL_OK); i += sizeof(uint64_t)) {
+		uint64_t doubleword;
+		memcpy(&doubleword, (const uint8_t *)data + i, sizeof(doubleword));
+		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + i, doubleword);
+	}
+
+	HAL_FLASH_Lock();
+
+	xTaskResumeAll();
+
+	return (status == HAL_OK);
+}
@@ -0,0 +1,221 @@
+/**
+ ******************************************************************************
+ * @file           : fmt.c
+ * @brief          : Integer and fixed point text emitters picked at compile time by FMT()
+ ******************************************************************************
+ */
+
+#include "fmt.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if FMT_BENCHMARK
+#include "printf.h"
+#include "profile.h"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+static const uint32_t fmt_powers[FMT_MAX_SCALE + 1] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+#if FMT_BENCHMARK
+//Spread of the values the stats command writes, in microvolts
+static const int32_t fmt_benchmark_values[] = {
+	16800000, 4200000, 4195500, 3999999, 3300000, 12600000, 8400000, 0, 1000, 999999,
+	2500000, 5100000, 500, 4210000, 20000000, 5000000, 1234567, 3000000, 15000000, 7654321
+};
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+void Fmt_Put(struct Fmt *fmt, char c);
+void Fmt_Terminate(struct Fmt *fmt);
+void Fmt_Digits(struct Fmt *fmt, uint32_t value, uint8_t lowest, uint8_t point);
+
+/**
+ * @brief Starts a writer on an empty string
+ * @param buffer Where the text goes, always left null terminated
+ * @param size Bytes in buffer including the terminator
+ */
+void Fmt_Init(struct Fmt *fmt, char *buffer, size_t size) {
+	fmt->buffer = buffer;
+	fmt->size = size;
+	fmt->length = 0;
+	fmt->flush = NULL;
+	Fmt_Terminate(fmt);
+}
+
+/**
+ * @brief Appends one character if it fits with the terminator. A stream writer flushes a full buffer first.
+ */
+void Fmt_Put(struct Fmt *fmt, char c) {
+	if (fmt->flush != NULL) {
+		if (fmt->length >= fmt->size) {
+			fmt->flush(fmt);
+		}
+		if (fmt->length < fmt->size) {
+			fmt->buffer[fmt->length++] = c;
+			return;
+		}
+	}
+
+	if ((fmt->length + 1) < fmt->size) {
+		fmt->buffer[fmt->length] = c;
+	}
+	fmt->length++;
+}
+
+/**
+ * @brief Null terminates what has been written, at the last byte of the buffer if it overflowed
+ */
+void Fmt_Terminate(struct Fmt *fmt) {
+	if ((fmt->size == 0) || (fmt->flush != NULL)) {
+		return;
+	}
+	fmt->buffer[(fmt->length < fmt->size) ? fmt->length : (fmt->size - 1)] = '\0';
+}
+
+/**
+ * @brief Writes value in decimal by subtracting powers of ten, the M0+ has no divide instruction.
+ * Leading zeros are left out above the units digit.
+ * @param lowest Power of ten of the last digit written, the digits below it are dropped
+ * @param point Power of ten that is the units digit, the decimal point follows it
+ */
+void Fmt_Digits(struct Fmt *fmt, uint32_t value, uint8_t lowest, uint8_t point) {
+	uint8_t started = 0;
+
+	for (int8_t power = FMT_MAX_SCALE; power >= lowest; power--) {
+		char digit = '0';
+
+		while (value >= fmt_powers[power]) {
+			value -= fmt_powers[power];
+			digit++;
+		}
+
+		if ((digit != '0') || (started == 1) || (power <= point)) {
+			Fmt_Put(fmt, digit);
+			started = 1;
+		}
+
+		if ((power == point) && (power != lowest)) {
+			Fmt_Put(fmt, '.');
+		}
+	}
+}
+
+/**
+ * @brief Appends a null terminated string
+ */
+void Fmt_String(struct Fmt *fmt, const char *string) {
+	while (*string != '\0') {
+		Fmt_Put(fmt, *string++);
+	}
+	Fmt_Terminate(fmt);
+}
+
+/**
+ * @brief Appends value in decimal, as %u
+ */
+void Fmt_Unsigned(struct Fmt *fmt, uint32_t value) {
+	Fmt_Digits(fmt, value, 0, 0);
+	Fmt_Terminate(fmt);
+}
+
+/**
+ * @brief Appends value in decimal, as %d
+ */
+void Fmt_Signed(struct Fmt *fmt, int32_t value) {
+	if (value < 0) {
+		Fmt_Put(fmt, '-');
+	}
+	Fmt_Digits(fmt, (value < 0) ? -(uint32_t)value : (uint32_t)value, 0, 0);
+	Fmt_Terminate(fmt);
+}
+
+/**
+ * @brief Appends a fixed point value rounded to its decimals, as %.<decimals>f on value / 10^scale
+ */
+void Fmt_Fixed_Point(struct Fmt *fmt, struct Fmt_Fixed fixed) {
+	configASSERT((fixed.scale <= FMT_MAX_SCALE) && (fixed.decimals <= fixed.scale));
+
+	uint32_t magnitude = (fixed.value < 0) ? -(uint32_t)fixed.value : (uint32_t)fixed.value;
+	uint8_t lowest = fixed.scale - fixed.decimals;
+
+	/* Round half up on the last digit kept, 2^31 plus half of 10^9 still fits */
+	magnitude += fmt_powers[lowest] / 2;
+
+	/* A value that rounds to zero is written without a sign */
+	if ((fixed.value < 0) && (magnitude >= fmt_powers[lowest])) {
+		Fmt_Put(fmt, '-');
+	}
+	Fmt_Digits(fmt, magnitude, lowest, fixed.scale);
+	Fmt_Terminate(fmt);
+}
+
+/**
+ * @brief Appends value in lower case hex without a prefix, as %x
+ */
+void Fmt_Hexadecimal(struct Fmt *fmt, struct Fmt_Hex hex) {
+	uint8_t started = 0;
+
+	for (int8_t shift = 28; shift >= 0; shift -= 4) {
+		uint8_t nibble = (hex.value >> shift) & 0x0F;
+
+		if ((nibble != 0) || (started == 1) || (shift == 0)) {
+			Fmt_Put(fmt, (nibble < 10) ? ('0' + nibble) : ('a' + nibble - 10));
+			started = 1;
+		}
+	}
+	Fmt_Terminate(fmt);
+}
+
+/**
+ * @brief Appends value in binary without a prefix, as %b
+ */
+void Fmt_Binary(struct Fmt *fmt, struct Fmt_Bin bin) {
+	uint8_t started = 0;
+
+	for (int8_t shift = 31; shift >= 0; shift--) {
+		uint8_t bit = (bin.value >> shift) & 0x01;
+
+		if ((bit != 0) || (started == 1) || (shift == 0)) {
+			Fmt_Put(fmt, '0' + bit);
+			started = 1;
+		}
+	}
+	Fmt_Terminate(fmt);
+}
+
+#if FMT_BENCHMARK
+/**
+ * @brief Times writing the same values as volts to 3 decimals with snprintf and with FMT, the way the stats
+ * command writes them. The snprintf side includes the conversion to float it needs.
+ * @param result Cycles per value for each, from the TIM7 cycle counter
+ */
+void Fmt_Run_Benchmark(struct Fmt_Benchmark *result) {
+	const uint32_t value_count = sizeof(fmt_benchmark_values) / sizeof(fmt_benchmark_values[0]);
+	char buffer[24];
+	struct Fmt fmt;
+
+	uint32_t start_cycles = Profile_Get_Cycles();
+	for (uint32_t run = 0; run < FMT_BENCHMARK_RUNS; run++) {
+		for (uint32_t i = 0; i < value_count; i++) {
+			snprintf(buffer, sizeof(buffer), "%.3f\r\n", (float)fmt_benchmark_values[i] / 1000000);
+		}
+	}
+	uint32_t printf_cycles = Profile_Get_Cycles() - start_cycles;
+
+	start_cycles = Profile_Get_Cycles();
+	for (uint32_t run = 0; run < FMT_BENCHMARK_RUNS; run++) {
+		for (uint32_t i = 0; i < value_count; i++) {
+			Fmt_Init(&fmt, buffer, sizeof(buffer));
+			FMT(&fmt, FMT_FIXED(fmt_benchmark_values[i], 6, 3), "\r\n");
+		}
+	}
+	uint32_t fmt_cycles = Profile_Get_Cycles() - start_cycles;
+
+	result->values = value_count * FMT_BENCHMARK_RUNS;
+	result->printf_cycles = printf_cycles / result->values;
+	result->fmt_cycles = fmt_cycles / result->values;
+}
+#endif
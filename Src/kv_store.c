@@ -0,0 +1,285 @@
+/**
+ ******************************************************************************
+ * @file           : kv_store.c
+ * @brief          : Wear levelled key value store in main flash
+ ******************************************************************************
+ */
+
+#include "kv_store.h"
+#include "crc.h"
+#include "flash_write.h"
+#include "event_log.h"
+#include "string.h"
+
+#include "task.h"
+
+//A record is the key and length, the value, then a CRC over all three, padded with 0xFF to a doubleword boundary
+#define KV_RECORD_HEADER_SIZE	4
+#define KV_RECORD_SIZE(length)	(((KV_RECORD_HEADER_SIZE + (length) + sizeof(uint16_t)) + 7) & ~7UL)
+#define KV_BLANK_KEY			0xFFFF
+#define KV_NO_PAGE				0xFF
+
+/* Private typedef -----------------------------------------------------------*/
+struct KV_Page_Header {
+	uint32_t magic;
+	uint32_t generation;
+};
+
+struct KV_Index_Entry {
+	uint16_t key;
+	uint16_t offset;
+	uint16_t length;
+};
+
+struct KV_Store {
+	struct KV_Index_Entry index[KV_MAX_KEYS];
+	uint8_t key_count;
+	uint8_t active_page;
+	uint16_t write_offset;
+	uint32_t generation;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct KV_Store kv_store;
+
+/* Private function prototypes -----------------------------------------------*/
+uint32_t KV_Page_Address(uint8_t page);
+void KV_Scan_Page(uint8_t page);
+struct KV_Index_Entry *KV_Find(uint16_t key);
+uint16_t KV_Build_Record(uint64_t *record, uint16_t key, const void *value, uint16_t length);
+uint8_t KV_Compact(uint16_t key, const void *value, uint16_t length);
+
+/**
+ * @brief Gets the flash address of a store page
+ */
+uint32_t KV_Page_Address(uint8_t page) {
+	return KV_STORE_START_ADDR + ((uint32_t)page * FLASH_PAGE_SIZE);
+}
+
+/**
+ * @brief Gets the index entry of a key
+ * @retval Entry, NULL if the key has never been written
+ */
+struct KV_Index_Entry *KV_Find(uint16_t key) {
+	for (uint8_t i = 0; i < kv_store.key_count; i++) {
+		if (kv_store.index[i].key == key) {
+			return &kv_store.index[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Walks the records of a page once, indexing the newest valid record of each key
+ */
+void KV_Scan_Page(uint8_t page) {
+	const uint8_t *base = (const uint8_t *)KV_Page_Address(page);
+	uint16_t offset = sizeof(struct KV_Page_Header);
+
+	kv_store.key_count = 0;
+
+	while ((offset + KV_RECORD_SIZE(0)) <= FLASH_PAGE_SIZE) {
+		uint16_t key, length, crc;
+		memcpy(&key, base + offset, sizeof(key));
+		memcpy(&length, base + offset + sizeof(key), sizeof(length));
+
+		if ((key == KV_BLANK_KEY) && (length == 0xFFFF)) {
+			break;
+		}
+
+		//A length that runs off the page can only come from a torn write, nothing after it can be trusted
+		if ((length > KV_MAX_VALUE_SIZE) || ((offset + KV_RECORD_SIZE(length)) > FLASH_PAGE_SIZE)) {
+			offset = FLASH_PAGE_SIZE;
+			break;
+		}
+
+		memcpy(&crc, base + offset + KV_RECORD_HEADER_SIZE + length, sizeof(crc));
+
+		if (crc == CRC16_CCITT(base + offset, KV_RECORD_HEADER_SIZE + length)) {
+			struct KV_Index_Entry *entry = KV_Find(key);
+
+			if ((entry == NULL) && (kv_store.key_count < KV_MAX_KEYS)) {
+				entry = &kv_store.index[kv_store.key_count++];
+				entry->key = key;
+			}
+			if (entry != NULL) {
+				entry->offset = offset;
+				entry->length = length;
+			}
+		}
+
+		offset += KV_RECORD_SIZE(length);
+	}
+
+	kv_store.write_offset = offset;
+}
+
+/**
+ * @brief Finds the active page and indexes it. Called once at boot.
+ */
+void KV_Store_Init(void) {
+	kv_store.active_page = KV_NO_PAGE;
+	kv_store.generation = 0;
+	kv_store.key_count = 0;
+
+	for (uint8_t page = 0; page < KV_STORE_PAGES; page++) {
+		const struct KV_Page_Header *header = (const struct KV_Page_Header *)KV_Page_Address(page);
+
+		if ((header->magic == KV_STORE_MAGIC) && (header->generation != 0xFFFFFFFF) &&
+				((kv_store.active_page == KV_NO_PAGE) || (header->generation > kv_store.generation))) {
+			kv_store.active_page = page;
+			kv_store.generation = header->generation;
+		}
+	}
+
+	if (kv_store.active_page == KV_NO_PAGE) {
+		//Never written, the first KV_Write formats page 0
+		kv_store.write_offset = FLASH_PAGE_SIZE;
+		return;
+	}
+
+	KV_Scan_Page(kv_store.active_page);
+}
+
+/**
+ * @brief Copies the newest value of a key out of the store
+ * @param length Size of value, must match the size it was written with
+ * @retval uint8_t 1 if found, 0 if not
+ */
+uint8_t KV_Read(uint16_t key, void *value, uint16_t length) {
+	struct KV_Index_Entry *entry = KV_Find(key);
+
+	if ((entry == NULL) || (entry->length != length)) {
+		return 0;
+	}
+
+	memcpy(value, (const uint8_t *)KV_Page_Address(kv_store.active_page) + entry->offset + KV_RECORD_HEADER_SIZE, length);
+	return 1;
+}
+
+/**
+ * @brief Lays out a record in RAM ready to program
+ * @retval Record size in bytes
+ */
+uint16_t KV_Build_Record(uint64_t *record, uint16_t key, const void *value, uint16_t length) {
+	uint8_t *bytes = (uint8_t *)record;
+
+	memset(bytes, 0xFF, KV_RECORD_SIZE(length));
+	memcpy(bytes, &key, sizeof(key));
+	memcpy(bytes + sizeof(key), &length, sizeof(length));
+	memcpy(bytes + KV_RECORD_HEADER_SIZE, value, length);
+
+	uint16_t crc = CRC16_CCITT(bytes, KV_RECORD_HEADER_SIZE + length);
+	memcpy(bytes + KV_RECORD_HEADER_SIZE + length, &crc, sizeof(crc));
+
+	return KV_RECORD_SIZE(length);
+}
+
+/**
+ * @brief Moves the newest record of every key plus the new one to the next page. The page header is
+ * written last, so the old page stays active until the copy is complete.
+ * @retval uint8_t 1 if successful, 0 if error
+ */
+uint8_t KV_Compact(uint16_t key, const void *value, uint16_t length) {
+	uint64_t record[KV_RECORD_SIZE(KV_MAX_VALUE_SIZE) / sizeof(uint64_t)];
+	uint8_t target = (kv_store.active_page == KV_NO_PAGE) ? 0 : ((kv_store.active_page + 1) % KV_STORE_PAGES);
+	uint32_t address = KV_Page_Address(target);
+	uint32_t offset = sizeof(struct KV_Page_Header);
+	uint8_t result = Flash_Erase_Page(address);
+
+	for (uint8_t i = 0; (i < kv_store.key_count) && (result == 1); i++) {
+		if (kv_store.index[i].key == key) {
+			continue;
+		}
+		uint16_t size = KV_RECORD_SIZE(kv_store.index[i].length);
+		result = Flash_Program(address + offset, (const uint8_t *)KV_Page_Address(kv_store.active_page) + kv_store.index[i].offset, size);
+		offset += size;
+	}
+
+	uint16_t size = KV_Build_Record(record, key, value, length);
+
+	if ((result == 0) || ((offset + size) > FLASH_PAGE_SIZE)) {
+		return 0;
+	}
+
+	result = Flash_Program(address + offset, record, size);
+
+	struct KV_Page_Header header = {
+		.magic = KV_STORE_MAGIC,
+		.generation = kv_store.generation + 1,
+	};
+
+	if (result == 1) {
+		result = Flash_Program(address, &header, sizeof(header));
+	}
+
+	if (result == 0) {
+		return 0;
+	}
+
+	kv_store.active_page = target;
+	kv_store.generation = header.generation;
+	KV_Scan_Page(target);
+
+	return 1;
+}
+
+/**
+ * @brief Stores a value. Nothing is written if the stored value is already the same. The scheduler is
+ * suspended for the whole update, so any task may call it and the index always matches the page.
+ * @param length 1 to KV_MAX_VALUE_SIZE bytes
+ * @retval uint8_t 1 if successful, 0 if error
+ */
+uint8_t KV_Write(uint16_t key, const void *value, uint16_t length) {
+	uint64_t record[KV_RECORD_SIZE(KV_MAX_VALUE_SIZE) / sizeof(uint64_t)];
+
+	if ((key == KV_BLANK_KEY) || (length == 0) || (length > KV_MAX_VALUE_SIZE)) {
+		return 0;
+	}
+
+	vTaskSuspendAll();
+
+	struct KV_Index_Entry *entry = KV_Find(key);
+
+	if ((entry != NULL) && (entry->length == length) &&
+			(memcmp((const uint8_t *)KV_Page_Address(kv_store.active_page) + entry->offset + KV_RECORD_HEADER_SIZE, value, length) == 0)) {
+		xTaskResumeAll();
+		return 1;
+	}
+
+	if ((entry == NULL) && (kv_store.key_count >= KV_MAX_KEYS)) {
+		xTaskResumeAll();
+		return 0;
+	}
+
+	uint8_t result;
+	uint16_t size = KV_RECORD_SIZE(length);
+
+	if ((kv_store.write_offset + size) > FLASH_PAGE_SIZE) {
+		result = KV_Compact(key, value, length);
+
+		if (result == 1) {
+			EVENT_LOG("KV store compacted to page %u, generation %u", kv_store.active_page, kv_store.generation);
+		}
+	}
+	else {
+		KV_Build_Record(record, key, value, length);
+		result = Flash_Program(KV_Page_Address(kv_store.active_page) + kv_store.write_offset, record, size);
+
+		if (result == 1) {
+			if (entry == NULL) {
+				entry = &kv_store.index[kv_store.key_count++];
+				entry->key = key;
+			}
+			entry->offset = kv_store.write_offset;
+			entry->length = length;
+		}
+
+		//A failed program still used up the space
+		kv_store.write_offset += size;
+	}
+
+	xTaskResumeAll();
+
+	return result;
+}
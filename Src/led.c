@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+ * @file           : led.c
+ * @brief          : LED patterns played from a software timer
+ ******************************************************************************
+ */
+
+#include "led.h"
+#include "main.h"
+#include "battery.h"
+#include "bq25703a_regulator.h"
+#include "error.h"
+#include "usbpd.h"
+#include "rtos_static.h"
+#include "string.h"
+
+#include "timers.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct LED_Step {
+	uint8_t colour;
+	uint16_t time_ms; // 0 holds the step until another pattern is selected
+};
+
+struct LED_Pattern {
+	uint8_t priority;
+	uint8_t blinks; // Times the first two steps are played before the rest
+	uint8_t step_count;
+	struct LED_Step steps[LED_MAX_STEPS];
+};
+
+struct LED {
+	TimerHandle_t timer;
+	TickType_t start_tick;
+	uint8_t selected; // Written by LED_Select
+	uint8_t status_colour;
+	uint8_t playing; // Only used by the timer callback
+	uint8_t step;
+	uint8_t blink;
+};
+
+/* Private variables ---------------------------------------------------------*/
+static const struct LED_Pattern led_patterns[LED_PATTERN_COUNT] = {
+	[LED_PATTERN_STATUS] =		{ 1, 1, 1, { { LED_STATUS, 0 } } },
+	[LED_PATTERN_ERROR_1] =		{ 2, 1, 3, { { LED_RED, 200 }, { LED_OFF, 200 }, { LED_OFF, 2000 } } },
+	[LED_PATTERN_ERROR_2] =		{ 2, 2, 3, { { LED_RED, 200 }, { LED_OFF, 200 }, { LED_OFF, 2000 } } },
+	[LED_PATTERN_ERROR_3] =		{ 2, 3, 3, { { LED_RED, 200 }, { LED_OFF, 200 }, { LED_OFF, 2000 } } },
+	[LED_PATTERN_ERROR_4] =		{ 2, 4, 3, { { LED_RED, 200 }, { LED_OFF, 200 }, { LED_OFF, 2000 } } },
+	[LED_PATTERN_ERROR_5] =		{ 2, 5, 3, { { LED_RED, 200 }, { LED_OFF, 200 }, { LED_OFF, 2000 } } },
+	[LED_PATTERN_ERROR_6] =		{ 2, 6, 3, { { LED_RED, 200 }, { LED_OFF, 200 }, { LED_OFF, 2000 } } },
+	[LED_PATTERN_NO_PD] =		{ 3, 1, 2, { { LED_RED, 500 }, { LED_BLUE, 500 } } },
+	[LED_PATTERN_PRECHARGE] =	{ 4, 1, 2, { { LED_RED, 500 }, { LED_OFF, 500 } } },
+	[LED_PATTERN_NO_PACK] =		{ 5, 1, 3, { { LED_GREEN, 500 }, { LED_BLUE, 500 }, { LED_RED, 500 } } },
+	[LED_PATTERN_STARTUP] =		{ 6, 1, 1, { { LED_WHITE, 0 } } },
+};
+
+static StaticTimer_t led_timer RTOS_SECTION(tmr, leds);
+struct LED led;
+
+/* Private function prototypes -----------------------------------------------*/
+void LED_Write(uint8_t colour);
+void LED_Timer(TimerHandle_t timer);
+
+/**
+ * @brief Starts the pattern timer on the startup pattern. Called once by the control executive before its first frame.
+ */
+void LED_Init(void) {
+	memset(&led, 0, sizeof(led));
+	led.start_tick = xTaskGetTickCount();
+	led.selected = LED_PATTERN_STARTUP;
+	led.playing = LED_PATTERN_COUNT;
+
+	led.timer = xTimerCreateStatic("leds", 1, pdFALSE, NULL, LED_Timer, &led_timer);
+	configASSERT(led.timer);
+	xTimerStart(led.timer, 0);
+}
+
+/**
+ * @brief Drives the LEDs, which are on when the pin is low
+ */
+void LED_Write(uint8_t colour) {
+	if (colour == LED_STATUS) {
+		colour = led.status_colour;
+	}
+
+	HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, (colour & LED_RED) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+	HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, (colour & LED_GREEN) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+	HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, (colour & LED_BLUE) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+/**
+ * @brief Software timer callback, runs in the timer task. Shows one step and sets the timer for the next.
+ * A newly selected pattern starts from its first step.
+ */
+void LED_Timer(TimerHandle_t timer) {
+	uint8_t selected = led.selected;
+
+	if (selected != led.playing) {
+		led.playing = selected;
+		led.step = 0;
+		led.blink = 0;
+	}
+
+	const struct LED_Pattern *pattern = &led_patterns[led.playing];
+	const struct LED_Step *step = &pattern->steps[led.step];
+
+	LED_Write(step->colour);
+
+	uint8_t next = led.step + 1;
+	if ((next == 2) && (++led.blink < pattern->blinks)) {
+		next = 0;
+	}
+	if (next >= pattern->step_count) {
+		next = 0;
+		led.blink = 0;
+	}
+	led.step = next;
+
+	if (step->time_ms != 0) {
+		xTimerChangePeriod(timer, pdMS_TO_TICKS(step->time_ms), 0);
+	}
+}
+
+/**
+ * @brief Indicate stage of the control executive. Selects the pattern for the charger state, the timer plays it.
+ */
+void LED_Select(void) {
+	uint32_t error_state = Get_Error_State();
+	uint16_t requests = (1 << LED_PATTERN_STATUS);
+	uint8_t selected = LED_PATTERN_STATUS;
+	uint8_t colour = LED_OFF;
+
+	if ((xTaskGetTickCount() - led.start_tick) < pdMS_TO_TICKS(LED_STARTUP_MS)) {
+		requests |= (1 << LED_PATTERN_STARTUP);
+	}
+
+	if ((Get_Balance_Connection_State() != CONNECTED) && (error_state == 0)) {
+		requests |= (1 << LED_PATTERN_NO_PACK);
+	}
+
+	if (Get_Precharge_State()) {
+		requests |= (1 << LED_PATTERN_PRECHARGE);
+	}
+
+	if ((Get_Input_Power_Ready() != READY) && ((Get_Regulator_Charging_State() == 1) || (Get_Requires_Charging_State() == 1))) {
+		requests |= (1 << LED_PATTERN_NO_PD);
+	}
+
+	//The lowest error bit gives the code, error 32 blinks 6 times rather than 32
+	for (uint8_t i = 0; i < (LED_PATTERN_ERROR_6 - LED_PATTERN_ERROR_1 + 1); i++) {
+		if (error_state & (1UL << i)) {
+			requests |= (1 << (LED_PATTERN_ERROR_1 + i));
+			break;
+		}
+	}
+
+	for (uint8_t i = 0; i < LED_PATTERN_COUNT; i++) {
+		if ((requests & (1 << i)) && (led_patterns[i].priority > led_patterns[selected].priority)) {
+			selected = i;
+		}
+	}
+
+	/* Status colour: blue with no XT60, red while charging, green when done */
+	if ((Get_XT60_Connection_State() == NOT_CONNECTED)) {
+		colour |= LED_BLUE;
+	}
+
+	if ((Get_Requires_Charging_State() == 1) || Get_Regulator_Charging_State() == 1) {
+		colour |= LED_RED;
+	}
+// Factory LED state will only go green when charging is completed
+#if FACTORY_LEDS
+	if ((Get_Requires_Charging_State() == 0) && (Get_Regulator_Charging_State() == 0)) {
+		colour |= LED_GREEN;
+	}
+#else
+	if ((Get_Requires_Charging_State() == 0)) {
+		colour |= LED_GREEN;
+	}
+#endif
+
+	if ((selected != led.selected) || ((selected == LED_PATTERN_STATUS) && (colour != led.status_colour))) {
+		led.selected = selected;
+		led.status_colour = colour;
+		/* Play it on the next tick rather than when the current step ends */
+		xTimerChangePeriod(led.timer, 1, 0);
+	}
+}
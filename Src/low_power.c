@@ -0,0 +1,311 @@
+/**
+ ******************************************************************************
+ * @file           : low_power.c
+ * @brief          : FreeRTOS tickless idle on LPTIM1, with STOP1 while no pack is attached
+ ******************************************************************************
+ */
+
+#include "low_power.h"
+#include "main.h"
+#include "battery.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "usbpd.h"
+#include "error.h"
+#include "string.h"
+#include "stm32g0xx_ll_rcc.h"
+#include "stm32g0xx_ll_exti.h"
+
+extern I2C_HandleTypeDef hi2c1;
+extern UART_HandleTypeDef huart1;
+
+/* Private typedef -----------------------------------------------------------*/
+struct Low_Power {
+	uint8_t adc_sample_ready;
+	uint8_t cmp_pending;
+	TickType_t console_tick;
+	uint32_t tick_remainder; // LPTIM counts * configTICK_RATE_HZ not yet stepped
+	uint16_t awake_start_count;
+	uint32_t awake_start_cycles;
+	uint32_t cal_counts;
+	uint64_t cal_cycles;
+	struct Low_Power_Stats stats;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Low_Power low_power;
+
+/* Private function prototypes -----------------------------------------------*/
+uint16_t LPTIM_Read_Count(void);
+void LPTIM_Set_Compare(uint16_t compare);
+uint8_t Low_Power_Stop_Blocker(void);
+void Low_Power_Measure_LSI(uint16_t count);
+void Low_Power_Enter_Stop(void);
+
+/**
+ * @brief Starts LPTIM1 free running from the LSI. Called once before the scheduler starts.
+ */
+void Low_Power_Init(void) {
+	memset(&low_power, 0, sizeof(low_power));
+	low_power.stats.lsi_hz = LOW_POWER_LSI_HZ;
+
+	LL_RCC_LSI_Enable();
+	while (LL_RCC_LSI_IsReady() != 1);
+
+	LL_RCC_SetLPTIMClockSource(LL_RCC_LPTIM1_CLKSOURCE_LSI);
+	__HAL_RCC_LPTIM1_CLK_ENABLE();
+
+	//IER and CFGR can only be written while the timer is disabled
+	LPTIM1->CR = 0;
+	LPTIM1->CFGR = 0;
+	LPTIM1->IER = LPTIM_IER_CMPMIE;
+	LPTIM1->CR = LPTIM_CR_ENABLE;
+	LPTIM1->ARR = LPTIM_ARR_ARR;
+	while ((LPTIM1->ISR & LPTIM_ISR_ARROK) == 0);
+	LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+	LPTIM1->CR |= LPTIM_CR_CNTSTRT;
+
+	//The NVIC line is only enabled around a sleep and cleared before interrupts are unmasked, so no handler is needed
+	HAL_NVIC_SetPriority(TIM6_DAC_LPTIM1_IRQn, 3, 0);
+	HAL_NVIC_DisableIRQ(TIM6_DAC_LPTIM1_IRQn);
+
+	//LPTIM1 wakes the core from STOP1. The UCPD line is enabled too, but STOP1 is only used without a PD contract.
+	LL_EXTI_EnableIT_0_31(LL_EXTI_LINE_29);
+	LL_EXTI_EnableIT_32_63(LL_EXTI_LINE_33);
+
+	//Console RX on PA10 is given an EXTI edge while stopped
+	EXTI->EXTICR[2] &= ~(0xFFUL << 16);
+
+	low_power.awake_start_count = LPTIM_Read_Count();
+	low_power.awake_start_cycles = Profile_Get_Cycles();
+}
+
+/**
+ * @brief Reads the asynchronous counter, which is only valid when two reads in a row agree
+ */
+uint16_t LPTIM_Read_Count(void) {
+	uint16_t count, check;
+
+	do {
+		count = (uint16_t)LPTIM1->CNT;
+		check = (uint16_t)LPTIM1->CNT;
+	} while (count != check);
+
+	return count;
+}
+
+/**
+ * @brief Sets the wake up count. A compare write takes a few LSI cycles to land, only the next write waits for it.
+ */
+void LPTIM_Set_Compare(uint16_t compare) {
+	if (low_power.cmp_pending == 1) {
+		while ((LPTIM1->ISR & LPTIM_ISR_CMPOK) == 0);
+	}
+
+	LPTIM1->ICR = LPTIM_ICR_CMPOKCF | LPTIM_ICR_CMPMCF;
+	LPTIM1->CMP = compare;
+	low_power.cmp_pending = 1;
+}
+
+/**
+ * @brief Called by the control executive once a filtered reading has been through pack detection. STOP1 halts
+ * the ADC, so one full reading is taken between stops to keep pack detection working.
+ */
+void Low_Power_ADC_Sample_Done(void) {
+	low_power.adc_sample_ready = 1;
+}
+
+/**
+ * @brief Called by the console task for each character received
+ */
+void Low_Power_Console_Activity(void) {
+	low_power.console_tick = xTaskGetTickCount();
+}
+
+/**
+ * @brief Gets how long the core has slept
+ */
+void Get_Low_Power_Stats(struct Low_Power_Stats *stats) {
+	taskENTER_CRITICAL();
+	memcpy(stats, &low_power.stats, sizeof(struct Low_Power_Stats));
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Checks nothing needs the high speed clocks. Runs with interrupts masked.
+ * @retval uint8_t LOW_POWER_STOP_ALLOWED if STOP1 can be used for this sleep, otherwise what needs the clocks
+ */
+uint8_t Low_Power_Stop_Blocker(void) {
+	if (LOW_POWER_ENABLE_STOP == 0) {
+		return LOW_POWER_STOP_DISABLED;
+	}
+
+	//A pack on either connector means charging, balancing or a measurement is close
+	if ((Get_XT60_Connection_State() == CONNECTED) || (Get_Balance_Connection_State() == CONNECTED)) {
+		return LOW_POWER_STOP_PACK;
+	}
+
+	if (low_power.adc_sample_ready == 0) {
+		return LOW_POWER_STOP_ADC;
+	}
+
+	//A PD source keeps sending to a sink after the contract settles, new capabilities, messages that expect a
+	//GoodCRC and hard resets. UCPD2 can not receive them in STOP1, so only stop when there is no contract.
+	if (Get_Input_Power_Ready() != NO_USB_PD_SUPPLY) {
+		return LOW_POWER_STOP_CONTRACT;
+	}
+
+	if (Get_Telemetry_Rate() != 0) {
+		return LOW_POWER_STOP_TELEMETRY;
+	}
+
+	if ((xTaskGetTickCountFromISR() - low_power.console_tick) < pdMS_TO_TICKS(LOW_POWER_CONSOLE_HOLD_MS)) {
+		return LOW_POWER_STOP_CONSOLE;
+	}
+
+	//A DMA transfer would stall half way
+	if ((huart1.gState != HAL_UART_STATE_READY) || (hi2c1.State != HAL_I2C_STATE_READY)) {
+		return LOW_POWER_STOP_DMA;
+	}
+
+	return LOW_POWER_STOP_ALLOWED;
+}
+
+/**
+ * @brief Measures the LSI against the core clock over the time spent awake, when both are running
+ * @param count LPTIM count at the start of this sleep
+ */
+void Low_Power_Measure_LSI(uint16_t count) {
+	uint32_t cycles = Profile_Get_Cycles() - low_power.awake_start_cycles;
+
+	//Awake for longer than a LPTIM wrap, the count difference is ambiguous
+	if (cycles >= (SystemCoreClock / 1000) * LOW_POWER_MAX_IDLE_MS) {
+		return;
+	}
+
+	low_power.cal_counts += (uint16_t)(count - low_power.awake_start_count);
+	low_power.cal_cycles += cycles;
+
+	if (low_power.cal_counts >= LOW_POWER_LSI_CAL_COUNTS) {
+		uint32_t lsi_hz = (uint32_t)(((uint64_t)low_power.cal_counts * SystemCoreClock) / low_power.cal_cycles);
+
+		//The LSI is specified to within about 10%, anything further out is a bad measurement
+		if ((lsi_hz > (LOW_POWER_LSI_HZ * 9 / 10)) && (lsi_hz < (LOW_POWER_LSI_HZ * 11 / 10))) {
+			low_power.stats.lsi_hz = lsi_hz;
+		}
+
+		low_power.cal_counts = 0;
+		low_power.cal_cycles = 0;
+	}
+}
+
+/**
+ * @brief Enters STOP1 and brings the PLL back on wake up. The core wakes on HSI16.
+ */
+void Low_Power_Enter_Stop(void) {
+	low_power.adc_sample_ready = 0;
+
+	EXTI->FPR1 = EXTI_FPR1_FPIF10;
+	EXTI->FTSR1 |= EXTI_FTSR1_FT10;
+	EXTI->IMR1 |= EXTI_IMR1_IM10;
+
+	HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+
+	LL_RCC_PLL_Enable();
+	while (LL_RCC_PLL_IsReady() != 1);
+	LL_RCC_SetSysClkSource(LL_RCC_SYS_CLKSOURCE_PLL);
+	while (LL_RCC_GetSysClkSource() != LL_RCC_SYS_CLKSOURCE_STATUS_PLL);
+
+	EXTI->IMR1 &= ~EXTI_IMR1_IM10;
+	EXTI->FTSR1 &= ~EXTI_FTSR1_FT10;
+
+	//Woken by the console, its first character is lost but the clocks stay up for the rest
+	if (EXTI->FPR1 & EXTI_FPR1_FPIF10) {
+		EXTI->FPR1 = EXTI_FPR1_FPIF10;
+		low_power.console_tick = xTaskGetTickCountFromISR();
+	}
+	NVIC_ClearPendingIRQ(EXTI4_15_IRQn);
+
+	low_power.stats.stop_count++;
+}
+
+/**
+ * @brief FreeRTOS tickless idle, configUSE_TICKLESS_IDLE 2. SysTick, the HAL tick and the profile
+ * counter are stopped, LPTIM1 wakes the core at the next deadline and the time asleep is added back to all three.
+ * @param xExpectedIdleTime Ticks until the next task is due
+ */
+void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime) {
+	if (xExpectedIdleTime > pdMS_TO_TICKS(LOW_POWER_MAX_IDLE_MS)) {
+		xExpectedIdleTime = pdMS_TO_TICKS(LOW_POWER_MAX_IDLE_MS);
+	}
+
+	__disable_irq();
+	__DSB();
+	__ISB();
+
+	if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+		__enable_irq();
+		return;
+	}
+
+	uint16_t start_count = LPTIM_Read_Count();
+	uint32_t sleep_counts = (xExpectedIdleTime * low_power.stats.lsi_hz) / configTICK_RATE_HZ;
+
+	Low_Power_Measure_LSI(start_count);
+	LPTIM_Set_Compare((uint16_t)(start_count + sleep_counts));
+
+	SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+	HAL_SuspendTick();
+	Profile_Suspend();
+
+	low_power.stats.stop_blocker = Low_Power_Stop_Blocker();
+	uint8_t stop = (low_power.stats.stop_blocker == LOW_POWER_STOP_ALLOWED) ? 1 : 0;
+
+	NVIC_ClearPendingIRQ(TIM6_DAC_LPTIM1_IRQn);
+	NVIC_EnableIRQ(TIM6_DAC_LPTIM1_IRQn);
+
+	if (stop == 1) {
+		Low_Power_Enter_Stop();
+	}
+	else {
+		__DSB();
+		__WFI();
+	}
+
+	NVIC_DisableIRQ(TIM6_DAC_LPTIM1_IRQn);
+	LPTIM1->ICR = LPTIM_ICR_CMPMCF;
+	NVIC_ClearPendingIRQ(TIM6_DAC_LPTIM1_IRQn);
+
+	uint16_t end_count = LPTIM_Read_Count();
+	uint32_t slept_counts = (uint16_t)(end_count - start_count);
+
+	//Carry the part of a tick left over so idle time does not drift
+	uint32_t scaled = (slept_counts * configTICK_RATE_HZ) + low_power.tick_remainder;
+	TickType_t slept_ticks = scaled / low_power.stats.lsi_hz;
+	low_power.tick_remainder = scaled % low_power.stats.lsi_hz;
+
+	if (slept_ticks > xExpectedIdleTime) {
+		slept_ticks = xExpectedIdleTime;
+		low_power.tick_remainder = 0;
+	}
+
+	Profile_Resume(((uint64_t)slept_counts * SystemCoreClock) / low_power.stats.lsi_hz);
+	uwTick += slept_ticks * (1000 / configTICK_RATE_HZ);
+	HAL_ResumeTick();
+
+	SysTick->VAL = 0;
+	SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+	vTaskStepTick(slept_ticks);
+
+	if (stop == 1) {
+		low_power.stats.stop_ms += slept_ticks * (1000 / configTICK_RATE_HZ);
+	}
+	else {
+		low_power.stats.sleep_ms += slept_ticks * (1000 / configTICK_RATE_HZ);
+	}
+
+	low_power.awake_start_count = end_count;
+	low_power.awake_start_cycles = Profile_Get_Cycles();
+
+	__enable_irq();
+}
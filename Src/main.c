@@ -69,6 +69,14 @@
 #include "stm32g0xx_hal_flash_ex.h"
 #include "stm32g0xx_hal_tim.h"
 #include "error.h"
+#include "telemetry.h"
+#include "event_log.h"
+#include "params.h"
+#include "kv_store.h"
+#include "low_power.h"
+#include "stack_monitor.h"
+#include "control.h"
+#include "rtos_static.h"
 
 /* USER CODE END Includes */
 
@@ -109,15 +117,16 @@ UART_HandleTypeDef huart1;
 DMA_HandleTypeDef hdma_usart1_tx;
 DMA_HandleTypeDef hdma_usart1_rx;
 
-osThreadId defaultTaskHandle;
 /* USER CODE BEGIN PV */
 
-osThreadId defaultTaskHandle;
-osThreadId blinkyTaskHandle;
-
 SemaphoreHandle_t xTxMutex_CLI;
+SemaphoreHandle_t xTxSpace_CLI;
 SemaphoreHandle_t xTxMutex_Regulator;
 
+RTOS_SEMAPHORE_MEM(xTxMutex_CLI);
+RTOS_SEMAPHORE_MEM(xTxSpace_CLI);
+RTOS_SEMAPHORE_MEM(xTxMutex_Regulator);
+
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -129,11 +138,9 @@ static void MX_I2C1_Init(void);
 static void MX_TIM7_Init(void);
 static void MX_USART1_UART_Init(void);
 static void MX_UCPD2_Init(void);
-void StartDefaultTask(void const * argument);
 
 /* USER CODE BEGIN PFP */
 
-void vLED_Blinky(void const *pvParameters);
 
 /* USER CODE END PFP */
 
@@ -213,6 +220,11 @@ int main(void)
     }
   }
 
+  KV_Store_Init();
+  Params_Load();
+  Stack_Monitor_Init();
+  Low_Power_Init();
+
 #if defined(_GUI_INTERFACE)
   /* Disable dead battery to use USART1_RX used by GUI 	*/
   LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_SYSCFG);
@@ -225,15 +237,16 @@ int main(void)
   MX_USBPD_Init();
 
   /* USER CODE BEGIN RTOS_MUTEX */
-	xTxMutex_Regulator = xSemaphoreCreateMutex();
+	xTxMutex_Regulator = xSemaphoreCreateMutexStatic(&rtos_scb_xTxMutex_Regulator);
 	configASSERT(xTxMutex_Regulator);
 
-	xTxMutex_CLI = xSemaphoreCreateMutex();
+	xTxMutex_CLI = xSemaphoreCreateMutexStatic(&rtos_scb_xTxMutex_CLI);
 	configASSERT(xTxMutex_CLI);
   /* USER CODE END RTOS_MUTEX */
 
   /* USER CODE BEGIN RTOS_SEMAPHORES */
-	/* add semaphores, ... */
+	xTxSpace_CLI = xSemaphoreCreateBinaryStatic(&rtos_scb_xTxSpace_CLI);
+	configASSERT(xTxSpace_CLI);
   /* USER CODE END RTOS_SEMAPHORES */
 
   /* USER CODE BEGIN RTOS_TIMERS */
@@ -244,33 +257,29 @@ int main(void)
 	/* add queues, ... */
   /* USER CODE END RTOS_QUEUES */
 
-  /* Create the thread(s) */
-  /* definition and creation of defaultTask */
-  osThreadDef(defaultTask, StartDefaultTask, osPriorityNormal, 0, 128);
-  defaultTaskHandle = osThreadCreate(osThread(defaultTask), NULL);
-
   /* USER CODE BEGIN RTOS_THREADS */
 
-	osThreadDef(blink_led, vLED_Blinky, LED_TASK_PRIORITY, 0, configMINIMAL_STACK_SIZE);
-	blinkyTaskHandle = osThreadCreate(osThread(blink_led), NULL);
-
-	/* Start the adc task */
-	osThreadDef(read_adc, vRead_ADC, ADC_TASK_PRIORITY, 0, vRead_ADC_STACK_SIZE);
-	adcTaskHandle = osThreadCreate(osThread(read_adc), NULL);
-
-	/* Start the task that manages the regulator*/
-	osThreadDef(regulator, vRegulator, REGULATOR_TASK_PRIORITY, 0, vRegulator_STACK_SIZE);
-	regulatorTaskHandle = osThreadCreate(osThread(regulator), NULL);
+	/* Start the control executive, it runs the ADC, regulator, USB PD contract and LEDs */
+	osThreadStaticMemDef(control, vControl, CONTROL_TASK_PRIORITY, vControl_STACK_SIZE);
+	controlTaskHandle = osThreadCreate(osThread(control), NULL);
 
 #if defined(_CLI_INTERFACE)
 	MX_USART1_UART_Init();
 	/* Initialize CLI */
 	/* Start the Command Line Interface on UART1 */
-	osThreadDef(CLI, prvUARTCommandConsoleTask, UART_CLI_TASK_PRIORITY, 0, vcliSTACK_SIZE);
+	osThreadStaticMemDef(CLI, prvUARTCommandConsoleTask, UART_CLI_TASK_PRIORITY, vcliSTACK_SIZE);
 	CLITaskHandle = osThreadCreate(osThread(CLI), NULL);
 
 	/* Register commands with the FreeRTOS+CLI command interpreter. */
 	vRegisterCLICommands();
+
+	/* Start the task that prints the event log */
+	osThreadStaticMemDef(event_log, vEvent_Log, EVENT_LOG_TASK_PRIORITY, vEvent_Log_STACK_SIZE);
+	eventLogTaskHandle = osThreadCreate(osThread(event_log), NULL);
+
+	/* Start the binary telemetry stream task, idle until a rate is set */
+	osThreadStaticMemDef(telemetry, vTelemetry, TELEMETRY_TASK_PRIORITY, vTelemetry_STACK_SIZE);
+	telemetryTaskHandle = osThreadCreate(osThread(telemetry), NULL);
 #endif /* _CLI_INTERFACE */
 
 	/* Initialize the Device Policy Manager */
@@ -521,9 +530,9 @@ static void MX_TIM7_Init(void)
 
   /* USER CODE END TIM7_Init 1 */
   htim7.Instance = TIM7;
-  htim7.Init.Prescaler = 0x1194;
+  htim7.Init.Prescaler = 0;
   htim7.Init.CounterMode = TIM_COUNTERMODE_UP;
-  htim7.Init.Period = 0x1;
+  htim7.Init.Period = 0xFFFF;
   htim7.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
   if (HAL_TIM_Base_Init(&htim7) != HAL_OK)
   {
@@ -718,151 +727,38 @@ static void MX_GPIO_Init(void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
-  /*Configure GPIO pins : PROTCHOT_Pin CHRG_OK_Pin */
-  GPIO_InitStruct.Pin = PROTCHOT_Pin|CHRG_OK_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  /*Configure GPIO pin : PROTCHOT_Pin */
+  GPIO_InitStruct.Pin = PROTCHOT_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
   GPIO_InitStruct.Pull = GPIO_NOPULL;
-  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+  HAL_GPIO_Init(PROTCHOT_GPIO_Port, &GPIO_InitStruct);
 
-}
+  /*Configure GPIO pin : CHRG_OK_Pin */
+  GPIO_InitStruct.Pin = CHRG_OK_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  HAL_GPIO_Init(CHRG_OK_GPIO_Port, &GPIO_InitStruct);
 
-/* USER CODE BEGIN 4 */
+  /* EXTI interrupt init*/
+  HAL_NVIC_SetPriority(EXTI0_1_IRQn, 3, 0);
+  HAL_NVIC_EnableIRQ(EXTI0_1_IRQn);
 
-void vLED_Blinky(void const *pvParameters) {
-	TickType_t xDelay = 500 / portTICK_PERIOD_MS;
-
-	uint8_t count = 0;
-
-	HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_RESET);
-
-	vTaskDelay(xDelay*4);
-
-	for (;;) {
-
-		if ( (Get_Balance_Connection_State() != CONNECTED) && (Get_Error_State() == 0)) {
-			switch (count) {
-			case 0:
-				HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_SET);
-				HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_RESET);
-				HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_SET);
-				break;
-			case 1:
-				HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_SET);
-				HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_SET);
-				HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_RESET);
-				break;
-			case 2:
-				HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_RESET);
-				HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_SET);
-				HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_SET);
-				break;
-			}
-			if (count == 2) {
-				count = 0;
-			}
-			else {
-				count++;
-			}
-		}
-		else if(Get_Precharge_State()){ // // Where we're precharging - blink red
-		  HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_SET);
-      HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_SET);
-		  if(count){
-		    HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_RESET);
-		    count = 0;
-		  }else{
-		    HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_SET);
-		    count++;
-		  }
-		}
-		else if((Get_Input_Power_Ready()!=READY) && ((Get_Regulator_Charging_State() == 1) || (Get_Requires_Charging_State() == 1))){ // Where we're charging but without PD - blink blue and red
-		  HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_SET);
-
-      if(count){
-        HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_RESET);
-        HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_SET);
-        count = 0;
-      }else{
-        HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_SET);
-        HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_RESET);
-        count++;
-      }
-		}
-		else if (Get_Error_State() != 0) {
-			HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_SET);
-			HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_SET);
-			HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_SET);
-
-			for (int i = 0; i < (Get_Error_State()); i++) {
-				vTaskDelay(200 / portTICK_PERIOD_MS);
-				HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_RESET);
-				vTaskDelay(200 / portTICK_PERIOD_MS);
-				HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_SET);
-			}
-			vTaskDelay(xDelay * 4);
-		}
-		else {
-			if ((Get_XT60_Connection_State() == NOT_CONNECTED)) {
-				HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_RESET);
-			}
-			else {
-				HAL_GPIO_WritePin(Blue_LED_GPIO_Port, Blue_LED_Pin, GPIO_PIN_SET);
-			}
-
-			if ((Get_Requires_Charging_State() == 1) || Get_Regulator_Charging_State() == 1) {
-				HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_RESET);
-			}
-			else {
-				HAL_GPIO_WritePin(Red_LED_GPIO_Port, Red_LED_Pin, GPIO_PIN_SET);
-			}
-// Factory LED state will only go green when charging is completed
-#if FACTORY_LEDS
-			if ((Get_Requires_Charging_State() == 0) && (Get_Regulator_Charging_State() == 0)) {
-				HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_RESET);
-			}
-			else {
-				HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_SET);
-			}
-#else
-			if ((Get_Requires_Charging_State() == 0)) {
-        HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_RESET);
-      }
-      else {
-        HAL_GPIO_WritePin(Green_LED_GPIO_Port, Green_LED_Pin, GPIO_PIN_SET);
-      }
-#endif
-		}
+  HAL_NVIC_SetPriority(EXTI4_15_IRQn, 3, 0);
+  HAL_NVIC_EnableIRQ(EXTI4_15_IRQn);
 
-		vTaskDelay(xDelay);
-	}
 }
 
+/* USER CODE BEGIN 4 */
+
 void _putchar(char character) {
-	UART_Transfer((uint8_t *) &character, 1);
+	/* Debug output would break up the records a script reads */
+	if (UART_Get_Script_Format() == CLI_SCRIPT_OFF) {
+		UART_Transfer((uint8_t *) &character, 1);
+	}
 }
 
 /* USER CODE END 4 */
 
-/* USER CODE BEGIN Header_StartDefaultTask */
-/**
- * @brief  Function implementing the defaultTask thread.
- * @param  argument: Not used
- * @retval None
- */
-/* USER CODE END Header_StartDefaultTask */
-void StartDefaultTask(void const * argument)
-{
-
-  /* USER CODE BEGIN 5 */
-	/* Infinite loop */
-	for (;;) {
-		osDelay(1);
-	}
-  /* USER CODE END 5 */ 
-}
-
 /**
   * @brief  Period elapsed callback in non blocking mode
   * @note   This function is called  when TIM1 interrupt took place, inside
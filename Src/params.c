@@ -0,0 +1,219 @@
+/**
+ ******************************************************************************
+ * @file           : params.c
+ * @brief          : Registry of runtime tunable parameters and their flash store
+ ******************************************************************************
+ */
+
+#include "params.h"
+#include "main.h"
+#include "adc_interface.h"
+#include "battery.h"
+#include "bq25703a_regulator.h"
+#include "kv_store.h"
+#include "event_log.h"
+#include "string.h"
+#include <stddef.h>
+
+#define PARAM(field, type, min, max, default_value, flags) \
+	{ #field, type, offsetof(struct Params, field), min, max, default_value, flags }
+
+/* Private typedef -----------------------------------------------------------*/
+struct Params_Record {
+	uint8_t version;
+	uint8_t count;
+	uint16_t reserved;
+	struct Params params;
+};
+
+_Static_assert(sizeof(struct Params_Record) <= KV_MAX_VALUE_SIZE, "Params_Record must fit in one key value store record");
+
+/* Private variables ---------------------------------------------------------*/
+struct Params params;
+
+static const struct Param_Definition param_definitions[] = {
+	PARAM(max_charge_current_ma, PARAM_TYPE_UINT, 64, 8128, MAX_CHARGE_CURRENT_MA, 0),
+	PARAM(charge_term_current_ma, PARAM_TYPE_UINT, 64, 2000, CHARGE_TERM_CURRENT_MA, 0),
+	PARAM(max_charging_power_mw, PARAM_TYPE_UINT, 2500, 100000, MAX_CHARGING_POWER, 0),
+	PARAM(assume_efficiency, PARAM_TYPE_FLOAT, 0.5f, 1.0f, ASSUME_EFFICIENCY, 0),
+	PARAM(temp_throttle_thresh_c, PARAM_TYPE_INT, 25, 85, TEMP_THROTTLE_THRESH_C, 0),
+	PARAM(balance_start_mv, PARAM_TYPE_UINT, 5, 200, CELL_DELTA_V_ENABLE_BALANCING / (BATTERY_ADC_MULTIPLIER / 1000), 0),
+	PARAM(balance_hysteresis_mv, PARAM_TYPE_UINT, 2, 200, CELL_BALANCING_HYSTERESIS_V / (BATTERY_ADC_MULTIPLIER / 1000), 0),
+	PARAM(enable_balancing, PARAM_TYPE_UINT, 0, 1, ENABLE_BALANCING, PARAM_FLAG_IDLE_ONLY),
+	PARAM(num_series, PARAM_TYPE_UINT, 2, 4, NUM_SERIES, PARAM_FLAG_IDLE_ONLY),
+	PARAM(uvp_recovery_current_ma, PARAM_TYPE_UINT, 64, 1000, UVP_RECOVERY_CURRENT_MA, 0),
+};
+
+#define PARAM_COUNT		(sizeof(param_definitions) / sizeof(param_definitions[0]))
+
+_Static_assert(PARAM_COUNT == (sizeof(struct Params) / sizeof(uint32_t)), "Every field of struct Params needs a registry entry");
+
+/* Private function prototypes -----------------------------------------------*/
+uint32_t *Param_Word(const struct Param_Definition *definition);
+uint8_t Param_In_Range(const struct Param_Definition *definition, float value);
+uint8_t Param_Locked(const struct Param_Definition *definition);
+
+/**
+ * @brief Gets the RAM copy of a parameter
+ */
+uint32_t *Param_Word(const struct Param_Definition *definition) {
+	return (uint32_t *)((uint8_t *)&params + definition->offset);
+}
+
+/**
+ * @brief Checks a value against the type and limits of a parameter
+ * @retval uint8_t 1 if allowed, 0 if not
+ */
+uint8_t Param_In_Range(const struct Param_Definition *definition, float value) {
+	//Checked this way round so NaN is rejected too
+	if (!((value >= definition->min) && (value <= definition->max))) {
+		return 0;
+	}
+	if ((definition->type != PARAM_TYPE_FLOAT) && (value != (float)(int32_t)value)) {
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief Checks whether a safety critical parameter may change now. The cell count and balancing decide the charge
+ * voltage and the cell checks, changing either under a pack on the XT60 could overcharge it.
+ * @retval uint8_t 1 if locked, 0 if it can be changed
+ */
+uint8_t Param_Locked(const struct Param_Definition *definition) {
+	if ((definition->flags & PARAM_FLAG_IDLE_ONLY) == 0) {
+		return 0;
+	}
+	return ((Get_XT60_Connection_State() == CONNECTED) || (Get_Regulator_Charging_State() == 1)) ? 1 : 0;
+}
+
+/**
+ * @brief Gets the number of registered parameters
+ */
+uint8_t Get_Param_Count(void) {
+	return PARAM_COUNT;
+}
+
+/**
+ * @brief Gets a registry entry
+ * @param index 0 to Get_Param_Count() - 1
+ * @retval Definition, NULL if out of range
+ */
+const struct Param_Definition *Get_Param_Definition(uint8_t index) {
+	if (index >= PARAM_COUNT) {
+		return NULL;
+	}
+	return &param_definitions[index];
+}
+
+/**
+ * @brief Looks up a parameter by name
+ * @retval Definition, NULL if there is no parameter with that name
+ */
+const struct Param_Definition *Find_Param(const char *name) {
+	for (uint8_t i = 0; i < PARAM_COUNT; i++) {
+		if (strcmp(param_definitions[i].name, name) == 0) {
+			return &param_definitions[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Gets the value of a parameter as a float whatever its type
+ */
+float Get_Param_Value(const struct Param_Definition *definition) {
+	uint32_t *word = Param_Word(definition);
+
+	switch (definition->type) {
+	case PARAM_TYPE_INT:
+		return (float)*(int32_t *)word;
+	case PARAM_TYPE_FLOAT:
+		return *(float *)word;
+	default:
+		return (float)*word;
+	}
+}
+
+/**
+ * @brief Changes a parameter in RAM. Takes effect on the next pass of the loop that uses it, Params_Save keeps it across resets.
+ * @param value New value, integer types must be given a whole number
+ * @retval uint8_t PARAM_SET_OK, PARAM_SET_REJECTED if out of range or PARAM_SET_LOCKED if it can not change while a pack is attached
+ */
+uint8_t Set_Param_Value(const struct Param_Definition *definition, float value) {
+	if (Param_In_Range(definition, value) == 0) {
+		return PARAM_SET_REJECTED;
+	}
+
+	if (Param_Locked(definition) == 1) {
+		return PARAM_SET_LOCKED;
+	}
+
+	uint32_t *word = Param_Word(definition);
+
+	//Single word stores, so the tasks reading params never see a torn value
+	switch (definition->type) {
+	case PARAM_TYPE_INT:
+		*(int32_t *)word = (int32_t)value;
+		break;
+	case PARAM_TYPE_FLOAT:
+		*(float *)word = value;
+		break;
+	default:
+		*word = (uint32_t)value;
+		break;
+	}
+	return PARAM_SET_OK;
+}
+
+/**
+ * @brief Fills params with the defaults, then with the record in the key value store. Values outside their limits keep the default.
+ * Called once at boot after KV_Store_Init, before the tasks start.
+ */
+void Params_Load(void) {
+	struct Params_Record record;
+
+	for (uint8_t i = 0; i < PARAM_COUNT; i++) {
+		Set_Param_Value(&param_definitions[i], param_definitions[i].default_value);
+	}
+
+	if ((KV_Read(KV_KEY_PARAMS, &record, sizeof(record)) == 0) || (record.version != PARAMS_VERSION) || (record.count != PARAM_COUNT)) {
+		return;
+	}
+
+	for (uint8_t i = 0; i < PARAM_COUNT; i++) {
+		uint32_t stored = *(const uint32_t *)((const uint8_t *)&record.params + param_definitions[i].offset);
+		float value;
+
+		switch (param_definitions[i].type) {
+		case PARAM_TYPE_INT:
+			value = (float)(int32_t)stored;
+			break;
+		case PARAM_TYPE_FLOAT:
+			memcpy(&value, &stored, sizeof(value));
+			break;
+		default:
+			value = (float)stored;
+			break;
+		}
+
+		if (Set_Param_Value(&param_definitions[i], value) != PARAM_SET_OK) {
+			EVENT_LOG("Param %u out of range, using default", i);
+		}
+	}
+}
+
+/**
+ * @brief Writes the RAM parameters to the key value store. Nothing is written if they have not changed since the last save.
+ * @retval uint8_t 1 if successful, 0 if error
+ */
+uint8_t Params_Save(void) {
+	struct Params_Record record;
+
+	memset(&record, 0xFF, sizeof(record));
+	record.version = PARAMS_VERSION;
+	record.count = PARAM_COUNT;
+	memcpy(&record.params, &params, sizeof(record.params));
+
+	return KV_Write(KV_KEY_PARAMS, &record, sizeof(record));
+}
@@ -0,0 +1,294 @@
+/**
+ ******************************************************************************
+ * @file           : profile.c
+ * @brief          : Cycle counter, FreeRTOS run time counter and per task and per interrupt execution time accounting
+ ******************************************************************************
+ */
+
+#include "profile.h"
+#include "string.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct Profile_Task {
+	char name[configMAX_TASK_NAME_LEN];
+	uint64_t total_cycles;
+	uint32_t max_cycles;
+	uint32_t count;
+};
+
+struct Profile_ISR {
+	uint64_t total_cycles;
+	uint32_t max_cycles;
+	uint32_t count;
+};
+
+struct Profile {
+	struct Profile_Task tasks[PROFILE_MAX_TASKS];
+	struct Profile_ISR isrs[PROFILE_ISR_COUNT];
+	uint8_t task_count;
+	uint32_t isr_depth;
+	uint32_t isr_busy_cycles; // Outermost profiled interrupt time, only differences are used
+	uint32_t switched_in_cycles;
+	uint32_t switched_in_isr_busy;
+	uint64_t window_start;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Profile profile;
+volatile uint32_t profile_overflows = 0;
+
+static const char *const isr_names[PROFILE_ISR_COUNT] = {
+	"ADC DMA IRQ",
+	"I2C IRQ",
+	"I2C DMA IRQ",
+	"UCPD IRQ",
+	"USART IRQ",
+	"USART DMA IRQ",
+};
+
+/* Private function prototypes -----------------------------------------------*/
+uint64_t Profile_Get_Cycles_64(void);
+UBaseType_t Profile_Task_Slot(TaskHandle_t task);
+uint32_t Profile_Permille(uint64_t cycles, uint64_t elapsed);
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
+
+/**
+ * @brief Reads TIM7 extended by the overflow count. Safe from any context.
+ * @retval Core clock cycles since boot
+ */
+uint64_t Profile_Get_Cycles_64(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint32_t high = profile_overflows;
+	uint32_t low = PROFILE_TIMER->CNT;
+
+	//The counter wrapped but the overflow interrupt has not run yet, the second read is after the wrap
+	if (PROFILE_TIMER->SR & TIM_SR_UIF) {
+		high++;
+		low = PROFILE_TIMER->CNT;
+	}
+
+	__set_PRIMASK(primask);
+
+	return ((uint64_t)high << 16) | low;
+}
+
+/**
+ * @brief Gets the low 32 bits of the cycle counter, enough to time anything shorter than 67 seconds
+ */
+uint32_t Profile_Get_Cycles(void) {
+	return (uint32_t)Profile_Get_Cycles_64();
+}
+
+/**
+ * @brief Counts a TIM7 wrap. Called from the TIM7 interrupt before the HAL handler.
+ */
+void Profile_Timer_Overflow(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (PROFILE_TIMER->SR & TIM_SR_UIF) {
+		PROFILE_TIMER->SR = ~TIM_SR_UIF;
+		profile_overflows++;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Stops the cycle counter for a low power sleep, so its overflow interrupt does not wake the core.
+ * Call with interrupts masked.
+ */
+void Profile_Suspend(void) {
+	PROFILE_TIMER->CR1 &= ~TIM_CR1_CEN;
+}
+
+/**
+ * @brief Restarts the cycle counter moved on by the time spent asleep. Call with interrupts masked.
+ * @param skipped_cycles Sleep time in core clock cycles
+ */
+void Profile_Resume(uint64_t skipped_cycles) {
+	uint64_t cycles = Profile_Get_Cycles_64() + skipped_cycles;
+
+	PROFILE_TIMER->SR = ~TIM_SR_UIF;
+	PROFILE_TIMER->CNT = (uint32_t)(cycles & 0xFFFF);
+	profile_overflows = (uint32_t)(cycles >> 16);
+	PROFILE_TIMER->CR1 |= TIM_CR1_CEN;
+}
+
+/**
+ * @brief FreeRTOS run time stats hook, TIM7 is already running from MX_TIM7_Init
+ */
+void configureTimerForRunTimeStats(void) {
+	Profile_Reset();
+}
+
+/**
+ * @brief FreeRTOS run time stats hook. The counter is only 32 bits, so it is scaled down far enough to outlast
+ * a charge session. Slices shorter than one count still add up correctly on average.
+ * @retval Run time counts of 64us since boot
+ */
+unsigned long getRunTimeCounterValue(void) {
+	return (unsigned long)(Profile_Get_Cycles_64() >> PROFILE_RUN_TIME_SHIFT);
+}
+
+/**
+ * @brief Marks the start of a profiled interrupt
+ * @retval Start cycle count to pass to Profile_ISR_Exit
+ */
+uint32_t Profile_ISR_Enter(void) {
+	profile.isr_depth++;
+	return Profile_Get_Cycles();
+}
+
+/**
+ * @brief Marks the end of a profiled interrupt. An interrupt never nests inside itself so its own
+ * entry is only written here. Only the outermost exit adds to the busy time taken away from tasks.
+ */
+void Profile_ISR_Exit(uint8_t isr, uint32_t start_cycles) {
+	uint32_t cycles = Profile_Get_Cycles() - start_cycles;
+	struct Profile_ISR *entry = &profile.isrs[isr];
+
+	entry->count++;
+	entry->total_cycles += cycles;
+	if (cycles > entry->max_cycles) {
+		entry->max_cycles = cycles;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	profile.isr_depth--;
+	if (profile.isr_depth == 0) {
+		profile.isr_busy_cycles += cycles;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief traceTASK_SWITCHED_IN hook, runs in the context switch with interrupts masked
+ */
+void Profile_Task_Switched_In(void) {
+	profile.switched_in_cycles = Profile_Get_Cycles();
+	profile.switched_in_isr_busy = profile.isr_busy_cycles;
+}
+
+/**
+ * @brief Gets the slot of a task, stored in its FreeRTOS task number. A task is given a slot the first
+ * time it runs. The USBPD tasks are deleted and created again on detach, so a name already seen reuses its slot.
+ * @retval Slot from 1, 0 if the table is full
+ */
+UBaseType_t Profile_Task_Slot(TaskHandle_t task) {
+	UBaseType_t slot = uxTaskGetTaskNumber(task);
+
+	if ((slot != 0) && (slot <= PROFILE_MAX_TASKS)) {
+		return slot;
+	}
+
+	const char *name = pcTaskGetName(task);
+
+	for (slot = 1; slot <= profile.task_count; slot++) {
+		if (strncmp(profile.tasks[slot - 1].name, name, configMAX_TASK_NAME_LEN) == 0) {
+			break;
+		}
+	}
+
+	if (slot > profile.task_count) {
+		if (profile.task_count >= PROFILE_MAX_TASKS) {
+			return 0;
+		}
+		slot = ++profile.task_count;
+		strncpy(profile.tasks[slot - 1].name, name, configMAX_TASK_NAME_LEN - 1);
+	}
+
+	vTaskSetTaskNumber(task, slot);
+
+	return slot;
+}
+
+/**
+ * @brief traceTASK_SWITCHED_OUT hook, charges the slice less any profiled interrupt time to the task
+ */
+void Profile_Task_Switched_Out(void) {
+	UBaseType_t slot = Profile_Task_Slot(xTaskGetCurrentTaskHandle());
+
+	if (slot == 0) {
+		return;
+	}
+
+	uint32_t cycles = (Profile_Get_Cycles() - profile.switched_in_cycles) - (profile.isr_busy_cycles - profile.switched_in_isr_busy);
+	struct Profile_Task *entry = &profile.tasks[slot - 1];
+
+	entry->count++;
+	entry->total_cycles += cycles;
+	if (cycles > entry->max_cycles) {
+		entry->max_cycles = cycles;
+	}
+}
+
+/**
+ * @brief Clears all totals and maximums and starts a new measurement window. Task slots are kept.
+ */
+void Profile_Reset(void) {
+	taskENTER_CRITICAL();
+
+	for (uint8_t i = 0; i < PROFILE_MAX_TASKS; i++) {
+		profile.tasks[i].total_cycles = 0;
+		profile.tasks[i].max_cycles = 0;
+		profile.tasks[i].count = 0;
+	}
+	memset(profile.isrs, 0, sizeof(profile.isrs));
+
+	profile.window_start = Profile_Get_Cycles_64();
+
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Share of the measurement window in tenths of a percent
+ */
+uint32_t Profile_Permille(uint64_t cycles, uint64_t elapsed) {
+	if (elapsed == 0) {
+		return 0;
+	}
+	return (uint32_t)((cycles * 1000) / elapsed);
+}
+
+/**
+ * @brief Gets one line of the profile, tasks first then interrupts
+ * @param index 0 upwards
+ * @retval uint8_t 1 if entry was filled, 0 if index is past the end
+ */
+uint8_t Get_Profile_Entry(uint8_t index, struct Profile_Entry *entry) {
+	uint64_t elapsed = Profile_Get_Cycles_64() - profile.window_start;
+	uint64_t total_cycles;
+
+	if (index < profile.task_count) {
+		taskENTER_CRITICAL();
+		entry->name = profile.tasks[index].name;
+		entry->count = profile.tasks[index].count;
+		entry->max_cycles = profile.tasks[index].max_cycles;
+		total_cycles = profile.tasks[index].total_cycles;
+		taskEXIT_CRITICAL();
+	}
+	else if ((index - profile.task_count) < PROFILE_ISR_COUNT) {
+		uint8_t isr = index - profile.task_count;
+
+		taskENTER_CRITICAL();
+		entry->name = isr_names[isr];
+		entry->count = profile.isrs[isr].count;
+		entry->max_cycles = profile.isrs[isr].max_cycles;
+		total_cycles = profile.isrs[isr].total_cycles;
+		taskEXIT_CRITICAL();
+	}
+	else {
+		return 0;
+	}
+
+	entry->cpu_permille = Profile_Permille(total_cycles, elapsed);
+
+	return 1;
+}
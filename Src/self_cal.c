@@ -0,0 +1,241 @@
+/**
+ ******************************************************************************
+ * @file           : self_cal.c
+ * @brief          : Checks the MCU pack voltage channels against the regulator VBAT ADC while the pack is at rest
+ ******************************************************************************
+ */
+
+#include "self_cal.h"
+#include "adc_interface.h"
+#include "battery.h"
+#include "bq25703a_regulator.h"
+#include "error.h"
+#include "event_log.h"
+#include "string.h"
+#include <math.h>
+#include <stdlib.h>
+
+#include "task.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct Ratio_Stats {
+	float mean;
+	float m2;
+};
+
+struct Self_Cal {
+	struct Ratio_Stats battery;
+	struct Ratio_Stats stack;
+	struct Ratio_Stats cross;
+	uint32_t samples;
+	uint8_t stack_channel;
+	TickType_t last_busy_tick;
+	struct Self_Cal_Estimate estimate;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Self_Cal self_cal;
+
+/* Private function prototypes -----------------------------------------------*/
+uint8_t Self_Cal_Busy(void);
+uint32_t Get_Stack_Voltage(uint8_t channel);
+void Ratio_Stats_Add(struct Ratio_Stats *stats, float ratio, uint32_t samples);
+void Self_Cal_Estimate_Channel(struct Self_Cal_Channel *channel, const struct Ratio_Stats *stats, uint32_t samples, uint32_t vbat_uv,
+		uint32_t channel_uv, int32_t gain, int32_t offset_uv);
+void Self_Cal_Reset(void);
+
+/**
+ * @brief Checks for anything that moves the pack away from its open circuit voltage or upsets the taps
+ * @retval uint8_t 1 if the pack is not at rest
+ */
+uint8_t Self_Cal_Busy(void) {
+	return (Get_Regulator_Charging_State() != 0) || (Get_Precharge_State() != 0) || (Get_Balancing_State() != 0) ||
+			(Get_XT60_Connection_State() != CONNECTED) || (Get_Balance_Connection_State() != CONNECTED) ||
+			(Get_Regulator_Connection_State() != 1) || (Get_Error_State() != 0);
+}
+
+/**
+ * @brief Gets the reading of the tap at the top of the stack
+ * @param channel Adc_Calibration index, 1 to 4
+ * @retval Voltage in volts * BATTERY_ADC_MULTIPLIER
+ */
+uint32_t Get_Stack_Voltage(uint8_t channel) {
+	switch (channel) {
+	case 4:
+		return Get_Four_S_Voltage();
+	case 3:
+		return Get_Three_S_Voltage();
+	case 2:
+		return Get_Two_S_Voltage();
+	default:
+		return Get_Cell_Voltage(0);
+	}
+}
+
+/**
+ * @brief Welford running mean and variance
+ * @param samples Count including this one
+ */
+void Ratio_Stats_Add(struct Ratio_Stats *stats, float ratio, uint32_t samples) {
+	float delta = ratio - stats->mean;
+	stats->mean += delta / (float)samples;
+	stats->m2 += delta * (ratio - stats->mean);
+}
+
+/**
+ * @brief Turns the ratio statistics into a drift, a bound and the gain that would remove the drift. The bound is the 95%
+ * confidence of the average plus the accuracy of the regulator VBAT ADC, which is one LSB absolute and its gain error.
+ * One rest voltage cannot tell a gain error from an offset, so the whole drift is put on the gain and the calibrated
+ * offset is kept. Only the part of the reading that comes from the gain is scaled, so the correction is exact at the
+ * rest voltage and an offset error shows up away from it.
+ * @param channel_uv Reading of the channel with the calibration in use
+ * @param gain Adc_Calibration gain of the channel
+ * @param offset_uv Adc_Calibration offset of the channel
+ */
+void Self_Cal_Estimate_Channel(struct Self_Cal_Channel *channel, const struct Ratio_Stats *stats, uint32_t samples, uint32_t vbat_uv,
+		uint32_t channel_uv, int32_t gain, int32_t offset_uv) {
+	float variance = stats->m2 / (float)(samples - 1);
+	float random_bound = 2.0f * sqrtf(variance / (float)samples);
+
+	//The reference is wrong by the same amount on every sample, so it adds to the bound rather than averaging away
+	float reference_bound = (vbat_uv > 0) ? ((float)SELF_CAL_VBAT_LSB_UV / (float)vbat_uv) : 1.0f;
+	reference_bound += (float)SELF_CAL_VBAT_GAIN_ERROR_PPM / 1000000.0f;
+
+	channel->drift_ppm = (int32_t)((stats->mean - 1.0f) * 1000000.0f);
+	channel->bound_ppm = (uint32_t)((random_bound + reference_bound) * 1000000.0f);
+
+	float gain_uv = (float)channel_uv - (float)offset_uv;
+
+	if (gain_uv > 0.0f) {
+		channel->proposed_gain = (int32_t)((float)gain * (((stats->mean * (float)channel_uv) - (float)offset_uv) / gain_uv));
+	}
+	else {
+		channel->proposed_gain = gain;
+	}
+}
+
+/**
+ * @brief Drops the statistics, the last estimate is kept until it is replaced or applied
+ */
+void Self_Cal_Reset(void) {
+	memset(&self_cal.battery, 0, sizeof(self_cal.battery));
+	memset(&self_cal.stack, 0, sizeof(self_cal.stack));
+	memset(&self_cal.cross, 0, sizeof(self_cal.cross));
+	self_cal.samples = 0;
+}
+
+/**
+ * @brief Adds a sample while the pack is at rest. Called once per regulator loop after the regulator ADC is read.
+ */
+void Self_Cal_Update(void) {
+	TickType_t now = xTaskGetTickCount();
+
+	if (Self_Cal_Busy() == 1) {
+		self_cal.last_busy_tick = now;
+		self_cal.estimate.resting = 0;
+		Self_Cal_Reset();
+		return;
+	}
+
+	if ((now - self_cal.last_busy_tick) < pdMS_TO_TICKS(SELF_CAL_REST_MS)) {
+		return;
+	}
+
+	uint8_t stack_channel = Get_Number_Of_Cells();
+
+	if ((stack_channel < 1) || (stack_channel > 4)) {
+		return;
+	}
+
+	//A different pack means different taps
+	if (stack_channel != self_cal.stack_channel) {
+		self_cal.stack_channel = stack_channel;
+		Self_Cal_Reset();
+	}
+
+	uint32_t vbat_uv = Get_VBAT_ADC_Reading() * (BATTERY_ADC_MULTIPLIER / REG_ADC_MULTIPLIER);
+	uint32_t battery_uv = Get_Battery_Voltage();
+	uint32_t stack_uv = Get_Stack_Voltage(stack_channel);
+
+	if ((vbat_uv == 0) || (battery_uv == 0) || (stack_uv == 0)) {
+		return;
+	}
+
+	self_cal.samples++;
+	Ratio_Stats_Add(&self_cal.battery, (float)vbat_uv / (float)battery_uv, self_cal.samples);
+	Ratio_Stats_Add(&self_cal.stack, (float)vbat_uv / (float)stack_uv, self_cal.samples);
+	Ratio_Stats_Add(&self_cal.cross, (float)battery_uv / (float)stack_uv, self_cal.samples);
+
+	self_cal.estimate.resting = 1;
+	self_cal.estimate.samples = self_cal.samples;
+
+	if (self_cal.samples < SELF_CAL_MIN_SAMPLES) {
+		return;
+	}
+
+	struct Adc_Calibration calibration;
+	Get_ADC_Calibration(&calibration);
+
+	uint8_t was_ready = self_cal.estimate.ready;
+
+	self_cal.estimate.battery.channel = 0;
+	Self_Cal_Estimate_Channel(&self_cal.estimate.battery, &self_cal.battery, self_cal.samples, vbat_uv, battery_uv,
+			calibration.gain[0], calibration.offset_uv[0]);
+
+	self_cal.estimate.stack.channel = stack_channel;
+	Self_Cal_Estimate_Channel(&self_cal.estimate.stack, &self_cal.stack, self_cal.samples, vbat_uv, stack_uv,
+			calibration.gain[stack_channel], calibration.offset_uv[stack_channel]);
+
+	self_cal.estimate.stack_vs_battery_ppm = (int32_t)((self_cal.cross.mean - 1.0f) * 1000000.0f);
+	self_cal.estimate.ready = 1;
+
+	if ((was_ready == 0) && ((uint32_t)abs(self_cal.estimate.battery.drift_ppm) > self_cal.estimate.battery.bound_ppm)) {
+		EVENT_LOG("Self cal: battery channel drift %d ppm +/- %u", self_cal.estimate.battery.drift_ppm, self_cal.estimate.battery.bound_ppm);
+	}
+}
+
+/**
+ * @brief Gets the latest estimate
+ */
+void Get_Self_Cal_Estimate(struct Self_Cal_Estimate *estimate) {
+	memcpy(estimate, &self_cal.estimate, sizeof(struct Self_Cal_Estimate));
+}
+
+/**
+ * @brief Applies the proposed gains of the channels whose drift is larger than its bound. A channel whose present error
+ * is within what the regulator VBAT ADC can resolve is left alone, the reference would make it no better. Run save_cal
+ * to keep them.
+ * @retval uint8_t 1 if a gain was changed, 0 if there was nothing confident enough to apply
+ */
+uint8_t Self_Cal_Apply(void) {
+	struct Self_Cal_Estimate estimate;
+	struct Adc_Calibration calibration;
+	uint8_t changed = 0;
+
+	Get_Self_Cal_Estimate(&estimate);
+
+	if (estimate.ready == 0) {
+		return 0;
+	}
+
+	Get_ADC_Calibration(&calibration);
+
+	struct Self_Cal_Channel *channels[] = { &estimate.battery, &estimate.stack };
+
+	for (uint8_t i = 0; i < 2; i++) {
+		if ((channels[i]->bound_ppm <= SELF_CAL_MAX_BOUND_PPM) && ((uint32_t)abs(channels[i]->drift_ppm) > channels[i]->bound_ppm)) {
+			calibration.gain[channels[i]->channel] = channels[i]->proposed_gain;
+			changed = 1;
+		}
+	}
+
+	if ((changed == 0) || (Set_ADC_Calibration(&calibration) == 0)) {
+		return 0;
+	}
+
+	//The ratios were measured against the old gains
+	self_cal.estimate.ready = 0;
+	Self_Cal_Reset();
+
+	return 1;
+}
@@ -0,0 +1,271 @@
+/**
+ ******************************************************************************
+ * @file           : session_log.c
+ * @brief          : Records each charge session to an append only log in flash
+ ******************************************************************************
+ */
+
+#include "session_log.h"
+#include "adc_interface.h"
+#include "battery.h"
+#include "bq25703a_regulator.h"
+#include "error.h"
+#include "usbpd.h"
+#include "crc.h"
+#include "flash_write.h"
+#include "event_log.h"
+#include "string.h"
+
+#include "task.h"
+
+_Static_assert(sizeof(struct Session_Record) == SESSION_RECORD_SIZE, "Session_Record must fill a flash slot");
+
+/* Private typedef -----------------------------------------------------------*/
+struct Session {
+	struct Session_Record record;
+	uint8_t active;
+	uint64_t energy_uw_ms;
+	uint64_t charge_ma_ms;
+	TickType_t last_update_tick;
+	TickType_t last_charging_tick;
+};
+
+struct Session_Log {
+	uint16_t next_slot;
+	uint32_t next_sequence;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Session session;
+struct Session_Log session_log;
+
+/* Private function prototypes -----------------------------------------------*/
+const struct Session_Record *Session_Slot_Address(uint16_t slot);
+uint8_t Session_Slot_Blank(uint16_t slot);
+uint8_t Session_End_Reason(void);
+void Session_Start(TickType_t now);
+void Session_Close(void);
+uint8_t Session_Log_Append(struct Session_Record *record);
+
+/**
+ * @brief Gets the flash address of a record slot
+ */
+const struct Session_Record *Session_Slot_Address(uint16_t slot) {
+	return (const struct Session_Record *)(SESSION_LOG_START_ADDR + ((uint32_t)slot * SESSION_RECORD_SIZE));
+}
+
+/**
+ * @brief Checks whether a slot is still erased
+ * @retval uint8_t 1 if every byte is 0xFF, 0 if not
+ */
+uint8_t Session_Slot_Blank(uint16_t slot) {
+	const uint32_t *word = (const uint32_t *)Session_Slot_Address(slot);
+
+	for (uint8_t i = 0; i < (SESSION_RECORD_SIZE / sizeof(uint32_t)); i++) {
+		if (word[i] != 0xFFFFFFFF) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief Copies a record out of flash
+ * @param slot 0 to SESSION_LOG_SLOTS - 1
+ * @retval uint8_t 1 if the slot holds a valid record, 0 if it is blank or corrupt
+ */
+uint8_t Session_Log_Read(uint16_t slot, struct Session_Record *record) {
+	if (slot >= SESSION_LOG_SLOTS) {
+		return 0;
+	}
+
+	memcpy(record, Session_Slot_Address(slot), sizeof(struct Session_Record));
+
+	if ((record->version != SESSION_LOG_VERSION) || (record->crc != CRC16_CCITT((const uint8_t *)record, sizeof(struct Session_Record) - sizeof(record->crc)))) {
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief Gets the slot the oldest record is in. Reading SESSION_LOG_SLOTS slots from here wraps round to the newest.
+ */
+uint16_t Get_Session_Log_Oldest_Slot(void) {
+	return session_log.next_slot;
+}
+
+/**
+ * @brief Finds the newest record so appends carry on after it. Called once at boot.
+ */
+void Session_Log_Init(void) {
+	struct Session_Record record;
+	uint8_t found = 0;
+
+	session_log.next_slot = 0;
+	session_log.next_sequence = 0;
+
+	for (uint16_t slot = 0; slot < SESSION_LOG_SLOTS; slot++) {
+		if (Session_Log_Read(slot, &record) == 1) {
+			if ((found == 0) || (record.sequence >= session_log.next_sequence)) {
+				found = 1;
+				session_log.next_sequence = record.sequence + 1;
+				session_log.next_slot = (slot + 1) % SESSION_LOG_SLOTS;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Writes a record into the next slot. Erases the page being moved into, which drops the oldest records.
+ * @retval uint8_t 1 if successful, 0 if error
+ */
+uint8_t Session_Log_Append(struct Session_Record *record) {
+	uint16_t slot = session_log.next_slot;
+
+	//A slot left dirty by a reset mid write starts the next page instead
+	if (((slot % SESSION_RECORDS_PER_PAGE) != 0) && (Session_Slot_Blank(slot) == 0)) {
+		slot = ((slot / SESSION_RECORDS_PER_PAGE) + 1) * SESSION_RECORDS_PER_PAGE;
+		slot = slot % SESSION_LOG_SLOTS;
+	}
+
+	record->sequence = session_log.next_sequence;
+	record->version = SESSION_LOG_VERSION;
+	record->crc = CRC16_CCITT((const uint8_t *)record, sizeof(struct Session_Record) - sizeof(record->crc));
+
+	uint32_t address = (uint32_t)Session_Slot_Address(slot);
+	uint8_t result = 1;
+
+	if ((slot % SESSION_RECORDS_PER_PAGE) == 0) {
+		result = Flash_Erase_Page(address);
+	}
+
+	if (result == 1) {
+		result = Flash_Program(address, record, SESSION_RECORD_SIZE);
+	}
+
+	session_log.next_slot = (slot + 1) % SESSION_LOG_SLOTS;
+	session_log.next_sequence++;
+
+	return result;
+}
+
+/**
+ * @brief Works out why charging stopped
+ * @retval SESSION_END_ reason
+ */
+uint8_t Session_End_Reason(void) {
+	if (Get_XT60_Connection_State() != CONNECTED) {
+		return SESSION_END_XT60_REMOVED;
+	}
+	if (Get_Balance_Connection_State() != CONNECTED) {
+		return SESSION_END_BALANCE_REMOVED;
+	}
+	if ((Get_Input_Power_Ready() != READY) || (Get_Error_State() & VOLTAGE_INPUT_ERROR)) {
+		return SESSION_END_INPUT_LOST;
+	}
+	if (Get_Error_State() != 0) {
+		return SESSION_END_ERROR;
+	}
+	if (Get_Requires_Charging_State() == 0) {
+		return SESSION_END_COMPLETE;
+	}
+	return SESSION_END_OTHER;
+}
+
+/**
+ * @brief Snapshots the pack and the PD contract at the start of charging
+ */
+void Session_Start(TickType_t now) {
+	memset(&session, 0, sizeof(session));
+	memset(session.record.reserved, 0xFF, sizeof(session.record.reserved));
+
+	session.active = 1;
+	session.last_update_tick = now;
+	session.last_charging_tick = now;
+
+	session.record.start_ms = now * portTICK_PERIOD_MS;
+	session.record.contract_mv = (uint16_t)Get_Input_Voltage();
+	session.record.contract_ma = (uint16_t)Get_Max_Input_Current();
+	session.record.number_of_cells = Get_Number_Of_Cells();
+	session.record.peak_temperature_c = (int8_t)Get_MCU_Temperature();
+
+	for (uint8_t i = 0; i < 4; i++) {
+		session.record.start_cell_mv[i] = (uint16_t)(Get_Cell_Voltage(i) / (BATTERY_ADC_MULTIPLIER / 1000));
+	}
+}
+
+/**
+ * @brief Finishes the record and writes it to flash
+ */
+void Session_Close(void) {
+	session.active = 0;
+
+	session.record.end_ms = session.last_charging_tick * portTICK_PERIOD_MS;
+	session.record.energy_mwh = (uint32_t)(session.energy_uw_ms / 3600000000ULL);
+	session.record.charge_mah = (uint32_t)(session.charge_ma_ms / 3600000ULL);
+	session.record.error_state = Get_Error_State();
+
+	if ((session.record.end_ms - session.record.start_ms) < SESSION_MIN_DURATION_MS) {
+		return;
+	}
+
+	if (Session_Log_Append(&session.record) == 0) {
+		EVENT_LOG("Session log write failed");
+	}
+	else {
+		EVENT_LOG("Session %u recorded: %u mWh, %u mAh, reason %u", session.record.sequence, session.record.energy_mwh, session.record.charge_mah, session.record.termination_reason);
+	}
+}
+
+/**
+ * @brief Tracks the charge session. Called once per regulator loop.
+ */
+void Session_Log_Update(void) {
+	TickType_t now = xTaskGetTickCount();
+
+	uint8_t charging = (Get_Regulator_Charging_State() == 1) && (Get_XT60_Connection_State() == CONNECTED);
+
+	if (session.active == 0) {
+		if (charging) {
+			Session_Start(now);
+		}
+		return;
+	}
+
+	uint32_t dt_ms = (now - session.last_update_tick) * portTICK_PERIOD_MS;
+	session.last_update_tick = now;
+
+	uint32_t vbat_mv = Get_VBAT_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000);
+	uint32_t charge_current_ma = Get_Charge_Current_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000);
+
+	session.energy_uw_ms += (uint64_t)(vbat_mv * charge_current_ma) * dt_ms;
+	session.charge_ma_ms += (uint64_t)charge_current_ma * dt_ms;
+
+	int8_t temperature = (int8_t)Get_MCU_Temperature();
+	if (temperature > session.record.peak_temperature_c) {
+		session.record.peak_temperature_c = temperature;
+	}
+
+	if (Get_Thermal_Throttle_State() == 1) {
+		session.record.throttle_ms += dt_ms;
+	}
+
+	if (charging) {
+		session.last_charging_tick = now;
+		session.record.termination_reason = 0;
+
+		for (uint8_t i = 0; i < 4; i++) {
+			session.record.end_cell_mv[i] = (uint16_t)(Get_Cell_Voltage(i) / (BATTERY_ADC_MULTIPLIER / 1000));
+		}
+	}
+	else {
+		//Remember why charging stopped rather than the state once the debounce has run out
+		if (session.record.termination_reason == 0) {
+			session.record.termination_reason = Session_End_Reason();
+		}
+
+		if ((now - session.last_charging_tick) >= pdMS_TO_TICKS(SESSION_END_DEBOUNCE_MS)) {
+			Session_Close();
+		}
+	}
+}
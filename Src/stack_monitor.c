@@ -0,0 +1,281 @@
+/**
+ ******************************************************************************
+ * @file           : stack_monitor.c
+ * @brief          : Task stack high water marks, kept across boots, and recommended stack sizes
+ ******************************************************************************
+ */
+
+#include "stack_monitor.h"
+#include "kv_store.h"
+#include "crc.h"
+#include "event_log.h"
+#include "rtos_static.h"
+#include "string.h"
+
+#include "timers.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct Stack_Task {
+	char name[configMAX_TASK_NAME_LEN];
+	TaskHandle_t handle; // NULL while the task is deleted
+	uint16_t stack_words;
+	uint16_t used_words;
+};
+
+//Layout of KV_KEY_STACK_WORST. Tasks are matched by a CRC of their name, an unused slot has used_words 0.
+struct Stack_Record {
+	uint16_t name_crc[STACK_MONITOR_MAX_TASKS];
+	uint16_t used_words[STACK_MONITOR_MAX_TASKS];
+};
+
+_Static_assert(sizeof(struct Stack_Record) <= KV_MAX_VALUE_SIZE, "Stack_Record must fit one key value store entry");
+
+struct Stack_Monitor {
+	struct Stack_Task tasks[STACK_MONITOR_MAX_TASKS];
+	uint8_t task_count;
+	struct Stack_Record record;
+	uint8_t record_changed;
+	TickType_t last_save_tick;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Stack_Monitor stack_monitor;
+static StaticTimer_t stack_monitor_timer RTOS_SECTION(tmr, stack_monitor);
+
+/* Private function prototypes -----------------------------------------------*/
+struct Stack_Task *Stack_Find_Handle(TaskHandle_t task);
+void Stack_Sample(struct Stack_Task *task);
+uint16_t Stack_Name_CRC(const char *name);
+int8_t Stack_Record_Slot(uint16_t name_crc, uint8_t add);
+uint16_t Stack_Recommend(uint16_t used_words);
+void Stack_Monitor_Timer(TimerHandle_t timer);
+
+/**
+ * @brief Loads the worst case of the previous boots and starts the sampling timer. Called once before
+ * the scheduler starts. The table of tasks is filled by the create hook, which may already have run, so it is left alone.
+ */
+void Stack_Monitor_Init(void) {
+	if (KV_Read(KV_KEY_STACK_WORST, &stack_monitor.record, sizeof(stack_monitor.record)) == 0) {
+		memset(&stack_monitor.record, 0, sizeof(stack_monitor.record));
+	}
+	stack_monitor.record_changed = 0;
+
+	TimerHandle_t timer = xTimerCreateStatic("stacks", pdMS_TO_TICKS(STACK_MONITOR_PERIOD_MS), pdTRUE, NULL, Stack_Monitor_Timer, &stack_monitor_timer);
+	configASSERT(timer);
+	xTimerStart(timer, 0);
+}
+
+/**
+ * @brief Software timer callback, runs in the timer task every STACK_MONITOR_PERIOD_MS
+ */
+void Stack_Monitor_Timer(TimerHandle_t timer) {
+	Stack_Monitor_Update();
+}
+
+/**
+ * @brief Gets the entry of a task that currently exists
+ * @retval Entry, NULL if the task is not monitored
+ */
+struct Stack_Task *Stack_Find_Handle(TaskHandle_t task) {
+	for (uint8_t i = 0; i < stack_monitor.task_count; i++) {
+		if (stack_monitor.tasks[i].handle == task) {
+			return &stack_monitor.tasks[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief traceTASK_CREATE hook, runs inside the kernel critical section. The USBPD PE task is deleted
+ * on detach and created again on attach, so a name already seen reuses its entry.
+ * @param stack_words Size of the stack the task was created with
+ */
+void Stack_Monitor_Task_Created(void *task, uint32_t stack_words) {
+	const char *name = pcTaskGetName((TaskHandle_t)task);
+	struct Stack_Task *entry = NULL;
+
+	for (uint8_t i = 0; i < stack_monitor.task_count; i++) {
+		if (strncmp(stack_monitor.tasks[i].name, name, configMAX_TASK_NAME_LEN) == 0) {
+			entry = &stack_monitor.tasks[i];
+			break;
+		}
+	}
+
+	if (entry == NULL) {
+		if (stack_monitor.task_count >= STACK_MONITOR_MAX_TASKS) {
+			return;
+		}
+		entry = &stack_monitor.tasks[stack_monitor.task_count++];
+		strncpy(entry->name, name, configMAX_TASK_NAME_LEN - 1);
+	}
+
+	entry->handle = (TaskHandle_t)task;
+	entry->stack_words = (uint16_t)stack_words;
+}
+
+/**
+ * @brief traceTASK_DELETE hook, takes a last reading so a short lived task is not missed. The TCB and
+ * stack are static, so both are still readable after the kernel has released them.
+ */
+void Stack_Monitor_Task_Deleted(void *task) {
+	struct Stack_Task *entry = Stack_Find_Handle((TaskHandle_t)task);
+
+	if (entry == NULL) {
+		return;
+	}
+
+	Stack_Sample(entry);
+	entry->handle = NULL;
+}
+
+/**
+ * @brief Reads the high water mark of a task, which FreeRTOS finds by scanning up from the bottom of the stack
+ */
+void Stack_Sample(struct Stack_Task *task) {
+	uint16_t free_words = (uint16_t)uxTaskGetStackHighWaterMark(task->handle);
+	uint16_t used_words = (free_words < task->stack_words) ? (task->stack_words - free_words) : 0;
+
+	if (used_words > task->used_words) {
+		task->used_words = used_words;
+	}
+}
+
+/**
+ * @brief Names are stored as a CRC to keep the record inside one key value store entry
+ */
+uint16_t Stack_Name_CRC(const char *name) {
+	return CRC16_CCITT((const uint8_t *)name, strnlen(name, configMAX_TASK_NAME_LEN));
+}
+
+/**
+ * @brief Gets the slot of a task in the stored record
+ * @param add 1 to take a free slot if the task has none
+ * @retval Slot, -1 if there is none
+ */
+int8_t Stack_Record_Slot(uint16_t name_crc, uint8_t add) {
+	int8_t free_slot = -1;
+
+	for (uint8_t i = 0; i < STACK_MONITOR_MAX_TASKS; i++) {
+		if (stack_monitor.record.used_words[i] == 0) {
+			if (free_slot < 0) {
+				free_slot = i;
+			}
+		}
+		else if (stack_monitor.record.name_crc[i] == name_crc) {
+			return i;
+		}
+	}
+
+	return (add == 1) ? free_slot : -1;
+}
+
+/**
+ * @brief Worst case plus margin, rounded up to 8 words
+ */
+uint16_t Stack_Recommend(uint16_t used_words) {
+	uint16_t margin = (used_words * STACK_MONITOR_MARGIN_PERCENT) / 100;
+
+	if (margin < STACK_MONITOR_MARGIN_WORDS) {
+		margin = STACK_MONITOR_MARGIN_WORDS;
+	}
+
+	return (used_words + margin + 7) & ~7U;
+}
+
+/**
+ * @brief Samples every task and stores a new worst case
+ */
+void Stack_Monitor_Update(void) {
+	TickType_t now = xTaskGetTickCount();
+
+	//Holds off the CAD task, which deletes and creates the PE task, and Stack_Monitor_Clear in the CLI task
+	vTaskSuspendAll();
+
+	for (uint8_t i = 0; i < stack_monitor.task_count; i++) {
+		if (stack_monitor.tasks[i].handle != NULL) {
+			Stack_Sample(&stack_monitor.tasks[i]);
+		}
+	}
+
+	for (uint8_t i = 0; i < stack_monitor.task_count; i++) {
+		struct Stack_Task *task = &stack_monitor.tasks[i];
+		uint16_t name_crc = Stack_Name_CRC(task->name);
+		int8_t slot = Stack_Record_Slot(name_crc, 1);
+
+		if ((slot < 0) || (task->used_words <= stack_monitor.record.used_words[slot])) {
+			continue;
+		}
+
+		if (stack_monitor.record.used_words[slot] != 0) {
+			EVENT_LOG("Stack: task %u worst case %u of %u words", i, task->used_words, task->stack_words);
+		}
+
+		stack_monitor.record.name_crc[slot] = name_crc;
+		stack_monitor.record.used_words[slot] = task->used_words;
+		stack_monitor.record_changed = 1;
+	}
+
+	xTaskResumeAll();
+
+	if ((stack_monitor.record_changed == 1) && ((now - stack_monitor.last_save_tick) >= pdMS_TO_TICKS(STACK_MONITOR_SAVE_MS))) {
+		if (KV_Write(KV_KEY_STACK_WORST, &stack_monitor.record, sizeof(stack_monitor.record)) == 1) {
+			stack_monitor.record_changed = 0;
+		}
+		stack_monitor.last_save_tick = now;
+	}
+}
+
+/**
+ * @brief Drops the worst case kept from previous boots, so it restarts from the use since this boot.
+ * The high water marks of this boot cannot be cleared, the stacks are only filled when a task is created.
+ * @retval uint8_t 1 if successful, 0 if the flash write failed
+ */
+uint8_t Stack_Monitor_Clear(void) {
+	struct Stack_Record record;
+
+	memset(&record, 0, sizeof(record));
+
+	for (uint8_t i = 0; i < stack_monitor.task_count; i++) {
+		record.name_crc[i] = Stack_Name_CRC(stack_monitor.tasks[i].name);
+		record.used_words[i] = stack_monitor.tasks[i].used_words;
+	}
+
+	if (KV_Write(KV_KEY_STACK_WORST, &record, sizeof(record)) == 0) {
+		return 0;
+	}
+
+	taskENTER_CRITICAL();
+	memcpy(&stack_monitor.record, &record, sizeof(record));
+	stack_monitor.record_changed = 0;
+	taskEXIT_CRITICAL();
+
+	return 1;
+}
+
+/**
+ * @brief Gets the stack use and recommended size of one task
+ * @param index 0 upwards, in the order the tasks were first created
+ * @retval uint8_t 1 if entry was filled, 0 if index is past the end
+ */
+uint8_t Get_Stack_Monitor_Entry(uint8_t index, struct Stack_Monitor_Entry *entry) {
+	if (index >= stack_monitor.task_count) {
+		return 0;
+	}
+
+	struct Stack_Task *task = &stack_monitor.tasks[index];
+	int8_t slot = Stack_Record_Slot(Stack_Name_CRC(task->name), 0);
+
+	taskENTER_CRITICAL();
+	entry->name = task->name;
+	entry->stack_words = task->stack_words;
+	entry->used_words = task->used_words;
+	entry->worst_words = task->used_words;
+	if ((slot >= 0) && (stack_monitor.record.used_words[slot] > entry->worst_words)) {
+		entry->worst_words = stack_monitor.record.used_words[slot];
+	}
+	taskEXIT_CRITICAL();
+
+	entry->recommended_words = Stack_Recommend(entry->worst_words);
+
+	return 1;
+}
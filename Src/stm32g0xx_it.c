@@ -41,6 +41,8 @@
 /* USER CODE BEGIN Includes */
 #include "tracer_emb.h"
 #include "printf.h"
+#include "UARTCommandConsole.h"
+#include "profile.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -61,8 +63,6 @@
 /* Private variables ---------------------------------------------------------*/
 /* USER CODE BEGIN PV */
 
-volatile unsigned long ulHighFrequencyTimerTicks = 0;
-
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -130,19 +130,48 @@ void HardFault_Handler(void)
 /* please refer to the startup file (startup_stm32g0xx.s).                    */
 /******************************************************************************/
 
+/**
+  * @brief This function handles EXTI line 0 and line 1 interrupts.
+  */
+void EXTI0_1_IRQHandler(void)
+{
+  /* USER CODE BEGIN EXTI0_1_IRQn 0 */
+
+  /* USER CODE END EXTI0_1_IRQn 0 */
+  HAL_GPIO_EXTI_IRQHandler(PROTCHOT_Pin);
+  /* USER CODE BEGIN EXTI0_1_IRQn 1 */
+
+  /* USER CODE END EXTI0_1_IRQn 1 */
+}
+
+/**
+  * @brief This function handles EXTI line 4 to 15 interrupts.
+  */
+void EXTI4_15_IRQHandler(void)
+{
+  /* USER CODE BEGIN EXTI4_15_IRQn 0 */
+
+  /* USER CODE END EXTI4_15_IRQn 0 */
+  HAL_GPIO_EXTI_IRQHandler(CHRG_OK_Pin);
+  /* USER CODE BEGIN EXTI4_15_IRQn 1 */
+
+  /* USER CODE END EXTI4_15_IRQn 1 */
+}
+
 /**
   * @brief This function handles UCPD1 and UCPD2 interrupts / UCPD1 and UCPD2 wake-up interrupts through EXTI lines 32 and 33.
   */
 void UCPD1_2_IRQHandler(void)
 {
   /* USER CODE BEGIN UCPD1_2_IRQn 0 */
-
+  PROFILE_ISR_ENTER();
   /* USER CODE END UCPD1_2_IRQn 0 */
   /* USER CODE BEGIN UCPD1_2_IRQn 1 */
 
   extern void USBPD_PORT0_IRQHandler(void);
   USBPD_PORT0_IRQHandler();
 
+  PROFILE_ISR_EXIT(PROFILE_ISR_UCPD);
   /* USER CODE END UCPD1_2_IRQn 1 */
 }
 
@@ -152,11 +181,11 @@ void UCPD1_2_IRQHandler(void)
 void DMA1_Channel1_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel1_IRQn 0 */
-
+  PROFILE_ISR_ENTER();
   /* USER CODE END DMA1_Channel1_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_adc1);
   /* USER CODE BEGIN DMA1_Channel1_IRQn 1 */
-
+  PROFILE_ISR_EXIT(PROFILE_ISR_ADC_DMA);
   /* USER CODE END DMA1_Channel1_IRQn 1 */
 }
 
@@ -166,12 +195,12 @@ void DMA1_Channel1_IRQHandler(void)
 void DMA1_Channel2_3_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel2_3_IRQn 0 */
-
+  PROFILE_ISR_ENTER();
   /* USER CODE END DMA1_Channel2_3_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_usart1_tx);
   HAL_DMA_IRQHandler(&hdma_usart1_rx);
   /* USER CODE BEGIN DMA1_Channel2_3_IRQn 1 */
-
+  PROFILE_ISR_EXIT(PROFILE_ISR_USART_DMA);
   /* USER CODE END DMA1_Channel2_3_IRQn 1 */
 }
 
@@ -181,12 +210,12 @@ void DMA1_Channel2_3_IRQHandler(void)
 void DMA1_Ch4_7_DMAMUX1_OVR_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Ch4_7_DMAMUX1_OVR_IRQn 0 */
-
+  PROFILE_ISR_ENTER();
   /* USER CODE END DMA1_Ch4_7_DMAMUX1_OVR_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_i2c1_tx);
   HAL_DMA_IRQHandler(&hdma_i2c1_rx);
   /* USER CODE BEGIN DMA1_Ch4_7_DMAMUX1_OVR_IRQn 1 */
-
+  PROFILE_ISR_EXIT(PROFILE_ISR_I2C_DMA);
   /* USER CODE END DMA1_Ch4_7_DMAMUX1_OVR_IRQn 1 */
 }
 
@@ -225,13 +254,13 @@ void TIM7_LPTIM2_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM7_LPTIM2_IRQn 0 */
 
+  /* Extend the free running cycle counter */
+  Profile_Timer_Overflow();
+
   /* USER CODE END TIM7_LPTIM2_IRQn 0 */
   HAL_TIM_IRQHandler(&htim7);
   /* USER CODE BEGIN TIM7_LPTIM2_IRQn 1 */
 
-  /* Increment the counter used to measure execution time */
-  ulHighFrequencyTimerTicks++;
-
   /* USER CODE END TIM7_LPTIM2_IRQn 1 */
 }
 
@@ -241,7 +270,7 @@ void TIM7_LPTIM2_IRQHandler(void)
 void I2C1_IRQHandler(void)
 {
   /* USER CODE BEGIN I2C1_IRQn 0 */
-
+  PROFILE_ISR_ENTER();
   /* USER CODE END I2C1_IRQn 0 */
   if (hi2c1.Instance->ISR & (I2C_FLAG_BERR | I2C_FLAG_ARLO | I2C_FLAG_OVR)) {
     HAL_I2C_ER_IRQHandler(&hi2c1);
@@ -249,7 +278,7 @@ void I2C1_IRQHandler(void)
     HAL_I2C_EV_IRQHandler(&hi2c1);
   }
   /* USER CODE BEGIN I2C1_IRQn 1 */
-
+  PROFILE_ISR_EXIT(PROFILE_ISR_I2C);
   /* USER CODE END I2C1_IRQn 1 */
 }
 
@@ -259,11 +288,15 @@ void I2C1_IRQHandler(void)
 void USART1_IRQHandler(void)
 {
   /* USER CODE BEGIN USART1_IRQn 0 */
-
+	PROFILE_ISR_ENTER();
+	if ((__HAL_UART_GET_FLAG(&huart1, UART_FLAG_IDLE) != RESET) && (__HAL_UART_GET_IT_SOURCE(&huart1, UART_IT_IDLE) != RESET)) {
+		__HAL_UART_CLEAR_IDLEFLAG(&huart1);
+		UART_RX_Idle_Callback();
+	}
   /* USER CODE END USART1_IRQn 0 */
   HAL_UART_IRQHandler(&huart1);
   /* USER CODE BEGIN USART1_IRQn 1 */
-
+	PROFILE_ISR_EXIT(PROFILE_ISR_USART);
   /* USER CODE END USART1_IRQn 1 */
 }
 
@@ -0,0 +1,195 @@
+/**
+ ******************************************************************************
+ * @file           : telemetry.c
+ * @brief          : Streams binary telemetry frames over the UART
+ ******************************************************************************
+ */
+
+#include "telemetry.h"
+#include "adc_interface.h"
+#include "battery.h"
+#include "bq25703a_regulator.h"
+#include "error.h"
+#include "usbpd.h"
+#include "UARTCommandConsole.h"
+#include "crc.h"
+
+#include "task.h"
+
+//Worst case COBS overhead is one byte per 254 plus the delimiter
+#define TELEMETRY_ENCODED_SIZE		(sizeof(struct Telemetry_Frame) + (sizeof(struct Telemetry_Frame) / 254) + 2)
+
+/* Private typedef -----------------------------------------------------------*/
+struct Telemetry {
+	uint8_t rate_hz;
+	uint8_t sequence;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Telemetry telemetry;
+
+/* Private function prototypes -----------------------------------------------*/
+uint16_t Telemetry_COBS_Encode(const uint8_t *input, uint16_t length, uint8_t *output);
+void Telemetry_Fill_Frame(struct Telemetry_Frame *frame);
+void Telemetry_Send_Frame(void);
+
+/**
+ * @brief Sets the telemetry stream rate and wakes the telemetry task
+ * @param rate_hz Frames per second, 0 stops the stream. Limited to TELEMETRY_MAX_RATE_HZ.
+ */
+void Set_Telemetry_Rate(uint8_t rate_hz) {
+	if (rate_hz > TELEMETRY_MAX_RATE_HZ) {
+		rate_hz = TELEMETRY_MAX_RATE_HZ;
+	}
+
+	telemetry.rate_hz = rate_hz;
+
+	if (telemetryTaskHandle != NULL) {
+		xTaskNotifyGive(telemetryTaskHandle);
+	}
+}
+
+/**
+ * @brief Gets the telemetry stream rate
+ * @retval Frames per second, 0 if stopped
+ */
+uint8_t Get_Telemetry_Rate(void) {
+	return telemetry.rate_hz;
+}
+
+/**
+ * @brief COBS encodes a buffer so it contains no zero bytes and appends the 0x00 delimiter
+ * @param output Must hold at least length + length/254 + 2 bytes
+ * @retval Number of bytes written to output including the delimiter
+ */
+uint16_t Telemetry_COBS_Encode(const uint8_t *input, uint16_t length, uint8_t *output) {
+	uint16_t code_index = 0;
+	uint16_t write_index = 1;
+	uint8_t code = 1;
+
+	for (uint16_t read_index = 0; read_index < length; read_index++) {
+		if (input[read_index] == 0) {
+			output[code_index] = code;
+			code_index = write_index++;
+			code = 1;
+		}
+		else {
+			output[write_index++] = input[read_index];
+			code++;
+
+			if (code == 0xFF) {
+				output[code_index] = code;
+				code_index = write_index++;
+				code = 1;
+			}
+		}
+	}
+
+	output[code_index] = code;
+	output[write_index++] = 0x00;
+
+	return write_index;
+}
+
+/**
+ * @brief Samples the latest readings into a frame
+ */
+void Telemetry_Fill_Frame(struct Telemetry_Frame *frame) {
+	frame->version = TELEMETRY_VERSION;
+	frame->sequence = telemetry.sequence++;
+	frame->timestamp_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+	for (uint8_t i = 0; i < 4; i++) {
+		frame->cell_mv[i] = (uint16_t)(Get_Cell_Voltage(i) / (BATTERY_ADC_MULTIPLIER / 1000));
+	}
+
+	frame->vbus_mv = (uint16_t)(Get_VBUS_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000));
+	frame->vbat_mv = (uint16_t)(Get_VBAT_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000));
+	frame->input_current_ma = (uint16_t)(Get_Input_Current_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000));
+	frame->charge_current_ma = (uint16_t)(Get_Charge_Current_ADC_Reading() / (REG_ADC_MULTIPLIER / 1000));
+	frame->max_charge_current_ma = (uint16_t)Get_Max_Charge_Current();
+	frame->mcu_temperature_c = (int8_t)Get_MCU_Temperature();
+	frame->number_of_cells = Get_Number_Of_Cells();
+
+	uint8_t state = 0;
+	if (Get_XT60_Connection_State() == CONNECTED) {
+		state |= TELEMETRY_STATE_XT60;
+	}
+	if (Get_Balance_Connection_State() == CONNECTED) {
+		state |= TELEMETRY_STATE_BALANCE;
+	}
+	if (Get_Regulator_Connection_State() == 1) {
+		state |= TELEMETRY_STATE_REGULATOR;
+	}
+	if (Get_Regulator_Charging_State() == 1) {
+		state |= TELEMETRY_STATE_CHARGING;
+	}
+	if (Get_Requires_Charging_State() == 1) {
+		state |= TELEMETRY_STATE_REQUIRES_CHARGE;
+	}
+	if (Get_Precharge_State() == 1) {
+		state |= TELEMETRY_STATE_PRECHARGE;
+	}
+	if (Get_Input_Power_Ready() == READY) {
+		state |= TELEMETRY_STATE_INPUT_READY;
+	}
+	frame->state = state;
+
+	frame->balancing = Get_Balancing_State();
+	frame->error_state = Get_Error_State();
+
+	struct Error_Event event;
+	if (Error_Read_Event(&event) == 1) {
+		frame->error_event_sequence = event.sequence;
+		frame->error_event_type = event.type;
+		frame->error_event = event.error;
+		frame->error_event_ms = event.time_ms;
+	}
+	else {
+		frame->error_event_sequence = 0;
+		frame->error_event_type = ERROR_EVENT_NONE;
+		frame->error_event = 0;
+		frame->error_event_ms = 0;
+	}
+
+	frame->crc = CRC16_CCITT((const uint8_t *)frame, sizeof(struct Telemetry_Frame) - sizeof(frame->crc));
+}
+
+/**
+ * @brief Samples, encodes and queues one frame on the UART. Nothing is sent while the console is in script mode.
+ */
+void Telemetry_Send_Frame(void) {
+	struct Telemetry_Frame frame;
+	uint8_t encoded[TELEMETRY_ENCODED_SIZE];
+
+	/* A binary frame would break up the records a script reads */
+	if (UART_Get_Script_Format() != CLI_SCRIPT_OFF) {
+		return;
+	}
+
+	Telemetry_Fill_Frame(&frame);
+
+	uint16_t length = Telemetry_COBS_Encode((const uint8_t *)&frame, sizeof(frame), encoded);
+
+	UART_Transfer(encoded, length);
+}
+
+void vTelemetry(void const *pvParameters) {
+
+	TickType_t last_wake_time = xTaskGetTickCount();
+
+	for (;;) {
+		if (telemetry.rate_hz == 0) {
+			/* Stopped, sleep until Set_Telemetry_Rate is called */
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			last_wake_time = xTaskGetTickCount();
+			continue;
+		}
+
+		vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(1000 / telemetry.rate_hz));
+
+		if (telemetry.rate_hz != 0) {
+			Telemetry_Send_Frame();
+		}
+	}
+}
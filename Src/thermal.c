@@ -0,0 +1,119 @@
+/**
+ ******************************************************************************
+ * @file           : thermal.c
+ * @brief          : Thermal model of the board used to set the charge power limit
+ ******************************************************************************
+ */
+
+#include "thermal.h"
+#include "adc_interface.h"
+#include "bq25703a_regulator.h"
+#include "params.h"
+
+#include "task.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct Thermal {
+	float modelled_rise_c;
+	float loss_ratio;
+	float ambient_c;
+	uint32_t dissipated_power_mw;
+	uint32_t power_limit_mw;
+	TickType_t last_update_tick;
+	uint8_t initialized;
+};
+
+/* Private variables ---------------------------------------------------------*/
+struct Thermal thermal = {
+	.loss_ratio = (1.0f - ASSUME_EFFICIENCY) / ASSUME_EFFICIENCY,
+	.power_limit_mw = MAX_CHARGING_POWER,
+};
+
+/**
+ * @brief Gets the output power that keeps the steady state temperature at THERMAL_TARGET_C
+ * @retval Max output power in mW
+ */
+uint32_t Get_Thermal_Power_Limit(void) {
+	return thermal.power_limit_mw;
+}
+
+/**
+ * @brief Gets the power being dissipated on the board
+ * @retval Input power minus output power in mW
+ */
+uint32_t Get_Dissipated_Power(void) {
+	return thermal.dissipated_power_mw;
+}
+
+/**
+ * @brief Gets the temperature the board will settle at with the present dissipation
+ * @retval Steady state temperature in celcius
+ */
+int32_t Get_Predicted_Temperature(void) {
+	return (int32_t)(thermal.ambient_c + (THERMAL_R_C_PER_W * ((float)thermal.dissipated_power_mw / 1000.0f)));
+}
+
+/**
+ * @brief Steps the thermal model and recalculates the power limit. Called once per regulator loop.
+ * @param input_power_mw Measured input power in mW
+ * @param output_power_mw Measured output power in mW
+ */
+void Thermal_Model_Update(uint32_t input_power_mw, uint32_t output_power_mw) {
+
+	TickType_t now = xTaskGetTickCount();
+	float temperature_c = (float)Get_MCU_Temperature();
+
+	if (input_power_mw > output_power_mw) {
+		thermal.dissipated_power_mw = input_power_mw - output_power_mw;
+	}
+	else {
+		thermal.dissipated_power_mw = 0;
+	}
+
+	float dissipated_power_w = (float)thermal.dissipated_power_mw / 1000.0f;
+
+	if (thermal.initialized == 0) {
+		thermal.initialized = 1;
+		thermal.modelled_rise_c = 0.0f;
+	}
+	else {
+		//Temperature rise relaxes towards R * P with time constant tau
+		float dt_s = (float)((now - thermal.last_update_tick) * portTICK_PERIOD_MS) / 1000.0f;
+		float alpha = dt_s / THERMAL_TAU_S;
+
+		if (alpha > 1.0f) {
+			alpha = 1.0f;
+		}
+
+		thermal.modelled_rise_c += alpha * ((THERMAL_R_C_PER_W * dissipated_power_w) - thermal.modelled_rise_c);
+	}
+	thermal.last_update_tick = now;
+
+	//Whatever the model does not explain is ambient
+	thermal.ambient_c = temperature_c - thermal.modelled_rise_c;
+
+	//Learn how much of the output power ends up as heat
+	if (output_power_mw > THERMAL_MIN_LEARN_POWER_MW) {
+		float loss_ratio = (float)thermal.dissipated_power_mw / (float)output_power_mw;
+		thermal.loss_ratio += THERMAL_LOSS_FILTER * (loss_ratio - thermal.loss_ratio);
+
+		if (thermal.loss_ratio < 0.02f) {
+			thermal.loss_ratio = 0.02f;
+		}
+	}
+
+	//Dissipation that puts the steady state temperature at the target
+	float allowed_dissipation_w = ((float)THERMAL_TARGET_C - thermal.ambient_c) / THERMAL_R_C_PER_W;
+
+	if (allowed_dissipation_w < 0.0f) {
+		allowed_dissipation_w = 0.0f;
+	}
+
+	float power_limit_mw = (allowed_dissipation_w * 1000.0f) / thermal.loss_ratio;
+
+	if (power_limit_mw > params.max_charging_power_mw) {
+		power_limit_mw = params.max_charging_power_mw;
+	}
+
+	thermal.power_limit_mw = (uint32_t)power_limit_mw;
+}
@@ -33,6 +33,7 @@
 #include "battery.h"
 #include "bq25703a_regulator.h"
 #include "printf.h"
+#include "event_log.h"
 #include <stdlib.h>
 
 /* USER CODE END 0 */
@@ -52,6 +53,11 @@ struct USB_PD_Received_Source_PDO {
 	uint32_t power_mw;
 };
 
+struct USBPD_User {
+	uint8_t request_pending;
+	uint8_t hold_steps;
+};
+
 /* Private variables ---------------------------------------------------------*/
 volatile struct USB_PD_Received_Source_PDO source_pdo[USBPD_MAX_NB_PDO];
 volatile uint32_t max_source_power_mw = 0;
@@ -60,6 +66,7 @@ volatile uint8_t max_source_power_pdo = 0;
 volatile uint8_t selected_source_pdo = 0;
 volatile uint8_t power_ready = NOT_READY;
 volatile uint8_t match_found = 0;
+struct USBPD_User usbpd_user;
 
 volatile uint16_t voltage_choice_list_mv[3][VOLTAGE_CHOICE_ARRAY_SIZE] = {
 //		{9000, 12000, 15000, 5000, 20000}, //Two S voltage choice list
@@ -70,9 +77,7 @@ volatile uint16_t voltage_choice_list_mv[3][VOLTAGE_CHOICE_ARRAY_SIZE] = {
 };
 
 osMessageQId  USBPDMsgBox;
-osThreadId USBPD_User_TaskHandle;
 
-void vUSBPD_User(void const *pvParameters);
 uint8_t check_if_power_ready(void);
 
 /* USER CODE END 2 */
@@ -98,9 +103,6 @@ void MX_USBPD_Init(void)
 
   /* USER CODE BEGIN 3 */
 
-	osThreadDef(usbpd_user_app, vUSBPD_User, USBPD_TASK_PRIORITY, 0, configMINIMAL_STACK_SIZE);
-	USBPD_User_TaskHandle = osThreadCreate(osThread(usbpd_user_app), NULL);
-
   /* USER CODE END 3 */
 
 }
@@ -139,26 +141,12 @@ uint32_t Get_Input_Voltage(void) {
 	return source_pdo[selected_source_pdo].voltage_mv;
 }
 
-void vUSBPD_User(void const *pvParameters) {
-	TickType_t xDelay = 500 / portTICK_PERIOD_MS;
-	USBPD_StatusTypeDef status = USBPD_ERROR;
-
-	vTaskDelay(xDelay);
-
-/*	while (status != USBPD_OK) {
-		//status = USBPD_DPM_RequestGetSourceCapability(USBPD_PORT_0);
-		//printf("USBPD_DPM_RequestGetSourceCapability Status: %d\r\n", status);
-
-		if (status == USBPD_ERROR) {
-			//printf("USBPD Error. Sending Hard Reset\r\n");
-			//USBPD_DPM_RequestHardReset(USBPD_PORT_0);
-		}
-
-		vTaskDelay(xDelay);
-	}
-*/
+/**
+ * @brief Reads the source PDOs received at attach. Called once by the control executive before its first frame.
+ */
+void USBPD_User_Init(void) {
 
-	printf("Number of received Source PDOs: %d\r\n", DPM_Ports[USBPD_PORT_0].DPM_NumberOfRcvSRCPDO);
+	EVENT_LOG("Number of received Source PDOs: %d", DPM_Ports[USBPD_PORT_0].DPM_NumberOfRcvSRCPDO);
 
 	USBPD_PDO_TypeDef srcpdo;
 	uint32_t nbsnkpdo;
@@ -167,9 +155,10 @@ void vUSBPD_User(void const *pvParameters) {
 
 	for (int i = 0; i < DPM_Ports[USBPD_PORT_0].DPM_NumberOfRcvSRCPDO; i++) {
 
-		printf("PDO From Source: #%d PDO: %d  ", i, DPM_Ports[USBPD_PORT_0].DPM_ListOfRcvSRCPDO[i]);
-
 		srcpdo.d32 = DPM_Ports[USBPD_PORT_0].DPM_ListOfRcvSRCPDO[i];
+
+		EVENT_LOG("PDO From Source: #%d PDO: 0x%08x Type: %u", i, srcpdo.d32, srcpdo.GenericPDO.PowerObject);
+
 		switch(srcpdo.GenericPDO.PowerObject)
 		{
 			/* SRC Fixed Supply PDO */
@@ -185,98 +174,108 @@ void vUSBPD_User(void const *pvParameters) {
 			  break;
 //			/* SRC Variable Supply (non-battery) PDO */
 			case USBPD_CORE_PDO_TYPE_VARIABLE:
-				printf("USBPD_CORE_PDO_TYPE_VARIABLE ");
 //			  srcmaxvoltage50mv = srcpdo.SRCVariablePDO.MaxVoltageIn50mVunits;
 //			  srcminvoltage50mv = srcpdo.SRCVariablePDO.MinVoltageIn50mVunits;
 //			  srcmaxcurrent10ma = srcpdo.SRCVariablePDO.MaxCurrentIn10mAunits;
 			  break;
 //			/* SRC Battery Supply PDO */
 			case USBPD_CORE_PDO_TYPE_BATTERY:
-				printf("USBPD_CORE_PDO_TYPE_BATTERY ");
 //			  srcmaxvoltage50mv = srcpdo.SRCBatteryPDO.MaxVoltageIn50mVunits;
 //			  srcminvoltage50mv = srcpdo.SRCBatteryPDO.MinVoltageIn50mVunits;
 //			  srcmaxpower250mw  = srcpdo.SRCBatteryPDO.MaxAllowablePowerIn250mWunits;
 			  break;
 //			/* Augmented Power Data Object (APDO) */
 			case USBPD_CORE_PDO_TYPE_APDO:
-				printf("USBPD_CORE_PDO_TYPE_BATTERY ");
 //				srcmaxvoltage100mv = srcpdo.SRCSNKAPDO.MaxVoltageIn100mV;
 //				srcmaxcurrent50ma = srcpdo.SRCSNKAPDO.MaxCurrentIn50mAunits;
 				break;
 		    default:
 		      break;
 		}
-		printf("Voltage: %dmV  Current: %dmA  Power: %dmW\r\n", source_pdo[i].voltage_mv, source_pdo[i].current_ma, source_pdo[i].power_mw);
+		EVENT_LOG("Voltage: %dmV  Current: %dmA  Power: %dmW", source_pdo[i].voltage_mv, source_pdo[i].current_ma, source_pdo[i].power_mw);
 	}
 
 	if (DPM_Ports[USBPD_PORT_0].DPM_NumberOfRcvSRCPDO == 0) {
 		power_ready = NO_USB_PD_SUPPLY;
-		for(;;) {
-			vTaskDelay(xDelay);
+	}
+}
+
+/**
+ * @brief Decide and actuate stage for the input contract. Picks the source PDO for the highest regulator
+ * efficiency and requests it. The result of a request is checked on the next call instead of being waited on.
+ */
+void USBPD_User_Update(void) {
+	USBPD_StatusTypeDef status = USBPD_ERROR;
+
+	if (power_ready == NO_USB_PD_SUPPLY) {
+		return;
+	}
+
+	if (usbpd_user.hold_steps > 0) {
+		usbpd_user.hold_steps--;
+		return;
+	}
+
+	if (usbpd_user.request_pending == 1) {
+		usbpd_user.request_pending = 0;
+		if (check_if_power_ready() != READY) {
+			EVENT_LOG("Result: Waiting for input voltage to be ready");
+			power_ready = NOT_READY;
+		}
+		else {
+			EVENT_LOG("Result: Success");
+			power_ready = READY;
 		}
+		return;
 	}
 
-	for (;;) {
-
-		//Find the best PDO from the source for the highest regulator efficiency
-		if ((Get_XT60_Connection_State() == CONNECTED)) { // Changing from balance connection to XT60 connection
-			if (match_found == 0) {
-				for (int i = 0; i < VOLTAGE_CHOICE_ARRAY_SIZE; i++) {
-					for (int t = 0; t < DPM_Ports[USBPD_PORT_0].DPM_NumberOfRcvSRCPDO; t++) {
-						if (voltage_choice_list_mv[Get_Number_Of_Cells() - 2][i] == source_pdo[t].voltage_mv) {
-							printf("Voltage match found: %d\r\n", source_pdo[t].voltage_mv);
-							selected_source_pdo = t;
-							match_found = 1;
-							break;
-						}
-					}
-					if (match_found != 0) {
+	//Find the best PDO from the source for the highest regulator efficiency
+	if ((Get_XT60_Connection_State() == CONNECTED)) { // Changing from balance connection to XT60 connection
+		if (match_found == 0) {
+			for (int i = 0; i < VOLTAGE_CHOICE_ARRAY_SIZE; i++) {
+				for (int t = 0; t < DPM_Ports[USBPD_PORT_0].DPM_NumberOfRcvSRCPDO; t++) {
+					if (voltage_choice_list_mv[Get_Number_Of_Cells() - 2][i] == source_pdo[t].voltage_mv) {
+						EVENT_LOG("Voltage match found: %d", source_pdo[t].voltage_mv);
+						selected_source_pdo = t;
+						match_found = 1;
 						break;
 					}
 				}
+				if (match_found != 0) {
+					break;
+				}
 			}
 		}
+	}
+	else {
+		match_found = 0;
+	}
+
+	if ((Get_XT60_Connection_State() == CONNECTED) && (Get_Balance_Connection_State() == CONNECTED) && (power_ready == NOT_READY) && (match_found == 1) && (Get_Requires_Charging_State() == 1)) {
+		EVENT_LOG("Requesting %dV", (source_pdo[selected_source_pdo].voltage_mv/1000));
+		status = USBPD_DPM_RequestMessageRequest(USBPD_PORT_0, (selected_source_pdo + 1), (uint16_t)source_pdo[selected_source_pdo].voltage_mv);
+		if (status == USBPD_OK) {
+			usbpd_user.request_pending = 1;
+		}
 		else {
-			match_found = 0;
+			EVENT_LOG("Result: Failed");
+			power_ready = NOT_READY;
 		}
-
-		if ((Get_XT60_Connection_State() == CONNECTED) && (Get_Balance_Connection_State() == CONNECTED) && (power_ready == NOT_READY) && (match_found == 1) && (Get_Requires_Charging_State() == 1)) {
-			printf("Requesting %dV, Result: ", (source_pdo[selected_source_pdo].voltage_mv/1000));
-			status = USBPD_DPM_RequestMessageRequest(USBPD_PORT_0, (selected_source_pdo + 1), (uint16_t)source_pdo[selected_source_pdo].voltage_mv);
-			vTaskDelay(400 / portTICK_PERIOD_MS);
+	}
+	else if ((Get_XT60_Connection_State() == NOT_CONNECTED) || (Get_Balance_Connection_State() == NOT_CONNECTED)){
+		if (Get_VBUS_ADC_Reading() > (6 * REG_ADC_MULTIPLIER)) {
+			EVENT_LOG("Requesting 5V");
+			selected_source_pdo = 0;
+			status = USBPD_DPM_RequestMessageRequest(USBPD_PORT_0, selected_source_pdo + 1, (uint16_t)source_pdo[selected_source_pdo].voltage_mv);
 			if (status == USBPD_OK) {
-				if (check_if_power_ready() != READY) {
-					printf("Waiting for input voltage to be ready\r\n");
-					power_ready = NOT_READY;
-				}
-				else {
-					printf("Success\r\n");
-					power_ready = READY;
-				}
+				EVENT_LOG("Result: Success");
 			}
 			else {
-				printf("Failed\r\n");
-				power_ready = NOT_READY;
+				EVENT_LOG("Result: Failed");
 			}
 		}
-		else if ((Get_XT60_Connection_State() == NOT_CONNECTED) || (Get_Balance_Connection_State() == NOT_CONNECTED)){
-			if (Get_VBUS_ADC_Reading() > (6 * REG_ADC_MULTIPLIER)) {
-				printf("Requesting 5V, Result: ");
-				selected_source_pdo = 0;
-				status = USBPD_DPM_RequestMessageRequest(USBPD_PORT_0, selected_source_pdo + 1, (uint16_t)source_pdo[selected_source_pdo].voltage_mv);
-				vTaskDelay(100 / portTICK_PERIOD_MS);
-				if (status == USBPD_OK) {
-					printf("Success\r\n");
-				}
-				else {
-					printf("Failed\r\n");
-				}
-			}
-			power_ready = NOT_READY;
-			vTaskDelay(1000 / portTICK_PERIOD_MS);
-		}
-
-		vTaskDelay(xDelay);
+		power_ready = NOT_READY;
+		usbpd_user.hold_steps = USBPD_USER_IDLE_HOLD_STEPS;
 	}
 }
 
@@ -28,6 +28,7 @@
 #include "usbpd_dpm_user.h"
 #include "usbpd_dpm_conf.h"
 #include "cmsis_os.h"
+#include "rtos_static.h"
 
 /* Private enum */
 enum {
@@ -45,19 +46,26 @@ extern uint32_t HAL_GetTick(void);
 void USBPD_DPM_CADCallback(uint8_t PortNum, USBPD_CAD_EVENT State, CCxPin_TypeDef Cc);
 void USBPD_PE_Task(void const *argument);
 void USBPD_CAD_Task(void const *argument);
-void USBPD_TRACE_TX_Task(void const *argument);
 
 static void USBPD_PE_TaskWakeUp(uint8_t PortNum);
 static void USBPD_DPM_CADTaskWakeUp(void);
 
 /* Private typedef -----------------------------------------------------------*/
-osThreadDef(PE_0, USBPD_PE_Task, osPriorityHigh, 0, 200);
-osThreadDef(PE_1, USBPD_PE_Task, osPriorityHigh, 0, 200);
+/* The PE task is deleted on detach and created again in the same memory on attach. It is deleted
+   from the CAD task, so the kernel releases it at once rather than leaving it to the idle task. */
+osThreadStaticMemDef(PE_0, USBPD_PE_Task, osPriorityHigh, 200);
+#if USBPD_PORT_COUNT == 2
+osThreadStaticMemDef(PE_1, USBPD_PE_Task, osPriorityHigh, 200);
+#endif /* USBPD_PORT_COUNT == 2 */
 
 /* Private define ------------------------------------------------------------*/
 #define MAX_TREAD_POWER   (USBPD_PORT_COUNT + 1)
 
+#if USBPD_PORT_COUNT == 2
 #define OSTHREAD_PE(__VAL__) __VAL__==USBPD_PORT_0?osThread(PE_0):osThread(PE_1)
+#else
+#define OSTHREAD_PE(__VAL__) osThread(PE_0)
+#endif /* USBPD_PORT_COUNT == 2 */
 
 /* Private macro -------------------------------------------------------------*/
 #define CHECK_PE_FUNCTION_CALL(_function_)  if(USBPD_OK != _function_) {return USBPD_ERROR;}
@@ -66,8 +74,11 @@ osThreadDef(PE_1, USBPD_PE_Task, osPriorityHigh, 0, 200);
 /* Private variables ---------------------------------------------------------*/
 static uint32_t DPM_Sleep_time[MAX_TREAD_POWER];
 static osThreadId DPM_Thread_Table[MAX_TREAD_POWER];
-osMessageQDef(queuePE, 2, uint16_t);
-osMessageQDef(queueCAD, 1, uint16_t);
+osMessageQStaticMemDef(queuePE_0, 2, uint16_t);
+#if USBPD_PORT_COUNT == 2
+osMessageQStaticMemDef(queuePE_1, 2, uint16_t);
+#endif /* USBPD_PORT_COUNT == 2 */
+osMessageQStaticMemDef(queueCAD, 1, uint16_t);
 static osMessageQId PEQueueId[USBPD_PORT_COUNT], CADQueueId;
 
 USBPD_ParamsTypeDef   DPM_Params[USBPD_PORT_COUNT];
@@ -181,25 +192,17 @@ static const USBPD_PE_Callbacks dpmCallbacks =
   */
 USBPD_StatusTypeDef USBPD_DPM_InitOS(void)
 {
-  osThreadDef(CAD, USBPD_CAD_Task, osPriorityRealtime, 0, 300);
+  osThreadStaticMemDef(CAD, USBPD_CAD_Task, osPriorityRealtime, 300);
   if((DPM_Thread_Table[USBPD_THREAD_CAD] = osThreadCreate(osThread(CAD), NULL)) == NULL)
   {
     return USBPD_ERROR;
   }
   CADQueueId = osMessageCreate(osMessageQ(queueCAD), NULL);
 
-  #if defined(_TRACE)
-    osThreadDef(TRA_TX, USBPD_TRACE_TX_Task, osPriorityLow, 0, configMINIMAL_STACK_SIZE * 2);
-    if(NULL == osThreadCreate(osThread(TRA_TX), NULL))
-    {
-      return USBPD_ERROR;
-    }
-  #endif
-
   /* Create the queue corresponding to PE task */
-  PEQueueId[0] = osMessageCreate(osMessageQ(queuePE), NULL);
+  PEQueueId[0] = osMessageCreate(osMessageQ(queuePE_0), NULL);
 #if USBPD_PORT_COUNT == 2
-  PEQueueId[1] = osMessageCreate(osMessageQ(queuePE), NULL);
+  PEQueueId[1] = osMessageCreate(osMessageQ(queuePE_1), NULL);
 #endif /* USBPD_PORT_COUNT == 2 */
 
   /* PE task to be created on attachment */
@@ -327,21 +330,17 @@ void USBPD_CAD_Task(void const *argument)
   }
 }
 
+#if defined(_TRACE)
 /**
-  * @brief  Main task for TRACE TX layer
-  * @param  argument Not used
+  * @brief  Drains the TRACE TX layer whenever the core is idle, instead of a task polling every 5 ms.
+  *         The UART DMA interrupt wakes the idle task again while data remains.
   * @retval None
   */
-void USBPD_TRACE_TX_Task(void const *argument)
+void vApplicationIdleHook(void)
 {
-  for(;;)
-  {
-    #if defined(_TRACE)
-      (void)USBPD_TRACE_TX_Process();
-    #endif
-    osDelay(5);
-  }
+  (void)USBPD_TRACE_TX_Process();
 }
+#endif /* _TRACE */
 
 /**
   * @brief  CallBack reporting events on a specified port from CAD layer.
@@ -401,7 +400,7 @@ static void DPM_ManageAttachedState(uint8_t PortNum, USBPD_CAD_EVENT State, CCxP
     DPM_Thread_Table[PortNum] = osThreadCreate(OSTHREAD_PE(PortNum), (void *)((uint32_t)PortNum));
     if (DPM_Thread_Table[PortNum] == NULL)
     {
-      /* should not occurr. May be an issue with FreeRTOS heap size too small */
+      /* should not occurr, the task memory is static */
       while(1);
     }
   }
@@ -35,6 +35,7 @@
 #include "usbpd_pwr_if.h"
 #include "string.h"
 #include "cmsis_os.h"
+#include "rtos_static.h"
 #include "printf.h"
 
 /** @addtogroup STM32_USBPD_LIBRARY
@@ -165,9 +166,9 @@ USBPD_StatusTypeDef USBPD_DPM_UserInit(void)
     return USBPD_ERROR;
   }
 #endif /* USBPD_PORT_COUNT == 2 */
-  osMessageQDef(MsgBox, DPM_BOX_MESSAGES_MAX, uint32_t);
+  osMessageQStaticMemDef(MsgBox, DPM_BOX_MESSAGES_MAX, uint32_t);
   DPMMsgBox = osMessageCreate(osMessageQ(MsgBox), NULL);
-  osThreadDef(DPM, USBPD_DPM_UserExecute, osPriorityLow, 0, 300);
+  osThreadStaticMemDef(DPM, USBPD_DPM_UserExecute, osPriorityLow, 300);
 
   if(NULL == osThreadCreate(osThread(DPM), &DPMMsgBox))
   {
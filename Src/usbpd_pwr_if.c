@@ -33,6 +33,7 @@
 #include "string.h"
 #include <stdio.h>
 #include "cmsis_os.h"
+#include "rtos_static.h"
 
 #include "main.h"
 
@@ -103,6 +104,7 @@
 uint8_t                  safety_contract = 0;
 USBPD_PDO_TypeDef        safety_pdo;
 USBPD_SNKRDO_TypeDef     safety_rdo;
+static osTimerId         safety_timer = NULL;
 
 /**
   * @brief  USBPD Port PDO Storage array declaration
@@ -140,6 +142,7 @@ uint32_t _PWR_ProgrammablePowerSupplyAPDO(float _MAXC_,float _MINV_,float _MAXV_
 
 /* Private functions ---------------------------------------------------------*/
 void USBPD_PWR_IF_MonitorSafety(void const *argument);
+static void PWR_IF_SafetyContract(uint8_t Contract);
 
 /**
   * @brief  Initialize structures and variables related to power board profiles
@@ -246,14 +249,49 @@ USBPD_StatusTypeDef USBPD_PWR_IF_Init(void)
 
 USBPD_StatusTypeDef USBPD_PWR_IF_StartMonitoring(void)
 {
-  osThreadDef(SAFE, USBPD_PWR_IF_MonitorSafety, osPriorityLow, 0, 100);
-  if(NULL == osThreadCreate(osThread(SAFE), NULL))
+  /* The monitor checks the current sourced against the contract. It is a software timer that only
+     runs while a source contract is in place, a sink only port never starts it. */
+#if defined(_SRC) || defined(_DRP)
+  osTimerStaticMemDef(SAFE, USBPD_PWR_IF_MonitorSafety);
+  safety_timer = osTimerCreate(osTimer(SAFE), osTimerPeriodic, NULL);
+  if(NULL == safety_timer)
   {
     return USBPD_ERROR;
   }
+#if USBPD_PORT_COUNT == 2
+  /* Port 1 is checked whatever the contract on port 0 */
+  osTimerStart(safety_timer, USBPD_PWR_IF_SAFETY_PERIOD_MS);
+#endif /* USBPD_PORT_COUNT == 2 */
+#endif /* _SRC || _DRP */
   return USBPD_OK;
 }
 
+/**
+  * @brief  Records whether a source contract is in place and runs the safety monitor only while it is
+  * @param  Contract 1 when VBUS is sourced to a contract, 0 when it is off
+  * @retval None
+  */
+static void PWR_IF_SafetyContract(uint8_t Contract)
+{
+  safety_contract = Contract;
+
+  if (NULL == safety_timer)
+  {
+    return;
+  }
+
+  if (1 == Contract)
+  {
+    osTimerStart(safety_timer, USBPD_PWR_IF_SAFETY_PERIOD_MS);
+  }
+#if USBPD_PORT_COUNT == 1
+  else
+  {
+    osTimerStop(safety_timer);
+  }
+#endif /* USBPD_PORT_COUNT == 1 */
+}
+
 /**
   * @brief  Sets the required power profile, now it works only with Fixed ones
   * @param  PortNum Port number
@@ -365,7 +403,7 @@ USBPD_StatusTypeDef USBPD_PWR_IF_SetProfile(uint8_t PortNum)
     return USBPD_FAIL;
   else
   {
-    safety_contract = 1;
+    PWR_IF_SafetyContract(1);
     return USBPD_OK;
   }
 }
@@ -479,7 +517,7 @@ USBPD_StatusTypeDef USBPD_PWR_IF_VBUSDisable(uint8_t PortNum)
   /* Safety add On */
   if(0 == PortNum)
   {
-    safety_contract = 0;
+    PWR_IF_SafetyContract(0);
   }
 
   return  _status;
@@ -952,8 +990,9 @@ USBPD_StatusTypeDef USBPD_PWR_IF_CheckUpdateSNKPower(uint8_t PortNum)
 }
 
 /**
-  * @brief  Manage the Safety to avoid material issue, it the current execed the limitation an alarm is set
-  * @param  None
+  * @brief  Manage the Safety to avoid material issue, it the current execed the limitation an alarm is set.
+  *         Software timer callback, runs every USBPD_PWR_IF_SAFETY_PERIOD_MS while a source contract is in place.
+  * @param  argument Timer handle, unused
   * @retval None
   */
 void USBPD_PWR_IF_MonitorSafety(void const *argument)
@@ -961,54 +1000,49 @@ void USBPD_PWR_IF_MonitorSafety(void const *argument)
   uint32_t _MaxOperatingCurrent = 1000;
   int32_t isense_safety[2];
 
-  for(;;) /* infinite loop to monitore the current from port 0 */
-  {
-    /* Monitor the current for the SRC power PORT0 */
-    isense_safety[USBPD_PORT_0] = BSP_PWR_VBUSGetCurrent(USBPD_PORT_0);
+  /* Monitor the current for the SRC power PORT0 */
+  isense_safety[USBPD_PORT_0] = BSP_PWR_VBUSGetCurrent(USBPD_PORT_0);
 
-    if ((DPM_Params[USBPD_PORT_0].PE_IsConnected == USBPD_TRUE) && (USBPD_PORTPOWERROLE_SRC == DPM_Params[USBPD_PORT_0].PE_PowerRole)
-        && (1 == safety_contract))
+  if ((DPM_Params[USBPD_PORT_0].PE_IsConnected == USBPD_TRUE) && (USBPD_PORTPOWERROLE_SRC == DPM_Params[USBPD_PORT_0].PE_PowerRole)
+      && (1 == safety_contract))
+  {
+    /* check if we are aligned with the limitation done by the SINK */
+    switch(safety_pdo.GenericPDO.PowerObject)
     {
-      /* check if we are aligned with the limitation done by the SINK */
-      switch(safety_pdo.GenericPDO.PowerObject)
+    case USBPD_CORE_PDO_TYPE_FIXED :
+    case USBPD_CORE_PDO_TYPE_VARIABLE :
       {
-      case USBPD_CORE_PDO_TYPE_FIXED :
-      case USBPD_CORE_PDO_TYPE_VARIABLE :
-        {
-          _MaxOperatingCurrent = safety_rdo.FixedVariableRDO.MaxOperatingCurrent10mAunits * 10;
-          break;
-        }
+        _MaxOperatingCurrent = safety_rdo.FixedVariableRDO.MaxOperatingCurrent10mAunits * 10;
+        break;
+      }
 #if defined(USBPD_REV30_SUPPORT)
-      case USBPD_CORE_PDO_TYPE_APDO :
-        {
-          _MaxOperatingCurrent    = safety_rdo.ProgRDO.OperatingCurrentIn50mAunits * 50;
-          break;
-        }
+    case USBPD_CORE_PDO_TYPE_APDO :
+      {
+        _MaxOperatingCurrent    = safety_rdo.ProgRDO.OperatingCurrentIn50mAunits * 50;
+        break;
+      }
 #endif
-      default :
-        {
-        }
+    default :
+      {
       }
     }
+  }
 
-    if(ABS(isense_safety[USBPD_PORT_0]) > (_MaxOperatingCurrent*1.1 +100))
-    {
-      USBPD_PWR_IF_Alarm();
-    }
+  if(ABS(isense_safety[USBPD_PORT_0]) > (_MaxOperatingCurrent*1.1 +100))
+  {
+    USBPD_PWR_IF_Alarm();
+  }
 
 #if USBPD_PORT_COUNT == 2
-    /* Monitor the current for the SNK power PORT1 */
-    isense_safety[USBPD_PORT_1] = BSP_PWR_VBUSGetCurrent(USBPD_PORT_1);
+  /* Monitor the current for the SNK power PORT1 */
+  isense_safety[USBPD_PORT_1] = BSP_PWR_VBUSGetCurrent(USBPD_PORT_1);
 
-    /* check if we are aligned with the limitation done by the SINK */
-    if (ABS(isense_safety[USBPD_PORT_1]) > 1000)
-    {
-      USBPD_PWR_IF_Alarm();
-    }
-#endif
-
-    osDelay(1);
+  /* check if we are aligned with the limitation done by the SINK */
+  if (ABS(isense_safety[USBPD_PORT_1]) > 1000)
+  {
+    USBPD_PWR_IF_Alarm();
   }
+#endif
 }
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Formats LiPow event log records using the format strings stored in the ELF.
+
+Needed with the default build, EVENT_LOG_FORMAT_ON_DEVICE 0. The event log
+task then prints raw lines of the form
+
+    #EVT <timestamp_ms> <fmt_offset> <nargs> <arg0> <arg1> <arg2> <arg3>
+
+where fmt_offset is the address of the format string inside the unloaded
+.event_log_fmt section. Every other line is passed through untouched.
+
+Requires pyelftools, and pyserial when reading from a port.
+
+Examples:
+    event_log_decode.py --elf build/Lipow.elf --port /dev/ttyUSB0
+    event_log_decode.py --elf build/Lipow.elf < console.log
+"""
+
+import argparse
+import re
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+SECTION_NAME = ".event_log_fmt"
+
+# C integer conversions to their Python equivalents, length modifiers dropped
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|t)?([diuxXoc%])")
+
+
+def load_formats(elf_path):
+    with open(elf_path, "rb") as elf_file:
+        section = ELFFile(elf_file).get_section_by_name(SECTION_NAME)
+        if section is None:
+            sys.exit("%s has no %s section, was it built with EVENT_LOG_FORMAT_ON_DEVICE 0?" % (elf_path, SECTION_NAME))
+        return section["sh_addr"], section.data()
+
+
+def format_string_at(formats, offset):
+    base, data = formats
+    start = offset - base
+    if start < 0 or start >= len(data):
+        return None
+    end = data.find(b"\x00", start)
+    return data[start:end].decode("ascii", "replace")
+
+
+def to_signed(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def format_event(fmt, args):
+    values = iter(args)
+
+    def substitute(match):
+        flags, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        value = next(values, 0)
+        if conversion in "di":
+            value = to_signed(value)
+        elif conversion == "u":
+            conversion = "d"
+        elif conversion == "c":
+            value = chr(value & 0xFF)
+        return ("%" + flags + conversion) % value
+
+    return CONVERSION.sub(substitute, fmt)
+
+
+def decode_line(formats, line):
+    fields = line.split()
+    if len(fields) != 8 or fields[0] != "#EVT":
+        return line
+
+    timestamp_ms = int(fields[1])
+    offset = int(fields[2], 16)
+    nargs = int(fields[3])
+    args = [int(field, 16) for field in fields[4:4 + nargs]]
+
+    fmt = format_string_at(formats, offset)
+    if fmt is None:
+        return "[%u] <unknown event 0x%x> %s" % (timestamp_ms, offset, " ".join(fields[4:4 + nargs]))
+
+    return "[%u] %s" % (timestamp_ms, format_event(fmt, args))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--elf", required=True, help="firmware ELF the device is running")
+    parser.add_argument("--port", help="serial port to read, stdin if omitted")
+    parser.add_argument("--baud", type=int, default=921600)
+    args = parser.parse_args()
+
+    formats = load_formats(args.elf)
+
+    if args.port:
+        import serial
+        port = serial.Serial(args.port, args.baud, timeout=1)
+        lines = (raw.decode("ascii", "replace") for raw in iter(port.readline, None))
+    else:
+        lines = sys.stdin
+
+    try:
+        for line in lines:
+            if line:
+                print(decode_line(formats, line.rstrip("\r\n")))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
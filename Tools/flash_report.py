@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+Prints the LiPow flash budget from the linker map file.
+
+Run by the Makefile after every link. The code and constants of each object
+file are summed from the map, so the cost of a module or library member can
+be compared between builds. The text formatting group adds up printf, the
+FMT emitters and the double precision soft float routines that %f pulls in
+from libgcc, to compare a build with FMT_BENCHMARK set to 1 against one with
+it at 0 (see Inc/fmt.h).
+
+Examples:
+    flash_report.py build/Lipow.map
+    flash_report.py build/Lipow.map --top 40
+"""
+
+import argparse
+import re
+import sys
+
+FLASH_REGION = "FLASH"
+FLASH_SECTIONS = [".isr_vector", ".text", ".rodata", ".ARM.extab", ".ARM", ".preinit_array", ".init_array",
+                  ".fini_array", ".data"]
+
+FORMATTING = [
+    ("printf", re.compile(r"(^|/)printf\.o$")),
+    ("fmt", re.compile(r"(^|/)fmt\.o$")),
+    ("soft float double", re.compile(r"libgcc\.a\(.*df.*\.o\)$")),
+]
+
+MEMORY_LINE = re.compile(r"^(\w+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+SECTION_LINE = re.compile(r"^(\s?)(\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+(\S+))?")
+
+
+def read_map(map_path):
+    """Returns the flash length, the flash output section sizes and the bytes of each object file"""
+    flash_length = None
+    outputs = {}
+    objects = {}
+    current = None
+    pending_name = None
+
+    with open(map_path) as map_file:
+        lines = map_file.read().splitlines()
+
+    in_memory = False
+    for line in lines:
+        if line.startswith("Memory Configuration"):
+            in_memory = True
+            continue
+        if in_memory:
+            if line.startswith("Linker script and memory map"):
+                in_memory = False
+            match = MEMORY_LINE.match(line)
+            if match and match.group(1) == FLASH_REGION:
+                flash_length = int(match.group(3), 16)
+            continue
+
+        # Long section names are printed alone with the address and size on the next line
+        if pending_name is not None and line.startswith("  "):
+            line = pending_name + line
+            pending_name = None
+        elif re.match(r"^\s?\S+$", line) and not line.strip().startswith("*"):
+            pending_name = line
+            continue
+        else:
+            pending_name = None
+
+        match = SECTION_LINE.match(line)
+        if not match or match.group(2) is None:
+            continue
+
+        indent, name, size, obj = match.group(1), match.group(2), int(match.group(4), 16), match.group(5)
+        if indent == "":
+            current = name if name in FLASH_SECTIONS else None
+            if current is not None:
+                outputs[current] = size
+        elif current is not None and size > 0 and obj is not None and not name.startswith("*"):
+            objects[obj] = objects.get(obj, 0) + size
+
+    if flash_length is None:
+        sys.exit("%s has no %s memory region" % (map_path, FLASH_REGION))
+
+    return flash_length, outputs, objects
+
+
+def short_name(obj):
+    """Drops the directories, keeping the archive an object came out of"""
+    return obj.split("/")[-1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--top", type=int, default=20, help="number of object files to list")
+    args = parser.parse_args()
+
+    flash_length, outputs, objects = read_map(args.map)
+    used = sum(outputs.values())
+
+    print("Flash budget, %u bytes" % flash_length)
+    for section in FLASH_SECTIONS:
+        size = outputs.get(section, 0)
+        if size > 0:
+            print("  %-20s %6u  %5.1f%%" % (section, size, 100.0 * size / flash_length))
+    print("  %-20s %6u  %5.1f%%" % ("free", flash_length - used, 100.0 * (flash_length - used) / flash_length))
+
+    print("\nText formatting")
+    total = 0
+    for group, pattern in FORMATTING:
+        size = sum(size for obj, size in objects.items() if pattern.search(obj))
+        total += size
+        print("  %-26s %6u" % (group, size))
+    print("  %-26s %6u" % ("total", total))
+
+    print("\nLargest object files")
+    for obj, size in sorted(objects.items(), key=lambda item: -item[1])[:args.top]:
+        print("  %-40s %6u" % (short_name(obj), size))
+
+
+if __name__ == "__main__":
+    main()
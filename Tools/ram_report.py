@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Prints the LiPow RAM budget from the linker map file.
+
+Run by the Makefile after every link. All FreeRTOS task stacks, TCBs and queue
+storage are static and linked into the .rtos section, one input section per
+object named .rtos.<kind>.<name> (see Inc/rtos_static.h), so each is listed
+by name. The largest .data and .bss objects follow, then the space left.
+
+Examples:
+    ram_report.py build/Lipow.map
+    ram_report.py build/Lipow.map --top 30
+"""
+
+import argparse
+import re
+import sys
+
+RAM_REGION = "RAM"
+RAM_SECTIONS = [".data", ".bss", ".rtos", "._user_heap_stack"]
+
+RTOS_KINDS = {
+    "stack": "task stacks",
+    "tcb": "task control blocks",
+    "queue": "queue storage",
+    "qcb": "queue control blocks",
+    "scb": "semaphore control blocks",
+    "tmr": "software timers",
+}
+
+MEMORY_LINE = re.compile(r"^(\w+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+SECTION_LINE = re.compile(r"^(\s?)(\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+(\S+))?")
+
+
+def read_map(map_path):
+    """Returns the RAM length, the RAM output section sizes and the input sections of each"""
+    ram_length = None
+    outputs = {}
+    inputs = {}
+    current = None
+    pending_name = None
+
+    with open(map_path) as map_file:
+        lines = map_file.read().splitlines()
+
+    in_memory = False
+    for line in lines:
+        if line.startswith("Memory Configuration"):
+            in_memory = True
+            continue
+        if in_memory:
+            if line.startswith("Linker script and memory map"):
+                in_memory = False
+            match = MEMORY_LINE.match(line)
+            if match and match.group(1) == RAM_REGION:
+                ram_length = int(match.group(3), 16)
+            continue
+
+        # Long section names are printed alone with the address and size on the next line
+        if pending_name is not None and line.startswith("  "):
+            line = pending_name + line
+            pending_name = None
+        elif re.match(r"^\s?\S+$", line) and not line.strip().startswith("*"):
+            pending_name = line
+            continue
+        else:
+            pending_name = None
+
+        match = SECTION_LINE.match(line)
+        if not match or match.group(2) is None:
+            continue
+
+        indent, name, size, obj = match.group(1), match.group(2), int(match.group(4), 16), match.group(5)
+        if indent == "":
+            current = name if name in RAM_SECTIONS else None
+            if current is not None:
+                outputs[current] = size
+                inputs[current] = []
+        elif current is not None and size > 0 and not name.startswith("*"):
+            inputs[current].append((name, size, obj))
+
+    if ram_length is None:
+        sys.exit("%s has no %s memory region" % (map_path, RAM_REGION))
+
+    return ram_length, outputs, inputs
+
+
+def object_name(section, obj):
+    """Turns an input section name into the variable it holds where -fdata-sections gives one"""
+    for prefix in (".bss.", ".data.", ".rtos."):
+        if section.startswith(prefix):
+            return section[len(prefix):]
+    return "%s (%s)" % (section, obj.split("/")[-1] if obj else "?")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--top", type=int, default=15, help="number of .data and .bss objects to list")
+    args = parser.parse_args()
+
+    ram_length, outputs, inputs = read_map(args.map)
+    used = sum(outputs.values())
+
+    print("RAM budget, %u bytes" % ram_length)
+    for section in RAM_SECTIONS:
+        size = outputs.get(section, 0)
+        print("  %-20s %6u  %5.1f%%" % (section, size, 100.0 * size / ram_length))
+    print("  %-20s %6u  %5.1f%%" % ("free", ram_length - used, 100.0 * (ram_length - used) / ram_length))
+
+    rtos = inputs.get(".rtos", [])
+    if rtos:
+        print("\nRTOS objects")
+        totals = {}
+        for section, size, obj in rtos:
+            kind = section.split(".")[2] if section.count(".") >= 3 else "other"
+            totals[kind] = totals.get(kind, 0) + size
+        for kind, size in sorted(totals.items(), key=lambda item: -item[1]):
+            print("  %-26s %6u" % (RTOS_KINDS.get(kind, kind), size))
+        print()
+        for section, size, obj in sorted(rtos, key=lambda item: -item[1]):
+            print("  %-26s %6u" % (object_name(section, obj), size))
+
+    data = inputs.get(".data", []) + inputs.get(".bss", [])
+    if data:
+        print("\nLargest .data and .bss objects")
+        for section, size, obj in sorted(data, key=lambda item: -item[1])[:args.top]:
+            print("  %-40s %6u" % (object_name(section, obj), size))
+
+
+if __name__ == "__main__":
+    main()
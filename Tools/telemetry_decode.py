@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""
+Decodes the LiPow binary telemetry stream into CSV.
+
+Frames are COBS encoded and terminated by a 0x00 byte. The payload layout
+matches struct Telemetry_Frame in Inc/telemetry.h. CLI text mixed into the
+stream fails the length or CRC check and is skipped.
+
+Examples:
+    telemetry_decode.py --port /dev/ttyUSB0 --rate 100 > session.csv
+    telemetry_decode.py --file capture.bin > session.csv
+"""
+
+import argparse
+import struct
+import sys
+
+TELEMETRY_VERSION = 2
+
+FRAME_FORMAT = "<BBI4HHHHHHbBBBIHBBIH"
+FRAME_SIZE = struct.calcsize(FRAME_FORMAT)
+
+FIELDS = [
+    "version", "sequence", "timestamp_ms",
+    "cell1_mv", "cell2_mv", "cell3_mv", "cell4_mv",
+    "vbus_mv", "vbat_mv", "input_current_ma", "charge_current_ma", "max_charge_current_ma",
+    "mcu_temperature_c", "number_of_cells", "state", "balancing", "error_state",
+    "error_event_sequence", "error_event_type", "error_event", "error_event_ms",
+]
+
+STATE_BITS = [
+    (0x01, "xt60"),
+    (0x02, "balance"),
+    (0x04, "regulator"),
+    (0x08, "charging"),
+    (0x10, "requires_charge"),
+    (0x20, "precharge"),
+    (0x40, "input_ready"),
+]
+
+
+def crc16_ccitt_false(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    output = bytearray()
+    index = 0
+    while index < len(data):
+        code = data[index]
+        if code == 0 or index + code > len(data):
+            return None
+        output += data[index + 1:index + code]
+        index += code
+        if code != 0xFF and index < len(data):
+            output.append(0)
+    return bytes(output)
+
+
+def decode_frame(encoded):
+    payload = cobs_decode(encoded)
+    if payload is None or len(payload) != FRAME_SIZE:
+        return None
+
+    values = struct.unpack(FRAME_FORMAT, payload)
+    if values[0] != TELEMETRY_VERSION:
+        return None
+    if crc16_ccitt_false(payload[:-2]) != values[-1]:
+        return None
+
+    return dict(zip(FIELDS, values[:-1]))
+
+
+def frames(stream, follow):
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            # A serial read times out on an idle line, only a capture file ends
+            if follow:
+                continue
+            return
+        buffer += chunk
+        while True:
+            end = buffer.find(b"\x00")
+            if end < 0:
+                break
+            frame = decode_frame(bytes(buffer[:end]))
+            del buffer[:end + 1]
+            if frame is not None:
+                yield frame
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port the LiPow CLI is on")
+    source.add_argument("--file", help="raw capture to decode")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--rate", type=int, help="send 'telemetry RATE' before reading")
+    args = parser.parse_args()
+
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud, timeout=1)
+        if args.rate is not None:
+            stream.write(b"telemetry %d\r\n" % args.rate)
+    else:
+        stream = open(args.file, "rb")
+
+    state_names = [name for _, name in STATE_BITS]
+    print(",".join(FIELDS[1:] + state_names))
+
+    dropped = 0
+    last_sequence = None
+    lost_events = 0
+    last_event_sequence = None
+
+    try:
+        for frame in frames(stream, args.port is not None):
+            if last_sequence is not None:
+                dropped += (frame["sequence"] - last_sequence - 1) & 0xFF
+            last_sequence = frame["sequence"]
+
+            # Error events carry their own sequence, a gap means the device queue overflowed
+            if frame["error_event_type"] != 0:
+                if last_event_sequence is not None:
+                    lost_events += (frame["error_event_sequence"] - last_event_sequence - 1) & 0xFFFF
+                last_event_sequence = frame["error_event_sequence"]
+
+            row = [str(frame[field]) for field in FIELDS[1:]]
+            row += ["1" if frame["state"] & bit else "0" for bit, _ in STATE_BITS]
+            print(",".join(row))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if args.port and args.rate is not None:
+            stream.write(b"telemetry 0\r\n")
+        stream.close()
+
+    if dropped:
+        print("%d frames dropped" % dropped, file=sys.stderr)
+    if lost_events:
+        print("%d error events lost" % lost_events, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
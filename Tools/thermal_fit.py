@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+Fits the thermal model constants in Inc/thermal.h from a logged charge session.
+
+Reads the CSV written by telemetry_decode.py. The dissipated power is input
+power minus output power, from vbus_mv * input_current_ma and vbat_mv *
+charge_current_ma, as Thermal_Model_Update works it out on the device. The
+model is the one thermal.c steps, a first order rise over ambient:
+
+    T = ambient + rise, rise relaxes towards R * P with time constant tau
+
+For each tau on a log spaced grid the power is run through that filter, which
+leaves T linear in ambient and R, so both come out of a least squares fit.
+The tau with the smallest residual wins. The MCU temperature is only whole
+degrees, so the session needs a few power steps large enough to move it by
+several degrees, a full charge from cold is usually enough. Ambient has to be
+steady over the session.
+
+Examples:
+    telemetry_decode.py --port /dev/ttyUSB0 --rate 10 > session.csv
+    thermal_fit.py session.csv
+    thermal_fit.py session.csv --tau-min 30 --tau-max 1200
+"""
+
+import argparse
+import csv
+import math
+import sys
+
+# Below this the fit has nothing to separate R from ambient
+MIN_POWER_SPAN_W = 1.0
+
+
+def load(path):
+    times = []
+    powers = []
+    temperatures = []
+    offset_ms = 0
+    last_ms = None
+
+    with open(path, newline="") as f:
+        for row in csv.DictReader(f):
+            try:
+                timestamp_ms = int(row["timestamp_ms"])
+                input_w = int(row["vbus_mv"]) * int(row["input_current_ma"]) / 1e6
+                output_w = int(row["vbat_mv"]) * int(row["charge_current_ma"]) / 1e6
+                temperature_c = int(row["mcu_temperature_c"])
+            except (KeyError, ValueError):
+                continue
+
+            # The device timestamp is 32 bits of milliseconds
+            if last_ms is not None and timestamp_ms < last_ms:
+                offset_ms += 1 << 32
+            last_ms = timestamp_ms
+
+            times.append((timestamp_ms + offset_ms) / 1000.0)
+            powers.append(max(input_w - output_w, 0.0))
+            temperatures.append(float(temperature_c))
+
+    return times, powers, temperatures
+
+
+def filtered_power(times, powers, tau_s):
+    # Same step as thermal.c, alpha = dt / tau clamped at 1
+    rise = [0.0]
+    for i in range(1, len(times)):
+        alpha = min((times[i] - times[i - 1]) / tau_s, 1.0)
+        rise.append(rise[-1] + alpha * (powers[i - 1] - rise[-1]))
+    return rise
+
+
+def fit_linear(x, y):
+    n = len(x)
+    mean_x = sum(x) / n
+    mean_y = sum(y) / n
+    sxx = sum((a - mean_x) ** 2 for a in x)
+    if sxx == 0:
+        return None
+    sxy = sum((a - mean_x) * (b - mean_y) for a, b in zip(x, y))
+    slope = sxy / sxx
+    intercept = mean_y - slope * mean_x
+    rms = math.sqrt(sum((intercept + slope * a - b) ** 2 for a, b in zip(x, y)) / n)
+    return slope, intercept, rms
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("csv", help="session decoded by telemetry_decode.py")
+    parser.add_argument("--tau-min", type=float, default=10.0, help="shortest time constant tried, s")
+    parser.add_argument("--tau-max", type=float, default=3000.0, help="longest time constant tried, s")
+    parser.add_argument("--steps", type=int, default=200, help="time constants tried")
+    args = parser.parse_args()
+
+    times, powers, temperatures = load(args.csv)
+    if len(times) < 2:
+        sys.exit("No telemetry rows in %s" % args.csv)
+
+    duration_s = times[-1] - times[0]
+    if (max(powers) - min(powers)) < MIN_POWER_SPAN_W:
+        sys.exit("Dissipated power only spans %.2fW, log a session with a larger power step" % (max(powers) - min(powers)))
+
+    best = None
+    for step in range(args.steps):
+        tau_s = args.tau_min * (args.tau_max / args.tau_min) ** (step / (args.steps - 1))
+        fit = fit_linear(filtered_power(times, powers, tau_s), temperatures)
+        if fit is None:
+            continue
+        r_c_per_w, ambient_c, rms = fit
+        if best is None or rms < best[3]:
+            best = (tau_s, r_c_per_w, ambient_c, rms)
+
+    if best is None:
+        sys.exit("No fit, the filtered power never changed")
+
+    tau_s, r_c_per_w, ambient_c, rms = best
+    print("Rows %d over %.0fs, dissipation %.2fW to %.2fW" % (len(times), duration_s, min(powers), max(powers)))
+    print("Ambient %.1fC, residual %.2fC rms" % (ambient_c, rms))
+
+    if tau_s <= args.tau_min * 1.01 or tau_s >= args.tau_max * 0.99:
+        print("tau is at the end of the search range, widen it or log a longer session", file=sys.stderr)
+    if duration_s < 3 * tau_s:
+        print("Session is shorter than 3 tau, R may be underestimated", file=sys.stderr)
+
+    print()
+    print("#define THERMAL_R_C_PER_W\t\t\t%.1ff" % r_c_per_w)
+    print("#define THERMAL_TAU_S\t\t\t\t%.1ff" % tau_s)
+
+
+if __name__ == "__main__":
+    main()